@@ -5,6 +5,7 @@
 #include <memory>
 #include <thr_queue/coroutine.h>
 #include <thr_queue/event/future.h>
+#include <thr_queue/functor.h>
 #include <util/function_traits.h>
 #include <uv.h>
 
@@ -72,7 +73,8 @@ using aio_buffer_ptr = std::shared_ptr< aio_buffer >;
 
 struct perform_helper_base : public platform::perform_helper_impl
 {
-  /** \brief In unix it does nothing since coroutines cannot be moved between threads.
+  /** \brief In unix it does nothing since the operation is run by a thread of
+   * the blocking lane, see thr_queue::run_blocking().
    * In Windows, it schedules an APC that will run when the thread is blocked for IO.
    * That APC is responsible for scheduling the coroutine in the global thread pool.
    * This lets us only schedule the coroutine to another thread only if the operation
@@ -110,6 +112,9 @@ private:
  * in another thread. This gives it the illusion that it is not blocking.
  * After the blocking IO function returns cant_block_anymore() should be called
  * to perform any necessary cleanup.
+ * In unix the operation is run by a thread of the blocking lane of the global
+ * pool instead, so it can't use the primitives that need a coroutine, such as
+ * event::mutex, but it can wait for futures.
  */
 template < typename T >
 struct perform_helper : perform_helper_base
@@ -122,6 +127,11 @@ struct perform_helper : perform_helper_base
    */
   void set_future( thr_queue::event::future< T > fut );
 
+  /** \brief Makes aio_operation::perform() throw e, unless the future has
+   * already been set. Called when the operation throws.
+   */
+  void fail( std::exception_ptr e );
+
 private:
   bool future_already_set( ) final override;
   prom_fut_T prom_fut;
@@ -145,7 +155,7 @@ public:
 protected:
   virtual bool may_block( ) = 0;
   void replace_running_cor_and_jump( perform_helper_base& helper, thr_queue::coroutine work_cor );
-  void perform_mayblock_aio_platform( perform_helper_base& helper, thr_queue::coroutine cor );
+  void perform_mayblock_aio_platform( perform_helper_base& helper, thr_queue::inline_functor work );
 
   bool already_performed = false;
 
@@ -163,6 +173,8 @@ public:
   using aio_result_promise = game_engine::thr_queue::event::promise< T >;
 
   /** \brief Runs the operation itself and returns a future with the result.
+   * Throws thr_queue::operation_cancelled without starting it if the task
+   * group of the coroutine has been cancelled.
    */
   aio_result_future perform( );
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "aio.h"
+#include <thr_queue/cancellation.h>
+#include <thr_queue/global_thr_pool.h>
 
 namespace game_engine {
 namespace aio {
@@ -9,6 +11,7 @@ typename aio_operation_t<T>::aio_result_future
 aio_operation_t<T>::perform()
 {
 	assert(!already_performed);
+	thr_queue::check_cancellation();
 	already_performed = true;
 	if (!may_block()) {
 		return do_perform_nonblock();
@@ -17,16 +20,21 @@ aio_operation_t<T>::perform()
 		auto fut_fut = prom_fut.get_future();
 		auto helper = std::make_unique<perform_helper<T>>( std::move( prom_fut ) );
 		auto helper_ptr = helper.get();
-		auto cor_work = [helper = std::move( helper ), aio_op = this->shared_from_this()] {
+		auto work = [helper = std::move( helper ), aio_op = this->shared_from_this()] {
 				try {
+					// the thread running us is stuck until the operation returns. It
+					// does nothing if it is a thread of the blocking lane.
+					thr_queue::blocking_section blocking;
 					aio_op->do_perform_may_block( *helper );
-					helper->done();
 				} catch (std::exception &e) {
-					LOG() << "Coroutine that was running an aio operation that could block caught this exception: " << e.what();
-					throw;
+					LOG() << "Thread that was running an aio operation that could block caught this exception: " << e.what();
+					helper->fail( std::current_exception() );
+				} catch (...) {
+					helper->fail( std::current_exception() );
 				}
+				helper->done();
 			};
-		perform_mayblock_aio_platform( *helper_ptr, std::move( cor_work ) );
+		perform_mayblock_aio_platform( *helper_ptr, std::move( work ) );
 		return fut_fut.get();
 	}
 }
@@ -41,6 +49,8 @@ void
 aio_operation_t<T>::perform_on_destruction_if_need()
 {
 	if (get_perform_on_destruction() && !already_performed) {
+		// cleanup has to happen even if the coroutine has been cancelled.
+		thr_queue::cancellation_shield shield;
 		perform();
 	}
 }
@@ -58,6 +68,17 @@ perform_helper<T>::set_future( thr_queue::event::future<T> fut )
 	prom_fut.set_value( std::move( fut ) );
 }
 
+template <typename T>
+void
+perform_helper<T>::fail( std::exception_ptr e )
+{
+	// the operation might have thrown after setting the future, the caller gets
+	// that one then.
+	if (!prom_fut.already_set()) {
+		prom_fut.set_exception( std::move( e ) );
+	}
+}
+
 template <typename T>
 bool
 perform_helper<T>::future_already_set()
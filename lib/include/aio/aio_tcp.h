@@ -1,7 +1,11 @@
 #pragma once
 
 #include "aio.h"
+#include <thr_queue/channel.h>
 #include <thr_queue/event/cond_var.h>
+#include <thr_queue/io_wait.h>
+#include <atomic>
+#include <mutex>
 #include <uv.h>
 
 namespace game_engine {
@@ -78,9 +82,33 @@ private:
     std::unique_ptr< read_internal_state > read_state;
     ssize_t read_error = 0;
     thr_queue::event::promise< void > closing_prom;
+#ifndef _WIN32
+    // reads and writes are done by the workers, not by the libuv thread.
+    std::once_flag io_once;
+    std::unique_ptr< thr_queue::io_handle > io;
+    // the socket counts as one, and so does every read or write that is
+    // using io. The destructor waits for io_released before closing the fd.
+    std::atomic< unsigned int > io_users{ 1 };
+    thr_queue::event::promise< void > io_released;
+#endif
     ~data( ){};
   };
 
+#ifndef _WIN32
+  /** \brief Returns the io_handle of the socket, creating it the first time.
+   * The caller must have called acquire_io().
+   */
+  static thr_queue::io_handle& io_of( data& d );
+
+  /** \brief Counts a read or write as a user of the io_handle. Returns false
+   * if the socket is being destroyed.
+   */
+  static bool acquire_io( data& d );
+
+  /** \brief Undoes acquire_io(). */
+  static void release_io( data& d );
+#endif
+
   std::shared_ptr< data > d;
   friend class passive_tcp_socket;
   friend struct write_internal_state;
@@ -121,10 +149,9 @@ private:
   struct data
   {
     uv_tcp_t socket;
-    uint8_t awaiting_accept = 0;
+    // one element per connection that is waiting to be accepted.
+    thr_queue::channel< int > pending_accepts;
     thr_queue::event::promise< void > closing_prom;
-    thr_queue::event::mutex mt;
-    thr_queue::event::condition_variable cv;
   };
   std::shared_ptr< data > d;
 
@@ -11,6 +11,7 @@ namespace ai {
  * It calls a member function in each component called ai_update(). Components have to subclass ai::component
  * to
  * be accepted by the subsystem.
+ * The components are updated in parallel by the global thread pool.
  */
 class ai_subsystem : public util::specialized_subsystem< ai_component >
 {
@@ -13,6 +13,8 @@ class ai_component : public virtual logic::component
 public:
   /** \brief Called by ai_subsystem when it's updating all components.
    * It's where the code for updating a component should be.
+   * The components are updated in parallel, so it must not modify other
+   * components without synchronizing.
    */
   virtual void ai_update( ) = 0;
 };
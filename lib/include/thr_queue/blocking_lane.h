@@ -0,0 +1,36 @@
+#pragma once
+
+#include "thr_queue/cancellation.h"
+#include "thr_queue/event/future.h"
+#include "thr_queue/functor.h"
+#include "thr_queue/queue.h"
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+/** \brief Returns whether the caller is a coroutine of the global pool, the
+ * only callers that can wait for the blocking lane.
+ */
+bool can_use_blocking_lane( );
+
+/** \brief Queues job on the blocking lane of the global pool. The calling
+ * coroutine is parked while the queue of the lane is full.
+ */
+void submit_blocking( inline_functor job );
+}
+
+/** \brief Runs func, which may block, on one of the threads that the global
+ * pool keeps for blocking calls, and returns its result or rethrows its
+ * exception. The calling coroutine is parked meanwhile, so the workers keep
+ * running coroutines. Outside of a coroutine func is run by the calling
+ * thread.
+ * Throws operation_cancelled without running func if the task group of the
+ * coroutine has been cancelled. Once func has been queued it is waited for
+ * even if the group is cancelled, since it may refer to the caller's stack.
+ */
+template < typename F >
+auto run_blocking( F func ) -> decltype( func( ) );
+}
+}
+
+#include "thr_queue/blocking_lane.inl"
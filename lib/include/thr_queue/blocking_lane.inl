@@ -0,0 +1,48 @@
+#pragma once
+
+#include "thr_queue/blocking_lane.h"
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+template < typename R >
+R
+blocking_result( event::future< R >& fut )
+{
+  return fut.get( );
+}
+
+inline void
+blocking_result( event::future< void >& fut )
+{
+  fut.wait( );
+  if ( auto e = fut.get_exception( ) ) {
+    std::rethrow_exception( e );
+  }
+}
+}
+
+template < typename F >
+auto
+run_blocking( F func ) -> decltype( func( ) )
+{
+  using result_type = decltype( func( ) );
+  if ( !detail::can_use_blocking_lane( ) ) {
+    return func( );
+  }
+  check_cancellation( );
+
+  event::promise< result_type > prom;
+  auto fut = prom.get_future( );
+  detail::submit_blocking( [ func = std::move( func ), prom = std::move( prom ) ]( ) mutable {
+    try {
+      worker< F, result_type >::do_work_and_store( func, prom );
+    } catch ( ... ) {
+      prom.set_exception( std::current_exception( ) );
+    }
+  } );
+  cancellation_shield shield;
+  return detail::blocking_result( fut );
+}
+}
+}
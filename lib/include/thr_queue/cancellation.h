@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+struct cancellation_state;
+}
+
+/** \brief Thrown by the suspension points of a coroutine whose task group has
+ * been cancelled: mutex::lock(), condition_variable::wait(), future::wait()
+ * and aio_operation::perform(). It is also thrown by check_cancellation().
+ */
+struct operation_cancelled : std::runtime_error
+{
+  operation_cancelled( );
+};
+
+/** \brief A handle to the cancellation state of a task group. A default
+ * constructed token is never cancelled.
+ */
+class cancellation_token
+{
+public:
+  cancellation_token( ) = default;
+
+  /** \brief Returns whether the task group has been cancelled. */
+  bool is_cancelled( ) const;
+
+  /** \brief Throws operation_cancelled if the task group has been cancelled. */
+  void throw_if_cancelled( ) const;
+
+private:
+  explicit cancellation_token( std::shared_ptr< detail::cancellation_state > s );
+
+  friend class task_group;
+  friend cancellation_token this_coroutine_token( );
+
+  std::shared_ptr< detail::cancellation_state > state;
+};
+
+/** \brief Returns the token of the task group that spawned the running
+ * coroutine, or one that is never cancelled.
+ */
+cancellation_token this_coroutine_token( );
+
+/** \brief Throws operation_cancelled if the task group that spawned the
+ * running coroutine has been cancelled and no cancellation_shield is active.
+ * Long running coroutines should call it now and then.
+ */
+void check_cancellation( );
+
+/** \brief While it is alive the suspension points of the running coroutine
+ * ignore its cancellation. It is meant for cleanup code that has to wait for
+ * something to finish even if the coroutine has been cancelled.
+ */
+class cancellation_shield
+{
+public:
+  cancellation_shield( );
+  ~cancellation_shield( );
+
+  cancellation_shield( const cancellation_shield& ) = delete;
+  cancellation_shield& operator=( const cancellation_shield& ) = delete;
+};
+}
+}
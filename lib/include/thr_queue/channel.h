@@ -0,0 +1,205 @@
+#pragma once
+
+#include "thr_queue/coroutine.h"
+#include "thr_queue/event/wait_list.h"
+#include "thr_queue/thread_api.h"
+#include <atomic>
+#include <boost/optional.hpp>
+#include <concurrentqueue.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+enum class channel_status
+{
+  success,
+  // a bounded channel had no room for the value.
+  full,
+  // the channel had no values.
+  empty,
+  // the channel was closed, and for receivers it is empty too.
+  closed
+};
+
+namespace detail {
+/** \brief A bounded multi-producer multi-consumer ring, from Dmitry Vyukov's
+ * "Bounded MPMC queue". Every cell has a sequence number that tells whether
+ * it is ready to be written or read in the current lap, so producers and
+ * consumers only contend on their own position.
+ */
+template < typename T >
+class bounded_ring
+{
+public:
+  /** \brief The capacity is rounded up to a power of two. */
+  explicit bounded_ring( size_t capacity );
+  ~bounded_ring( );
+
+  /** \brief Moves val into the ring unless it is full. */
+  bool try_push( T& val );
+
+  /** \brief Moves the oldest value into val unless the ring is empty. */
+  bool try_pop( boost::optional< T >& val );
+
+  bool empty_approx( ) const;
+  bool full_approx( ) const;
+
+private:
+  struct cell
+  {
+    std::atomic< size_t > seq;
+    typename std::aligned_storage< sizeof( T ), alignof( T ) >::type storage;
+  };
+
+  const size_t mask;
+  std::unique_ptr< cell[] > cells;
+  alignas( 64 ) std::atomic< size_t > enqueue_pos{ 0 };
+  alignas( 64 ) std::atomic< size_t > dequeue_pos{ 0 };
+};
+
+class channel_selector;
+
+/** \brief The coroutines waiting for one side of a channel, and the
+ * selectors watching it.
+ * Notifying only locks when somebody is waiting.
+ */
+class channel_waiters
+{
+public:
+  ~channel_waiters( );
+
+  /** \brief Parks the calling coroutine unless ready(ctx) returns true. It is
+   * called after the coroutine is counted as a waiter, so a notification
+   * can't be missed.
+   */
+  void park_unless( bool ( *ready )( void* ), void* ctx );
+
+  /** \brief Wakes up one parked coroutine and every selector. */
+  void notify_one( );
+
+  /** \brief Wakes up every parked coroutine and every selector. */
+  void notify_all( );
+
+  void add_selector( channel_selector* sel );
+  void remove_selector( channel_selector* sel );
+
+private:
+  void notify( bool all );
+
+  event::wait_list waiters;
+  // guarded by the lock of waiters.
+  std::vector< channel_selector* > selectors;
+};
+
+/** \brief Lets a coroutine wait on several channels at once. */
+class channel_selector
+{
+public:
+  /** \brief Makes the next or current call to wait() return. */
+  void signal( );
+
+  /** \brief Parks the calling coroutine until signal() is called. */
+  void wait( );
+
+private:
+  boost::mutex mt;
+  bool signaled = false;
+  boost::optional< coroutine > parked;
+};
+
+template < typename T, typename F >
+struct recv_case;
+}
+
+/** \brief A multi-producer multi-consumer channel of values of type T.
+ * A bounded channel is backed by a lock-free ring and an unbounded one by a
+ * lock-free queue. The blocking operations can only be called from
+ * coroutines, which are parked while the channel is full or empty. The try_
+ * operations can be called from any thread.
+ * Values sent before the channel is closed can still be received after it.
+ */
+template < typename T >
+class channel
+{
+public:
+  /** \brief Creates a channel with room for capacity values, rounded up to a
+   * power of two, or an unbounded one if it is 0.
+   */
+  explicit channel( size_t capacity = 0 );
+  ~channel( );
+
+  channel( const channel& ) = delete;
+  channel& operator=( const channel& ) = delete;
+
+  /** \brief Sends val, waiting while the channel is full. Returns false, and
+   * drops val, if the channel is closed.
+   */
+  bool send( T val );
+
+  /** \brief Receives a value, waiting while the channel is empty. Returns
+   * none once the channel is closed and empty.
+   */
+  boost::optional< T > recv( );
+
+  /** \brief Sends val if there is room. It is only moved from on success. */
+  channel_status try_send( T& val );
+
+  /** \brief Moves a value into val if there is any. */
+  channel_status try_recv( T& val );
+
+  /** \brief Makes sending fail and wakes up every waiting coroutine. */
+  void close( );
+
+  bool closed( ) const;
+
+private:
+  template < typename, typename >
+  friend struct detail::recv_case;
+  template < typename... Cases >
+  friend size_t select( Cases... cases );
+
+  channel_status try_take( boost::optional< T >& val );
+  bool pop( boost::optional< T >& val );
+
+  static bool can_send( void* ch );
+  static bool can_recv( void* ch );
+
+  std::unique_ptr< detail::bounded_ring< T > > ring;
+  std::unique_ptr< moodycamel::ConcurrentQueue< T > > unbounded;
+  std::atomic< bool > is_closed{ false };
+  detail::channel_waiters senders;
+  detail::channel_waiters receivers;
+};
+
+namespace detail {
+template < typename T, typename F >
+struct recv_case
+{
+  channel< T >* ch;
+  F handler;
+  boost::optional< T > val;
+
+  // true if it has received a value or the channel is closed.
+  bool try_take( );
+};
+}
+
+/** \brief Returns a case for select() that receives from ch and calls f with
+ * the value, or with none if ch is closed.
+ */
+template < typename T, typename F >
+detail::recv_case< T, F > on_recv( channel< T >& ch, F f );
+
+/** \brief Waits until any of the channels of the cases has a value or is
+ * closed, receives from it and calls the handler of its case. Returns the
+ * index of that case. If several are ready the first one is chosen.
+ * It can only be called from a coroutine.
+ */
+template < typename... Cases >
+size_t select( Cases... cases );
+}
+}
+
+#include "thr_queue/channel.inl"
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "thr_queue/channel.h"
+#include <new>
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+inline size_t round_up_pow2(size_t n) {
+  size_t ret = 1;
+  while (ret < n) {
+    ret <<= 1;
+  }
+  return ret;
+}
+
+template <typename T>
+bounded_ring<T>::bounded_ring(size_t capacity)
+ :mask(round_up_pow2(capacity) - 1)
+ ,cells(new cell[mask + 1])
+{
+  for (size_t i = 0; i <= mask; ++i) {
+    cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+bounded_ring<T>::~bounded_ring() {
+  boost::optional<T> val;
+  while (try_pop(val)) {
+  }
+}
+
+template <typename T>
+bool bounded_ring<T>::try_push(T &val) {
+  auto pos = enqueue_pos.load(std::memory_order_relaxed);
+  cell *c;
+  while (true) {
+    c = &cells[pos & mask];
+    auto seq = c->seq.load(std::memory_order_acquire);
+    auto dif = std::intptr_t(seq) - std::intptr_t(pos);
+    if (dif == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (dif < 0) {
+      // the cell hasn't been read in the previous lap.
+      return false;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  new (&c->storage) T(std::move(val));
+  c->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool bounded_ring<T>::try_pop(boost::optional<T> &val) {
+  auto pos = dequeue_pos.load(std::memory_order_relaxed);
+  cell *c;
+  while (true) {
+    c = &cells[pos & mask];
+    auto seq = c->seq.load(std::memory_order_acquire);
+    auto dif = std::intptr_t(seq) - std::intptr_t(pos + 1);
+    if (dif == 0) {
+      if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (dif < 0) {
+      // the cell hasn't been written in this lap.
+      return false;
+    } else {
+      pos = dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  auto ptr = reinterpret_cast<T *>(&c->storage);
+  val = std::move(*ptr);
+  ptr->~T();
+  c->seq.store(pos + mask + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool bounded_ring<T>::empty_approx() const {
+  auto pos = dequeue_pos.load(std::memory_order_relaxed);
+  auto seq = cells[pos & mask].seq.load(std::memory_order_acquire);
+  return std::intptr_t(seq) - std::intptr_t(pos + 1) < 0;
+}
+
+template <typename T>
+bool bounded_ring<T>::full_approx() const {
+  auto pos = enqueue_pos.load(std::memory_order_relaxed);
+  auto seq = cells[pos & mask].seq.load(std::memory_order_acquire);
+  return std::intptr_t(seq) - std::intptr_t(pos) < 0;
+}
+
+template <typename T, typename F>
+bool recv_case<T, F>::try_take() {
+  return ch->try_take(val) != channel_status::empty;
+}
+
+inline bool try_cases(size_t &) {
+  return false;
+}
+
+template <typename Case, typename... Cases>
+bool try_cases(size_t &index, Case &c, Cases &... cases) {
+  if (c.try_take()) {
+    return true;
+  }
+  ++index;
+  return try_cases(index, cases...);
+}
+
+inline void run_case(size_t) {
+}
+
+template <typename Case, typename... Cases>
+void run_case(size_t index, Case &c, Cases &... cases) {
+  if (index == 0) {
+    c.handler(std::move(c.val));
+  } else {
+    run_case(index - 1, cases...);
+  }
+}
+}
+
+template <typename T>
+channel<T>::channel(size_t capacity) {
+  if (capacity == 0) {
+    unbounded = std::make_unique<moodycamel::ConcurrentQueue<T>>();
+  } else {
+    ring = std::make_unique<detail::bounded_ring<T>>(capacity);
+  }
+}
+
+template <typename T>
+channel<T>::~channel() = default;
+
+template <typename T>
+bool channel<T>::send(T val) {
+  while (true) {
+    switch (try_send(val)) {
+    case channel_status::success:
+      return true;
+    case channel_status::closed:
+      return false;
+    default:
+      senders.park_unless(&channel::can_send, this);
+    }
+  }
+}
+
+template <typename T>
+boost::optional<T> channel<T>::recv() {
+  boost::optional<T> val;
+  while (try_take(val) == channel_status::empty) {
+    receivers.park_unless(&channel::can_recv, this);
+  }
+  return val;
+}
+
+template <typename T>
+channel_status channel<T>::try_send(T &val) {
+  if (closed()) {
+    return channel_status::closed;
+  }
+
+  if (ring) {
+    if (!ring->try_push(val)) {
+      return channel_status::full;
+    }
+  } else if (!unbounded->enqueue(std::move(val))) {
+    throw std::bad_alloc();
+  }
+  receivers.notify_one();
+  return channel_status::success;
+}
+
+template <typename T>
+channel_status channel<T>::try_recv(T &val) {
+  boost::optional<T> taken;
+  auto status = try_take(taken);
+  if (status == channel_status::success) {
+    val = std::move(*taken);
+  }
+  return status;
+}
+
+template <typename T>
+channel_status channel<T>::try_take(boost::optional<T> &val) {
+  if (pop(val)) {
+    senders.notify_one();
+    return channel_status::success;
+  }
+  // values sent before closing the channel can still be received.
+  if (closed()) {
+    return pop(val) ? channel_status::success : channel_status::closed;
+  }
+  return channel_status::empty;
+}
+
+template <typename T>
+bool channel<T>::pop(boost::optional<T> &val) {
+  if (ring) {
+    return ring->try_pop(val);
+  }
+  return unbounded->try_dequeue(val);
+}
+
+template <typename T>
+void channel<T>::close() {
+  is_closed = true;
+  senders.notify_all();
+  receivers.notify_all();
+}
+
+template <typename T>
+bool channel<T>::closed() const {
+  return is_closed;
+}
+
+template <typename T>
+bool channel<T>::can_send(void *ptr) {
+  auto ch = static_cast<channel *>(ptr);
+  return ch->closed() || !ch->ring->full_approx();
+}
+
+template <typename T>
+bool channel<T>::can_recv(void *ptr) {
+  auto ch = static_cast<channel *>(ptr);
+  if (ch->closed()) {
+    return true;
+  }
+  return ch->ring ? !ch->ring->empty_approx() : ch->unbounded->size_approx() > 0;
+}
+
+template <typename T, typename F>
+detail::recv_case<T, F> on_recv(channel<T> &ch, F f) {
+  return detail::recv_case<T, F>{&ch, std::move(f), boost::none};
+}
+
+template <typename... Cases>
+size_t select(Cases... cases) {
+  size_t index = 0;
+  if (!detail::try_cases(index, cases...)) {
+    // the selector is registered before checking again, so a value sent
+    // after the check signals it.
+    detail::channel_selector sel;
+    int add[]{0, (cases.ch->receivers.add_selector(&sel), 0)...};
+    (void) add;
+    while (index = 0, !detail::try_cases(index, cases...)) {
+      sel.wait();
+    }
+    int remove[]{0, (cases.ch->receivers.remove_selector(&sel), 0)...};
+    (void) remove;
+  }
+  detail::run_case(index, cases...);
+  return index;
+}
+}
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "thr_queue/functor.h"
+#include "thr_queue/work_options.h"
 #include <memory>
 
 namespace game_engine {
@@ -9,6 +10,12 @@ namespace platform {
 class worker_thread_impl;
 }
 class worker_thread;
+class cancellation_shield;
+class cancellation_token;
+cancellation_token this_coroutine_token( );
+namespace detail {
+struct cancellation_state;
+}
 
 enum class coroutine_type
 {
@@ -29,16 +36,16 @@ struct cor_data_deleter
 class coroutine
 {
 public:
-  /** \brief Constructs a coroutine that executes func when switched to. Its type
-   * will be cor_typ.
+  /** \brief Constructs a coroutine that executes func when switched to. Its
+   * stack is chosen according to opts.
    */
   template < typename F >
-  coroutine( F func );
+  coroutine( F func, work_options opts = work_options( ) );
 
   ~coroutine( );
 
   /** \brief Construct a coroutine based on a functor. */
-  coroutine( functor_ptr func );
+  coroutine( inline_functor func, work_options opts = work_options( ) );
 
   coroutine( coroutine&& other ) = default;
   coroutine& operator=( coroutine&& rhs ) = default;
@@ -47,6 +54,9 @@ public:
    */
   coroutine_type type( ) const;
 
+  /** \brief Returns the size class of the stack the coroutine runs on. */
+  stack_size_class stack_size( ) const;
+
   /** \brief Switches from this coroutine to the one passed as an argument.
    */
   void switch_to_from( coroutine& from );
@@ -70,6 +80,9 @@ private:
   friend class generic_worker_thread;
   friend class platform::worker_thread_impl;
   friend struct cor_data;
+  friend class cancellation_shield;
+  friend struct detail::cancellation_state;
+  friend cancellation_token this_coroutine_token( );
 
 private:
   std::unique_ptr< cor_data, cor_data_deleter > data_ptr;
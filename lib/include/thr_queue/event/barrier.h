@@ -0,0 +1,40 @@
+#pragma once
+
+#include "thr_queue/event/wait_list.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+/** \brief A reusable barrier for a fixed number of coroutines.
+ * Every phase ends when the expected number of coroutines has arrived, and
+ * then the next one starts. Reusing it doesn't allocate memory once its list
+ * of parked coroutines has grown to the number of participants.
+ */
+class barrier
+{
+public:
+  explicit barrier( std::ptrdiff_t expected );
+
+  /** \brief Parks the coroutine until every participant has arrived. */
+  void arrive_and_wait( );
+
+  /** \brief Arrives and removes the coroutine from the participants of the
+   * next phases, without waiting.
+   */
+  void arrive_and_drop( );
+
+private:
+  // returns the phase that the coroutine arrived at.
+  uint64_t arrive( std::ptrdiff_t drop );
+
+  std::atomic< std::ptrdiff_t > expected;
+  std::atomic< std::ptrdiff_t > remaining;
+  std::atomic< uint64_t > phase{ 0 };
+  wait_list waiters;
+};
+}
+}
+}
@@ -3,7 +3,11 @@
 #include "thr_queue/coroutine.h"
 #include "thr_queue/event/mutex.h"
 #include "thr_queue/thread_api.h"
+#include "thr_queue/timer.h"
+#include "thr_queue/trace.h"
+#include <condition_variable>
 #include <deque>
+#include <memory>
 
 namespace game_engine {
 namespace thr_queue {
@@ -11,14 +15,39 @@ namespace event {
 class condition_variable
 {
 public:
+  /** \brief reason is what traces show when a coroutine waits on it. */
+  explicit condition_variable( block_reason reason = block_reason::cond_var );
+
   void notify( );
+
+  /** \brief Unlocks lock and waits until notify() is called. lock is held
+   * again when it returns. If the task group of the coroutine is cancelled it
+   * stops waiting and throws operation_cancelled.
+   */
   void wait( boost::unique_lock< mutex >& lock );
 
+  /** \brief Like wait() but it gives up once deadline has passed. */
+  std::cv_status wait_until( boost::unique_lock< mutex >& lock, timer_clock::time_point deadline );
+
+  template < typename Rep, typename Period >
+  std::cv_status
+  wait_for( boost::unique_lock< mutex >& lock, const std::chrono::duration< Rep, Period >& d )
+  {
+    return wait_until( lock, timer_clock::now( ) + std::chrono::duration_cast< timer_clock::duration >( d ) );
+  }
+
   ~condition_variable( );
 
 private:
+  /** \brief Waits until notify() is called or deadline, if it isn't null, has
+   * passed. Returns whether it gave up because of the deadline.
+   */
+  bool park( boost::unique_lock< mutex >& lock, const timer_clock::time_point* deadline );
+
+  const block_reason reason;
   boost::mutex mt;
-  std::deque< coroutine > waiting_cors;
+  // only allocated once a coroutine waits.
+  std::unique_ptr< std::deque< coroutine > > waiting_cors;
 };
 }
 }
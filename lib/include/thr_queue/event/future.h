@@ -2,40 +2,98 @@
 
 #include "cond_var.h"
 #include <boost/optional.hpp>
-#include <list>
 #include <memory>
 #include <stdexcept>
 #include <thr_queue/functor.h>
+#include <thr_queue/pool_allocator.h>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 // shamelessly copied from boost::promise and boost::future
 
 namespace game_engine {
 namespace thr_queue {
 namespace event {
+/** \brief The state of a promise.
+ * alive_waiting means that it isn't set yet and a coroutine is waiting on the
+ * condition variable, so setting it has to notify it. Otherwise the promise
+ * is set without locking.
+ */
 enum class promise_status
 {
   alive_not_set,
+  alive_waiting,
   alive_set,
   dead_set,
 };
 
-struct future_promise_priv_shared : std::enable_shared_from_this< future_promise_priv_shared >
+/** \brief What is needed to wait for a promise. Most promises are set
+ * before anybody waits for them, so it is only allocated by the first wait.
+ */
+struct promise_waiters
 {
+  // only used by the coroutines that wait for the promise to be set.
   mutex mt;
-  condition_variable cv;
-  std::list< std::weak_ptr< condition_variable > > when_any_callbacks;
+  condition_variable cv{ block_reason::future };
+  // functions to call once the promise is set. They have their own lock so
+  // that they can be added by threads that aren't running a coroutine.
+  boost::mutex continuations_mt;
+  std::vector< inline_functor > continuations;
+  bool continuations_run = false;
+};
+
+struct future_promise_priv_shared : std::enable_shared_from_this< future_promise_priv_shared >
+{
+  future_promise_priv_shared( ) = default;
+  future_promise_priv_shared( const future_promise_priv_shared& ) = delete;
+  future_promise_priv_shared& operator=( const future_promise_priv_shared& ) = delete;
+  ~future_promise_priv_shared( );
+
   functor_ptr wait_callback = nullptr;
   std::exception_ptr except_ptr;
   std::atomic< promise_status > prom_status{ promise_status::alive_not_set };
   std::atomic< bool > scheduled_set_func{ false };
+  // null until somebody waits, see get_waiters().
+  std::atomic< promise_waiters* > waiters{ nullptr };
+
+  /** \brief Returns the waiters of the promise, allocating them the first
+   * time. A setter that doesn't see them has already set the promise before
+   * they were published, so whoever called this has to check is_set().
+   */
+  promise_waiters& get_waiters( );
 
-  void notify_all_cvs( functor_ptr func );
+  /** \brief Returns whether there are continuations waiting to be run. */
+  bool has_continuations( );
+
+  /** \brief Calls func, which stores the value or the exception, marks the
+   * promise as set and wakes up whoever was waiting for it.
+   */
+  void notify_all_cvs( inline_functor func );
+
+  /** \brief Returns whether the promise has been set. It never locks. */
+  bool is_set( ) const;
+
+  /** \brief Calls func once the promise is set. If it already is, func is
+   * called immediately, or by the global pool if the caller isn't running a
+   * coroutine.
+   */
+  void add_continuation( inline_functor func );
+
+private:
+  void run_continuations( );
 };
 
 template < typename R >
 struct future_promise_priv : future_promise_priv_shared
 {
   boost::optional< R > val;
+  // the value can only be taken by a single call to future::get.
+  std::atomic< bool > val_taken{ false };
+#ifndef NDEBUG
+  // set while future::get or future::peek read the value, see future.
+  std::atomic< bool > consuming{ false };
+#endif
 };
 
 template <>
@@ -124,11 +182,33 @@ protected:
   virtual future_promise_priv_shared& get_priv( ) const = 0;
 
 public:
+  /** \brief Waits until the promise is set. A coroutine whose task group is
+   * cancelled while it waits stops and throws operation_cancelled.
+   */
   void wait( ) const;
 
+  /** \brief Like wait() but it gives up once deadline has passed. Returns
+   * whether the future is ready.
+   */
+  bool wait_until( timer_clock::time_point deadline ) const;
+
+  template < typename Rep, typename Period >
+  bool
+  wait_for( const std::chrono::duration< Rep, Period >& d ) const
+  {
+    return wait_until( timer_clock::now( ) + std::chrono::duration_cast< timer_clock::duration >( d ) );
+  }
+
   std::exception_ptr get_exception( ) const;
 
   bool ready( ) const;
+
+  /** \brief Calls f once the future is ready, without waiting for it.
+   * f runs in the coroutine that sets the promise, or in the calling one if
+   * the future is already ready. When that thread isn't running a coroutine, f
+   * is submitted to default_par_queue() instead. f must not block.
+   */
+  void on_ready( inline_functor f ) const;
 };
 
 template < typename R >
@@ -139,18 +219,36 @@ class future_base : public future_generic_base
 public:
   using value_type = R;
 
+  /** \brief Returns a future that is set to f(fut), where fut is a copy of this
+   * future, once this one is ready. If f throws, the returned future holds the
+   * exception.
+   * f is run like the functions passed to on_ready(), so it must not block.
+   */
+  template < typename F >
+  auto then( F f ) const -> future< typename std::result_of< F( future< R > ) >::type >;
+
 protected:
   future_base( std::shared_ptr< future_promise_priv< R > > d_ );
 
   std::shared_ptr< future_promise_priv< R > > d;
 };
 
+/** \brief The value of a future has a single consumer, like std::future.
+ * get() and peek() read it without locking, so they must not be called at the
+ * same time on copies of the same future. Debug builds assert it.
+ */
 template < typename R >
 class future : public future_base< R >
 {
 public:
+  /** \brief Waits for the promise and moves its value out. Later calls throw
+   * future_was_emptied_before.
+   */
   R get( );
 
+  /** \brief Waits for the promise and returns its value, which stays valid
+   * until get() is called.
+   */
   const R& peek( ) const;
 
 private:
@@ -173,14 +271,43 @@ future< T > future_with_value( T val );
 template < typename T, typename E >
 future< T > future_with_exception( E e );
 
+/** \brief Returns a future that is set once every future in [first, last) is
+ * ready. Its value holds copies of them.
+ */
+template < typename InIt >
+future< std::vector< typename std::iterator_traits< InIt >::value_type > > when_all( InIt first,
+                                                                                  InIt last );
+
+/** \brief Returns a future that is set once every future passed is ready. Its
+ * value holds copies of them.
+ */
+template < typename... Rs >
+future< std::tuple< future< Rs >... > > when_all( const future< Rs >&... futs );
+
+/** \brief Returns a future that is set to the index of the first future in
+ * [first, last) that becomes ready. It holds an exception if the range is
+ * empty.
+ */
+template < typename InIt >
+future< size_t > when_any( InIt first, InIt last );
+
+/** \brief Returns a future that is set to the index of the first of the
+ * futures passed that becomes ready.
+ */
+template < typename... Rs >
+future< size_t > when_any( const future< Rs >&... futs );
+
+/** \brief Waits for any future in [first, last) and returns an iterator to it.
+ */
 template < typename InIt >
-typename std::allocator_traits< InIt >::reference_type wait_any( InIt first, InIt last );
+InIt wait_any( InIt first, InIt last );
 
 template < typename InIt >
 void wait_all( InIt first, InIt last );
 
+/** \brief Waits for any of the futures passed and returns its index. */
 template < typename... Rs >
-size_t wait_any( const future< Rs >&... );
+size_t wait_any( const future< Rs >&... futs );
 
 template < typename... Rs >
 void wait_all( const future< Rs >&... );
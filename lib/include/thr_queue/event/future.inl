@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <boost/iterator/indirect_iterator.hpp>
+#include <cassert>
 #include "future.h"
 #include <logging/log.h>
 #include <thr_queue/global_thr_pool.h>
@@ -12,7 +13,7 @@ namespace thr_queue {
 namespace event {
 template<typename R>
 promise_base<R>::promise_base()
- :d(std::make_shared<future_promise_priv<R>>())
+ :d(std::allocate_shared<future_promise_priv<R>>(pool_allocator<future_promise_priv<R>>()))
 {}
 
 template<typename R>
@@ -20,8 +21,7 @@ promise_base<R>::~promise_base()
 {
   if (d) {
     if (d.use_count() > 1) {
-      if (d->prom_status == promise_status::alive_set
-          || d->scheduled_set_func) {
+      if (d->is_set() || d->scheduled_set_func) {
         return;
       }
       auto work_to_do = [d = d] {
@@ -29,9 +29,9 @@ promise_base<R>::~promise_base()
         LOG() << msg;
         d->except_ptr = std::make_exception_ptr(promise_dead_before_completion(msg));
       };
-      d->notify_all_cvs(make_functor(std::move(work_to_do)));
+      d->notify_all_cvs(std::move(work_to_do));
     } else { // no futures
-      assert(d->when_any_callbacks.size() == 0);
+      assert(!d->has_continuations());
     }
   }
 }
@@ -57,9 +57,9 @@ void promise_base<R>::set_exception(std::exception_ptr e)
     throw promise_already_set("attempting to set an already set promise");
   }
 
-  this->d->notify_all_cvs(make_functor([d = d, e = std::move(e)] {
+  this->d->notify_all_cvs([d = d, e = std::move(e)] {
     d->except_ptr = std::move(e);
-  }));
+  });
 }
 
 template<typename R>
@@ -73,7 +73,7 @@ template<typename R>
 template<typename F>
 void promise_base<R>::set_wait_callback(F f)
 {
-  boost::lock_guard<mutex> l(d->mt);
+  boost::lock_guard<mutex> l(d->get_waiters().mt);
   d->wait_callback = make_functor(std::move(f));
 }
 
@@ -106,57 +106,129 @@ void swap(promise_base<R>& lhs, promise_base<R>& rhs)
 }
 
 template<typename InIt>
-typename std::allocator_traits<InIt>::reference_type wait_any(InIt, InIt)
+future<std::vector<typename std::iterator_traits<InIt>::value_type>>
+when_all(InIt first, InIt last)
 {
-  return typename std::allocator_traits<InIt>::reference_type();
-}
+  using futures = std::vector<typename std::iterator_traits<InIt>::value_type>;
+  struct state {
+    std::atomic<size_t> remaining{0};
+    promise<futures> prom;
+    futures futs;
+  };
 
-template<typename InIt>
-void wait_all(InIt first, InIt last)
-{
-  std::for_each(first, last, [](auto fut) {
-    fut.wait();
-  });
+  auto st = std::make_shared<state>();
+  st->futs.assign(first, last);
+  auto fut = st->prom.get_future();
+  if (st->futs.empty()) {
+    st->prom.set_value(futures());
+    return fut;
+  }
+
+  st->remaining = st->futs.size();
+  for (auto &f : st->futs) {
+    f.on_ready([st] {
+      if (--st->remaining == 0) {
+        st->prom.set_value(std::move(st->futs));
+      }
+    });
+  }
+  return fut;
 }
 
 template<typename... Rs>
-size_t wait_any(const future<Rs>&... futs)
+future<std::tuple<future<Rs>...>> when_all(const future<Rs>&... futs)
 {
-  auto check_ready = [&]() -> boost::optional<size_t> {
-    bool any_ready[] = {futs.ready()...};
-    for (size_t i = 0; i < sizeof...(Rs); ++i) {
-      if (any_ready[i]) {
-        return i;
-      }
-    }
-    return boost::none;
+  using futures = std::tuple<future<Rs>...>;
+  struct state {
+    state(const future<Rs>&... fs)
+     :futs(fs...)
+    {}
+
+    std::atomic<size_t> remaining{sizeof...(Rs)};
+    promise<futures> prom;
+    futures futs;
   };
 
-  if (auto index = check_ready()) {
-    return *index;
+  auto st = std::make_shared<state>(futs...);
+  auto fut = st->prom.get_future();
+  if (sizeof...(Rs) == 0) {
+    st->prom.set_value(std::move(st->futs));
+    return fut;
   }
 
-  auto shared_cv = std::make_shared<condition_variable>();
-  promise<void> cor_prom;
-  future<void> cor_cut = cor_prom.get_future();
+  auto on_ready = [st] {
+    if (--st->remaining == 0) {
+      st->prom.set_value(std::move(st->futs));
+    }
+  };
+  int expand[]{0, (futs.on_ready(on_ready), 0)...};
+  (void) expand;
+  return fut;
+}
 
-  std::vector<boost::unique_lock<boost::mutex>> locks;
-  std::vector<std::vector<std::weak_ptr<condition_variable>>*> cv_vectors;
-  locks.reserve(sizeof...(Rs));
-  cv_vectors.reserve(sizeof...(Rs));
+namespace detail {
+// shared by the continuations of when_any, the first one to run sets prom.
+struct when_any_state {
+  std::atomic<bool> done{false};
+  promise<size_t> prom;
 
-  auto preproc = [&](auto future) {
-    auto &d = const_cast<std::remove_const_t<decltype(*future.d)>>(*future.d);
-    locks.emplace_back(d->os_mt, boost::defer_lock);
-    cv_vectors.emplace_back(&d->when_any_callbacks);
-  };
+  void set(size_t index) {
+    if (!done.exchange(true)) {
+      prom.set_value(index);
+    }
+  }
+};
+}
 
-  int l{(preproc(futs),0)...};
-  (void) l;
-  boost::lock(begin(locks), end(locks));
-  for (auto *cv_vec : cv_vectors) {
-    cv_vec->emplace_back(shared_cv);
+template<typename InIt>
+future<size_t> when_any(InIt first, InIt last)
+{
+  if (first == last) {
+    return future_with_exception<size_t>(
+      std::runtime_error("when_any called with an empty range"));
   }
+
+  auto st = std::make_shared<detail::when_any_state>();
+  auto fut = st->prom.get_future();
+  size_t index = 0;
+  for (; first != last; ++first, ++index) {
+    first->on_ready([st, index] { st->set(index); });
+  }
+  return fut;
+}
+
+template<typename... Rs>
+future<size_t> when_any(const future<Rs>&... futs)
+{
+  static_assert(sizeof...(Rs) > 0, "when_any needs at least one future");
+  auto st = std::make_shared<detail::when_any_state>();
+  auto fut = st->prom.get_future();
+  size_t index = 0;
+  int expand[]{(futs.on_ready([st, i = index++] { st->set(i); }), 0)...};
+  (void) expand;
+  return fut;
+}
+
+template<typename InIt>
+InIt wait_any(InIt first, InIt last)
+{
+  auto index = when_any(first, last).get();
+  std::advance(first, index);
+  return first;
+}
+
+template<typename InIt>
+void wait_all(InIt first, InIt last)
+{
+  std::for_each(first, last, [](auto fut) {
+    fut.wait();
+  });
+}
+
+template<typename... Rs>
+size_t wait_any(const future<Rs>&... futs)
+{
+  return when_any(futs...).get();
 }
 
 template<typename... Rs>
@@ -182,10 +254,10 @@ void promise<R>::set_value(R val)
     throw promise_already_set("attempting to set an already set promise");
   }
 
-  this->d->notify_all_cvs(make_functor([d = this->d, val = std::move(val)] ()
+  this->d->notify_all_cvs([d = this->d, val = std::move(val)] ()
         mutable {
     d->val = std::move(val);
-  }));
+  });
 }
 
 template<typename R>
@@ -199,15 +271,73 @@ game_engine::thr_queue::event::future_base<R>::future_base(std::shared_ptr<futur
  :d(std::move(d_))
 {}
 
+namespace detail {
+// asserts that the get() and peek() calls of a value don't overlap.
+template<typename R>
+struct consumer_check {
+#ifndef NDEBUG
+  explicit consumer_check(future_promise_priv<R> &d_) : d(d_) {
+    bool overlapped = d.consuming.exchange(true);
+    assert(!overlapped && "a future has a single consumer");
+    (void) overlapped;
+  }
+  ~consumer_check() { d.consuming = false; }
+
+  future_promise_priv<R> &d;
+#else
+  explicit consumer_check(future_promise_priv<R> &) {}
+#endif
+};
+
+template<typename T, typename F, typename... Args>
+void fulfill(promise<T> &prom, F &f, Args&&... args)
+{
+  try {
+    prom.set_value(f(std::forward<Args>(args)...));
+  } catch (...) {
+    prom.set_exception(std::current_exception());
+  }
+}
+
+template<typename F, typename... Args>
+void fulfill(promise<void> &prom, F &f, Args&&... args)
+{
+  try {
+    f(std::forward<Args>(args)...);
+    prom.set_value();
+  } catch (...) {
+    prom.set_exception(std::current_exception());
+  }
+}
+}
+
+template<typename R>
+template<typename F>
+auto future_base<R>::then(F f) const
+  -> future<typename std::result_of<F(future<R>)>::type>
+{
+  using T = typename std::result_of<F(future<R>)>::type;
+  promise<T> prom;
+  auto fut = prom.get_future();
+  future<R> self = static_cast<const future<R>&>(*this);
+  this->on_ready([f = std::move(f), prom = std::move(prom), self = std::move(self)]
+                 () mutable {
+    detail::fulfill(prom, f, std::move(self));
+  });
+  return fut;
+}
+
 template<typename R>
 R future<R>::get()
 {
+  // once the promise is set its value and exception don't change, so they can
+  // be read without locking.
   this->wait();
-  boost::lock_guard<mutex> l(this->d->mt);
+  detail::consumer_check<R> check(*this->d);
   if (this->d->except_ptr) {
     std::rethrow_exception(this->d->except_ptr);
     abort();
-  } else if (this->d->val) {
+  } else if (!this->d->val_taken.exchange(true)) {
     R val = std::move(*this->d->val);
     this->d->val = boost::none;
     return val;
@@ -220,11 +350,11 @@ template<typename R>
 const R &future<R>::peek() const
 {
   this->wait();
-  boost::lock_guard<mutex> l(this->d->mt);
+  detail::consumer_check<R> check(*this->d);
   if (this->d->except_ptr) {
     std::rethrow_exception(this->d->except_ptr);
     abort();
-  } else if (this->d->val) {
+  } else if (!this->d->val_taken) {
     return *this->d->val;
   } else {
     throw future_was_emptied_before("the future was emptied before");
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "thr_queue/event/wait_list.h"
+#include <atomic>
+#include <cstddef>
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+/** \brief A single-use counter that coroutines can wait to reach zero.
+ * Counting down is a single atomic operation unless it reaches zero, the last
+ * count_down() takes the lock of the waiters so that a coroutine that returns
+ * from wait() can destroy the latch.
+ */
+class latch
+{
+public:
+  explicit latch( std::ptrdiff_t expected );
+
+  /** \brief Decrements the counter by n, it must not go below zero. */
+  void count_down( std::ptrdiff_t n = 1 );
+
+  /** \brief Returns whether the counter has reached zero. */
+  bool try_wait( ) const;
+
+  /** \brief Parks the coroutine until the counter reaches zero. */
+  void wait( );
+
+  void arrive_and_wait( std::ptrdiff_t n = 1 );
+
+private:
+  std::atomic< std::ptrdiff_t > count;
+  wait_list waiters;
+};
+}
+}
+}
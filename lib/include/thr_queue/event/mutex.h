@@ -1,25 +1,111 @@
 #pragma once
 
 #include "thr_queue/thread_api.h"
+#include "thr_queue/timer.h"
 #include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
 
 namespace game_engine {
 namespace thr_queue {
 class coroutine;
 
 namespace event {
+/** \brief How a coroutine waits for a mutex owned by another one.
+ * * adaptive: it spins for a while, adjusted to how long the mutex took to be
+ *   released in the past, before yielding. Good for short critical sections.
+ * * park: it yields immediately.
+ */
+enum class mutex_mode
+{
+  adaptive,
+  park
+};
+
+/** \brief Contention counters of a mutex. */
+struct mutex_stats
+{
+  uint64_t acquisitions = 0;
+  // acquisitions that found the mutex locked.
+  uint64_t contended = 0;
+  // contended acquisitions that got the mutex while spinning.
+  uint64_t spin_acquired = 0;
+  // contended acquisitions that had to yield.
+  uint64_t parked = 0;
+  // unlocks that passed the mutex directly to a waiting coroutine.
+  uint64_t handoffs = 0;
+};
+
+/** \brief A mutex for coroutines.
+ * A coroutine that can't lock it either spins or yields, depending on the
+ * mode. When it is unlocked with coroutines waiting, the ownership is handed
+ * to the first of them, so that they can't be starved by coroutines that keep
+ * locking it while spinning. The new owner is scheduled ahead of other work
+ * on the worker it last ran on, not on the unlocking one: on Linux coroutines
+ * are bound to the worker that first runs them, and elsewhere the
+ * work_stealing scheduler queues it on its last worker.
+ */
 class mutex
 {
 public:
+  explicit mutex( mutex_mode mode = mutex_mode::adaptive );
   ~mutex( );
+
+  /** \brief Locks the mutex. If the coroutine has to wait and its task group
+   * is cancelled, it gives up and throws operation_cancelled.
+   */
   void lock( );
   bool try_lock( );
   void unlock( );
 
+  /** \brief Like lock() but it gives up once deadline has passed. Returns
+   * whether the mutex was locked.
+   */
+  bool try_lock_until( timer_clock::time_point deadline );
+
+  template < typename Rep, typename Period >
+  bool
+  try_lock_for( const std::chrono::duration< Rep, Period >& d )
+  {
+    return try_lock_until( timer_clock::now( ) + std::chrono::duration_cast< timer_clock::duration >( d ) );
+  }
+
+  /** \brief Returns the contention counters since the mutex was created. */
+  mutex_stats stats( ) const;
+
 private:
+  /** \brief Counts an acquisition. Only the owner calls it. */
+  void note_acquired( );
+
+  bool spin_lock( );
+  /** \brief Yields until the mutex is handed to us. If deadline isn't null it
+   * gives up once it has passed and returns false. It throws
+   * operation_cancelled if the task group of the coroutine is cancelled.
+   */
+  bool park_lock( const timer_clock::time_point* deadline );
+
+  struct counters
+  {
+    std::atomic< uint64_t > acquisitions{ 0 };
+    std::atomic< uint64_t > contended{ 0 };
+    std::atomic< uint64_t > spin_acquired{ 0 };
+    std::atomic< uint64_t > parked{ 0 };
+    std::atomic< uint64_t > handoffs{ 0 };
+  };
+
+  const mutex_mode mode;
+  // the address of the owning coroutine, or 0 if it is unlocked. The lowest
+  // bit is set while coroutines are parked, so that unlock() hands the mutex to
+  // them.
+  std::atomic< uintptr_t > state{ 0 };
+  // running average of the spins that it took to lock the mutex.
+  std::atomic< uint32_t > spin_estimate{ 0 };
+  counters cnt;
+  // protects waiting_cors and the bit of state that marks them.
   boost::mutex mt;
-  coroutine* owning_cor = nullptr;
-  std::deque< coroutine > waiting_cors;
+  // only allocated once a coroutine has to wait.
+  std::unique_ptr< std::deque< coroutine > > waiting_cors;
 };
 }
 }
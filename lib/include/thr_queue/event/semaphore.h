@@ -0,0 +1,33 @@
+#pragma once
+
+#include "thr_queue/event/wait_list.h"
+#include <atomic>
+#include <cstddef>
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+/** \brief A counting semaphore for coroutines.
+ * acquire() takes a unit, parking the coroutine while there are none, and
+ * release() returns them. While there are units left it is just an atomic
+ * counter.
+ */
+class semaphore
+{
+public:
+  explicit semaphore( std::ptrdiff_t initial = 0 );
+
+  void acquire( );
+
+  /** \brief Takes a unit if there is one, without waiting. */
+  bool try_acquire( );
+
+  void release( std::ptrdiff_t n = 1 );
+
+private:
+  std::atomic< std::ptrdiff_t > count;
+  wait_list waiters;
+};
+}
+}
+}
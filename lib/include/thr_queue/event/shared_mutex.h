@@ -0,0 +1,55 @@
+#pragma once
+
+#include "thr_queue/thread_api.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace game_engine {
+namespace thr_queue {
+class coroutine;
+
+namespace event {
+/** \brief A reader/writer lock for coroutines that prefers writers.
+ * Any number of coroutines can hold it shared, or one of them exclusively.
+ * Once a writer is waiting no new readers get the lock, and an unlocking
+ * writer hands it to the next waiting writer before letting readers in.
+ * Coroutines that can't get it yield until they are handed the lock.
+ * Taking and releasing it shared while no writer is around is a single
+ * atomic operation. It works with boost::shared_lock and boost::unique_lock.
+ */
+class shared_mutex
+{
+public:
+  ~shared_mutex( );
+
+  void lock( );
+  bool try_lock( );
+  void unlock( );
+
+  void lock_shared( );
+  bool try_lock_shared( );
+  void unlock_shared( );
+
+private:
+  void lock_slow( );
+  void lock_shared_slow( );
+  void wake_writer( );
+
+  // number of readers that hold the lock, plus the flags.
+  static const uint32_t writer_held    = uint32_t( 1 ) << 31;
+  static const uint32_t writer_waiting = uint32_t( 1 ) << 30;
+  static const uint32_t readers_mask   = writer_waiting - 1;
+
+  std::atomic< uint32_t > state{ 0 };
+  // protects everything below.
+  boost::mutex mt;
+  uint32_t writers_waiting = 0;
+  // only allocated once a coroutine has to wait.
+  std::unique_ptr< std::deque< coroutine > > waiting_writers;
+  std::unique_ptr< std::deque< coroutine > > waiting_readers;
+};
+}
+}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "thr_queue/coroutine.h"
+#include "thr_queue/thread_api.h"
+#include "thr_queue/trace.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+/** \brief A list of coroutines waiting for a condition that is checked
+ * without locking.
+ * Notifying only locks when somebody is waiting, and once the list has grown
+ * to the number of waiters it doesn't allocate memory again.
+ */
+class wait_list
+{
+public:
+  ~wait_list( );
+
+  /** \brief Parks the calling coroutine unless ready() returns true. It is
+   * called after the coroutine is counted as a waiter, so a notification sent
+   * after the condition becomes true can't be missed. A woken coroutine has
+   * to check the condition again. The coroutine is traced as blocked because
+   * of reason.
+   */
+  template < typename F >
+  void park_unless( F ready, block_reason reason = block_reason::wait_list );
+
+  /** \brief Wakes up the coroutine that has waited the longest. */
+  void notify_one( );
+
+  /** \brief Wakes up every parked coroutine. */
+  void notify_all( );
+
+  /** \brief Like notify_one(), or notify_all() if all is true, but also calls
+   * signal while holding the lock of the list. signal wakes up the waiters
+   * added with add_waiter(), which aren't coroutines parked in the list.
+   */
+  template < typename F >
+  void notify( bool all, F signal );
+
+  /** \brief Calls add, which registers a waiter that isn't parked in the list,
+   * while holding the lock of the list. Notifications aren't skipped until
+   * the waiter is removed with remove_waiter(). Like with park_unless(), the
+   * condition has to be checked after this returns.
+   */
+  template < typename F >
+  void add_waiter( F add );
+
+  /** \brief Calls remove, which unregisters a waiter added with add_waiter(),
+   * while holding the lock of the list.
+   */
+  template < typename F >
+  void remove_waiter( F remove );
+
+  /** \brief Calls change, which makes the condition true, while holding the
+   * lock of the list, and wakes up every parked coroutine. A coroutine that
+   * sees the change and then calls sync() knows that the notifier is done
+   * with the list, so it can destroy it.
+   */
+  template < typename F >
+  void notify_all_after( F change );
+
+  /** \brief Waits until a notify_all_after() that has made its change has
+   * returned.
+   */
+  void sync( );
+
+private:
+  void park_unless( bool ( *ready )( void* ), void* ctx, block_reason reason );
+  void notify_all_after( void ( *change )( void* ), void* ctx );
+  void notify( bool all, void ( *signal )( void* ), void* ctx );
+  void add_waiter( void ( *add )( void* ), void* ctx );
+  void remove_waiter( void ( *remove )( void* ), void* ctx );
+
+  std::atomic< uint32_t > count{ 0 };
+  boost::mutex mt;
+  std::vector< coroutine > waiting;
+};
+
+template < typename F >
+void
+wait_list::park_unless( F ready, block_reason reason )
+{
+  park_unless( []( void* f ) { return ( *static_cast< F* >( f ) )( ); }, &ready, reason );
+}
+
+template < typename F >
+void
+wait_list::notify( bool all, F signal )
+{
+  notify( all, []( void* f ) { ( *static_cast< F* >( f ) )( ); }, &signal );
+}
+
+template < typename F >
+void
+wait_list::add_waiter( F add )
+{
+  add_waiter( []( void* f ) { ( *static_cast< F* >( f ) )( ); }, &add );
+}
+
+template < typename F >
+void
+wait_list::remove_waiter( F remove )
+{
+  remove_waiter( []( void* f ) { ( *static_cast< F* >( f ) )( ); }, &remove );
+}
+
+template < typename F >
+void
+wait_list::notify_all_after( F change )
+{
+  notify_all_after( []( void* f ) { ( *static_cast< F* >( f ) )( ); }, &change );
+}
+}
+}
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <utility>
 
 namespace game_engine {
@@ -42,5 +45,156 @@ make_functor( F f )
   functor_ptr func = std::make_unique< spec_functor< F > >( std::move( f ) );
   return func;
 }
+/** \brief A move-only callable that stores small callables inside itself.
+ * Callables of at most inline_size bytes that can be moved without throwing
+ * don't need a heap allocation, bigger ones are moved to the heap.
+ */
+class inline_functor
+{
+public:
+  static constexpr size_t inline_size = 48;
+
+  inline_functor( ) noexcept = default;
+
+  inline_functor( std::nullptr_t ) noexcept
+  {
+  }
+
+  template < typename F,
+             typename = typename std::enable_if<
+               !std::is_same< typename std::decay< F >::type, inline_functor >::value >::type >
+  inline_functor( F f )
+  {
+    construct( std::move( f ), std::integral_constant< bool, fits_inline< F >( ) >( ) );
+  }
+
+  /** \brief Takes ownership of a functor that is already in the heap. */
+  inline_functor( functor_ptr f ) : inline_functor( [f = std::move( f )] { ( *f )( ); } )
+  {
+  }
+
+  inline_functor( inline_functor&& other ) noexcept
+  {
+    move_from( other );
+  }
+
+  inline_functor& operator=( inline_functor&& rhs ) noexcept
+  {
+    if ( this != &rhs ) {
+      reset( );
+      move_from( rhs );
+    }
+    return *this;
+  }
+
+  inline_functor( const inline_functor& ) = delete;
+  inline_functor& operator=( const inline_functor& ) = delete;
+
+  ~inline_functor( )
+  {
+    reset( );
+  }
+
+  void operator( )( )
+  {
+    vtbl->call( &storage );
+  }
+
+  explicit operator bool( ) const noexcept
+  {
+    return vtbl != nullptr;
+  }
+
+  /** \brief Returns whether the callable is stored without a heap allocation. */
+  bool is_inline( ) const noexcept
+  {
+    return vtbl && vtbl->stored_inline;
+  }
+
+private:
+  struct vtable
+  {
+    void ( *call )( void* );
+    // move constructs into dst and destroys src.
+    void ( *relocate )( void* dst, void* src );
+    void ( *destroy )( void* );
+    bool stored_inline;
+  };
+
+  template < typename F >
+  static constexpr bool
+  fits_inline( )
+  {
+    return sizeof( F ) <= inline_size && alignof( F ) <= alignof( std::max_align_t ) &&
+           std::is_nothrow_move_constructible< F >::value;
+  }
+
+  template < typename F >
+  static const vtable*
+  inline_vtable( )
+  {
+    static const vtable table = {
+      []( void* f ) { ( *static_cast< F* >( f ) )( ); },
+      []( void* dst, void* src ) {
+        new ( dst ) F( std::move( *static_cast< F* >( src ) ) );
+        static_cast< F* >( src )->~F( );
+      },
+      []( void* f ) { static_cast< F* >( f )->~F( ); },
+      true
+    };
+    return &table;
+  }
+
+  template < typename F >
+  static const vtable*
+  heap_vtable( )
+  {
+    static const vtable table = {
+      []( void* f ) { ( **static_cast< F** >( f ) )( ); },
+      []( void* dst, void* src ) { new ( dst ) F*( *static_cast< F** >( src ) ); },
+      []( void* f ) { delete *static_cast< F** >( f ); },
+      false
+    };
+    return &table;
+  }
+
+  template < typename F >
+  void
+  construct( F f, std::true_type )
+  {
+    new ( &storage ) F( std::move( f ) );
+    vtbl = inline_vtable< F >( );
+  }
+
+  template < typename F >
+  void
+  construct( F f, std::false_type )
+  {
+    new ( &storage ) F*( new F( std::move( f ) ) );
+    vtbl = heap_vtable< F >( );
+  }
+
+  void
+  move_from( inline_functor& other ) noexcept
+  {
+    if ( other.vtbl ) {
+      other.vtbl->relocate( &storage, &other.storage );
+      vtbl       = other.vtbl;
+      other.vtbl = nullptr;
+    }
+  }
+
+  void
+  reset( ) noexcept
+  {
+    if ( vtbl ) {
+      vtbl->destroy( &storage );
+      vtbl = nullptr;
+    }
+  }
+
+  const vtable* vtbl = nullptr;
+  typename std::aligned_storage< inline_size, alignof( std::max_align_t ) >::type storage;
+};
 }
 }
@@ -1,9 +1,20 @@
 #pragma once
 
+#include "thr_queue/event/cond_var.h"
+#include "thr_queue/event/latch.h"
+#include "thr_queue/event/mutex.h"
+#include "thr_queue/pool_options.h"
 #include "thr_queue/queue.h"
 
 namespace game_engine {
 namespace thr_queue {
+/** \brief Sets the options the global thread pool is started with instead of
+ * pool_options::from_environment(). The pool starts the first time it's used,
+ * so this has to be called before anything is scheduled. Returns false, and
+ * changes nothing, if the pool has already been started.
+ */
+bool configure_global_pool( const pool_options& opts );
+
 /** \brief A function that schedules the queue q is the global thread pool and forgets
  * about it. The queue is responsible for informing, if necessary, about it's
  * completion.
@@ -17,16 +28,57 @@ void schedule_queue( queue q );
 void schedule_queue_first( queue q );
 
 /** \brief A function that schedules a queue in the global thread pool and then
- * notifies using the condition variable passed as an argument when at least
- * min units of work have been completed.
+ * notifies using the condition variable passed as an argument, while holding
+ * mt, every time a unit of work completes once at least min of them have.
+ * cv and mt have to live until every unit has been run.
  */
 void schedule_queue( queue q, event::condition_variable& cv, event::mutex& mt, size_t min );
 
 /** \brief A function that schedules a queue in the global thread pool and then
- * notifies using the condition variable passed as an argument when at least
- * min units of work have been completed.  The queue is scheduled with maximum
- * priority.
+ * notifies using the condition variable passed as an argument, while holding
+ * mt, every time a unit of work completes once at least min of them have.
+ * cv and mt have to live until every unit has been run. The queue is
+ * scheduled with maximum priority.
  */
 void schedule_queue_first( queue q, event::condition_variable& cv, event::mutex& mt, size_t min );
+
+/** \brief A function that schedules a queue in the global thread pool and
+ * counts down the latch passed as an argument once per unit of work
+ * completed. The latch has to live until every unit has been run.
+ */
+void schedule_queue( queue q, event::latch& done );
+
+/** \brief A function that schedules a queue in the global thread pool and
+ * counts down the latch passed as an argument once per unit of work
+ * completed. The latch has to live until every unit has been run. The queue
+ * is scheduled with maximum priority.
+ */
+void schedule_queue_first( queue q, event::latch& done );
+
+/** \brief Tells the global thread pool that the running coroutine is about to
+ * block its worker thread, for example in a system call. If that leaves too
+ * few workers running coroutines the pool starts another one, which exits
+ * once it has been idle for a while. It must be followed by end_blocking().
+ * It does nothing if it isn't called from a coroutine.
+ */
+void begin_blocking( );
+
+/** \brief Tells the global thread pool that the call that begin_blocking()
+ * was called for has returned.
+ */
+void end_blocking( );
+
+/** \brief Calls begin_blocking() when it is constructed and end_blocking()
+ * when it is destroyed.
+ */
+class blocking_section
+{
+public:
+  blocking_section( );
+  ~blocking_section( );
+
+  blocking_section( const blocking_section& ) = delete;
+  blocking_section& operator=( const blocking_section& ) = delete;
+};
 }
 }
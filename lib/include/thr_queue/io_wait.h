@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+struct io_state;
+}
+
+#ifdef _WIN32
+// a SOCKET.
+using io_descriptor = uintptr_t;
+#else
+using io_descriptor = int;
+#endif
+
+/** \brief Lets coroutines wait for a non blocking descriptor to become
+ * readable or writable without blocking their worker.
+ * On Linux the descriptor is registered, edge triggered, in the epoll set of
+ * the worker that runs the waiting coroutine, and that worker resumes it as
+ * soon as the descriptor is ready. Elsewhere, and outside of a coroutine,
+ * waiting blocks the thread in poll().
+ * The waits are meant to be used after an operation has failed with EAGAIN,
+ * and they may return spuriously, so the operation has to be retried in a
+ * loop. Only one coroutine can wait for each direction at a time.
+ */
+class io_handle
+{
+public:
+  /** \brief fd must outlive the handle. */
+  explicit io_handle( io_descriptor fd );
+  ~io_handle( );
+
+  io_handle( const io_handle& ) = delete;
+  io_handle& operator=( const io_handle& ) = delete;
+
+  /** \brief Waits until fd is readable, the peer has closed it or it has an
+   * error. Returns false if close() has been called. Throws
+   * operation_cancelled if the task group of the coroutine is cancelled.
+   */
+  bool wait_readable( );
+
+  /** \brief Waits until fd is writable or it has an error. Returns false if
+   * close() has been called. Throws operation_cancelled if the task group of
+   * the coroutine is cancelled.
+   */
+  bool wait_writable( );
+
+  /** \brief Wakes up the coroutines that are waiting and makes the waits
+   * return false from then on. fd isn't closed.
+   */
+  void close( );
+
+  io_descriptor native_handle( ) const;
+
+private:
+  bool wait( int direction );
+
+  const io_descriptor fd;
+  detail::io_state* state;
+  std::atomic< bool > closed{ false };
+};
+}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "thr_queue/event/cond_var.h"
+#include "thr_queue/event/mutex.h"
+#include "thr_queue/functor.h"
+#include "thr_queue/work_options.h"
+#include <atomic>
+#include <exception>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief Calls f with every element of [first, last).
+ * first and last can either be random access iterators, in which case f is
+ * called with *it, or integers, in which case f is called with the index.
+ * The range is split recursively in halves that are run by the global thread
+ * pool, until they are smaller than grain or the pool already has enough work
+ * to keep every thread busy. In that case the rest is run by the caller.
+ * A grain of 0 chooses one based on the size of the range and the number of
+ * threads.
+ * The function returns when f has been called for every element. If any call
+ * throws, the first exception is rethrown after every chunk has finished.
+ */
+template < typename It, typename F >
+void parallel_for( It first, It last, size_t grain, F f, work_options opts = work_options( ) );
+
+/** \brief Returns reduce(...reduce(reduce(init, map(e0)), map(e1))..., map(en))
+ * for the elements e of [first, last), computed in parallel like
+ * parallel_for.
+ * Every chunk starts its partial result from init, so it must be an identity
+ * of reduce. The partial results are combined in order, so reduce only needs
+ * to be associative.
+ */
+template < typename It, typename T, typename Map, typename Reduce >
+T parallel_reduce( It first, It last, size_t grain, T init, Map map, Reduce reduce,
+                   work_options opts = work_options( ) );
+
+/** \brief Stores f(e) in d_first[i] for every element e = first[i] of
+ * [first, last), computed in parallel like parallel_for. d_first has to be a
+ * random access iterator.
+ */
+template < typename It, typename OutIt, typename F >
+void parallel_transform( It first, It last, OutIt d_first, size_t grain, F f,
+                         work_options opts = work_options( ) );
+
+namespace detail {
+/** \brief Keeps track of the chunks of a parallel algorithm that are still
+ * running. The caller counts as one of them.
+ */
+class fork_join_state
+{
+public:
+  /** \brief Called before spawning a chunk. */
+  void add( );
+
+  /** \brief Called by every spawned chunk when it finishes. */
+  void done( );
+
+  /** \brief Called by the caller when its own chunk finishes. It waits for the
+   * spawned ones and rethrows the first exception thrown by any of them.
+   */
+  void join( );
+
+  /** \brief Stores e if it is the first exception thrown by a chunk. */
+  void fail( std::exception_ptr e );
+
+  /** \brief Returns whether a chunk has thrown an exception. */
+  bool has_failed( ) const;
+
+  /** \brief Makes the state ready to be used again once join() has returned. */
+  void reset( );
+
+private:
+  std::atomic< size_t > pending{ 1 };
+  std::atomic< bool > failed{ false };
+  std::exception_ptr error;
+  event::mutex mt;
+  event::condition_variable cv;
+  bool finished = false;
+};
+
+/** \brief Returns whether the global pool has queued at least as much work as
+ * it has threads, in which case splitting further only adds overhead.
+ */
+bool pool_saturated( );
+
+/** \brief Returns the number of threads that run work concurrently. */
+unsigned int pool_concurrency( );
+
+/** \brief Returns whether the caller is running in a coroutine. */
+bool in_coroutine( );
+
+/** \brief Runs f in a new coroutine of the global pool. */
+void spawn( inline_functor f, work_options opts );
+
+/** \brief Runs f in a coroutine of the global pool and waits for it. */
+void run_in_coroutine( inline_functor f );
+}
+}
+}
+
+#include "thr_queue/parallel.inl"
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "thr_queue/parallel.h"
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+template <typename It>
+size_t range_size(It first, It last) {
+  return last > first ? size_t(last - first) : 0;
+}
+
+template <typename It>
+It element_at(It first, size_t i, std::true_type /* integral */) {
+  return first + It(i);
+}
+
+template <typename It>
+auto element_at(It first, size_t i, std::false_type /* integral */)
+  -> decltype(first[i]) {
+  return first[i];
+}
+
+template <typename It>
+auto element_at(It first, size_t i)
+  -> decltype(element_at(first, i, std::is_integral<It>())) {
+  return element_at(first, i, std::is_integral<It>());
+}
+
+inline size_t choose_grain(size_t size, size_t grain) {
+  if (grain != 0) {
+    return grain;
+  }
+  // a few chunks per thread so that the ones that finish early can take more.
+  return std::max<size_t>(1, size / (4 * pool_concurrency()));
+}
+
+// shared by every chunk of a call, it lives in the caller's stack.
+template <typename Leaf>
+struct fork_join_task {
+  fork_join_task(const Leaf &l, size_t g, work_options o)
+   :leaf(l)
+   ,grain(g)
+   ,opts(o)
+  {}
+
+  const Leaf &leaf;
+  const size_t grain;
+  const work_options opts;
+  fork_join_state state;
+};
+
+template <typename Leaf>
+void split_and_run(size_t begin, size_t end, fork_join_task<Leaf> &task) {
+  while (end - begin > task.grain && !pool_saturated()) {
+    auto mid = begin + (end - begin) / 2;
+    task.state.add();
+    spawn([mid, end, task_ptr = &task] {
+      try {
+        split_and_run(mid, end, *task_ptr);
+      } catch (...) {
+        task_ptr->state.fail(std::current_exception());
+      }
+      task_ptr->state.done();
+    }, task.opts);
+    end = mid;
+  }
+  task.leaf(begin, end);
+}
+
+// calls leaf(begin, end) for disjoint subranges that cover [0, size).
+template <typename Leaf>
+void fork_join(size_t size, size_t grain, const Leaf &leaf, work_options opts) {
+  if (size == 0) {
+    return;
+  }
+
+  if (!in_coroutine()) {
+    std::exception_ptr error;
+    run_in_coroutine([&] {
+      try {
+        fork_join(size, grain, leaf, opts);
+      } catch (...) {
+        error = std::current_exception();
+      }
+    });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return;
+  }
+
+  fork_join_task<Leaf> task(leaf, choose_grain(size, grain), opts);
+  try {
+    split_and_run(0, size, task);
+  } catch (...) {
+    task.state.fail(std::current_exception());
+  }
+  task.state.join();
+}
+}
+
+template <typename It, typename F>
+void parallel_for(It first, It last, size_t grain, F f, work_options opts) {
+  auto leaf = [&](size_t begin, size_t end) {
+    for (auto i = begin; i != end; ++i) {
+      f(detail::element_at(first, i));
+    }
+  };
+  detail::fork_join(detail::range_size(first, last), grain, leaf, opts);
+}
+
+template <typename It, typename T, typename Map, typename Reduce>
+T parallel_reduce(It first, It last, size_t grain, T init, Map map,
+                  Reduce reduce, work_options opts) {
+  auto size = detail::range_size(first, last);
+  if (size == 0) {
+    return init;
+  }
+
+  // the range is split in chunks of a fixed size so that the partial results
+  // can be combined in order.
+  grain = detail::choose_grain(size, grain);
+  auto chunks = (size + grain - 1) / grain;
+  std::vector<T> partials(chunks, init);
+  auto leaf = [&](size_t begin, size_t end) {
+    for (auto c = begin; c != end; ++c) {
+      auto chunk_end = std::min(size, (c + 1) * grain);
+      for (auto i = c * grain; i != chunk_end; ++i) {
+        partials[c] = reduce(std::move(partials[c]),
+                             map(detail::element_at(first, i)));
+      }
+    }
+  };
+  detail::fork_join(chunks, 1, leaf, opts);
+
+  T result = std::move(partials[0]);
+  for (size_t c = 1; c < chunks; ++c) {
+    result = reduce(std::move(result), std::move(partials[c]));
+  }
+  return result;
+}
+
+template <typename It, typename OutIt, typename F>
+void parallel_transform(It first, It last, OutIt d_first, size_t grain, F f,
+                        work_options opts) {
+  auto leaf = [&](size_t begin, size_t end) {
+    for (auto i = begin; i != end; ++i) {
+      d_first[i] = f(detail::element_at(first, i));
+    }
+  };
+  detail::fork_join(detail::range_size(first, last), grain, leaf, opts);
+}
+}
+}
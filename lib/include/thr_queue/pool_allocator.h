@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief An allocator that keeps freed objects in a per-thread free list
+ * instead of returning them to the heap.
+ * It is meant for small objects that are created and destroyed at a high
+ * rate, like the shared state of promises. Objects freed by a thread go to its
+ * own list, whichever thread allocated them. Arrays are allocated from the
+ * heap.
+ * So it only saves allocations when the objects are mostly freed by the
+ * threads that allocate them. If one thread keeps creating them and another
+ * keeps freeing them, the first one always allocates from the heap and the
+ * second one frees to the heap once its list is full.
+ */
+template < typename T >
+class pool_allocator
+{
+  static_assert( alignof( T ) <= alignof( std::max_align_t ), "T is overaligned" );
+
+public:
+  using value_type = T;
+
+  /** \brief Number of objects that every thread keeps at most. */
+  static constexpr size_t max_cached = 256;
+
+  pool_allocator( ) noexcept = default;
+
+  template < typename U >
+  pool_allocator( const pool_allocator< U >& ) noexcept
+  {
+  }
+
+  T* allocate( size_t n );
+  void deallocate( T* p, size_t n ) noexcept;
+
+  template < typename U >
+  struct rebind
+  {
+    using other = pool_allocator< U >;
+  };
+
+private:
+  union node
+  {
+    node* next;
+    typename std::aligned_storage< sizeof( T ), alignof( T ) >::type storage;
+  };
+
+  struct free_list
+  {
+    ~free_list( );
+
+    node* head  = nullptr;
+    size_t size = 0;
+  };
+
+  static free_list* local_list( );
+};
+
+template < typename T, typename U >
+bool operator==( const pool_allocator< T >&, const pool_allocator< U >& ) noexcept;
+
+template < typename T, typename U >
+bool operator!=( const pool_allocator< T >&, const pool_allocator< U >& ) noexcept;
+}
+}
+
+#include "thr_queue/pool_allocator.inl"
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "thr_queue/pool_allocator.h"
+#include <new>
+
+namespace game_engine {
+namespace thr_queue {
+template <typename T>
+pool_allocator<T>::free_list::~free_list() {
+  while (head) {
+    auto next = head->next;
+    ::operator delete(head);
+    head = next;
+  }
+}
+
+template <typename T>
+typename pool_allocator<T>::free_list *pool_allocator<T>::local_list() {
+  // objects can be freed by the destructors of other thread_locals after the
+  // list is gone, in that case they go back to the heap.
+  static thread_local bool destroyed = false;
+  static thread_local struct owner {
+    ~owner() { destroyed = true; }
+    free_list list;
+  } local;
+  return destroyed ? nullptr : &local.list;
+}
+
+template <typename T>
+T *pool_allocator<T>::allocate(size_t n) {
+  if (n == 1) {
+    auto list = local_list();
+    if (list && list->head) {
+      auto first = list->head;
+      list->head = first->next;
+      --list->size;
+      return reinterpret_cast<T *>(first);
+    }
+    return reinterpret_cast<T *>(::operator new(sizeof(node)));
+  }
+  return static_cast<T *>(::operator new(n * sizeof(T)));
+}
+
+template <typename T>
+void pool_allocator<T>::deallocate(T *p, size_t n) noexcept {
+  if (n == 1) {
+    auto list = local_list();
+    if (list && list->size < max_cached) {
+      auto freed = reinterpret_cast<node *>(p);
+      freed->next = list->head;
+      list->head = freed;
+      ++list->size;
+      return;
+    }
+  }
+  ::operator delete(p);
+}
+
+template <typename T, typename U>
+bool operator==(const pool_allocator<T> &, const pool_allocator<U> &) noexcept {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const pool_allocator<T> &, const pool_allocator<U> &) noexcept {
+  return false;
+}
+}
+}
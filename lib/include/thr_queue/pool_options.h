@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief How the worker threads of a pool share their work.
+ * * shared_queues: every worker dequeues from the queues shared by the whole
+ *   pool.
+ * * work_stealing: every worker owns a deque where the coroutines it schedules
+ *   are pushed. Idle workers steal from the deques of random workers. The
+ *   shared queues are only used by threads that are not workers.
+ */
+enum class scheduler_type
+{
+  shared_queues,
+  work_stealing
+};
+
+/** \brief How the worker threads are bound to CPUs.
+ * * none: the OS places them.
+ * * cpu: every worker runs on a single CPU, they are dealt round robin.
+ * * llc: every worker runs on the CPUs that share a last level cache with the
+ *   CPU it would get with cpu.
+ * * socket: every worker runs on the CPUs of the socket of the CPU it would
+ *   get with cpu.
+ */
+enum class pinning_type
+{
+  none,
+  cpu,
+  llc,
+  socket
+};
+
+/** \brief The options of the global thread pool, see configure_global_pool().
+ */
+struct pool_options
+{
+  scheduler_type scheduler = scheduler_type::shared_queues;
+
+  /** \brief How long queued work of a priority can go without being run before
+   * it is run ahead of work of higher priorities.
+   */
+  std::chrono::milliseconds starvation_limit{ 10 };
+
+  /** \brief The number of worker threads that are always running. 0 picks
+   * the number of CPUs the pool can use.
+   */
+  unsigned int threads = 0;
+
+  /** \brief The most worker threads the pool may have. When workers block,
+   * for example in blocking aio operations, the pool starts new ones so that
+   * threads workers keep running coroutines. 0 picks threads + 64.
+   */
+  unsigned int max_threads = 0;
+
+  /** \brief How long a worker started to replace a blocked one can go without
+   * work before it exits.
+   */
+  std::chrono::milliseconds idle_timeout{ 10000 };
+
+  /** \brief The CPUs the pool may use. Empty means all the online CPUs the
+   * process can run on.
+   */
+  std::vector< unsigned int > cpus;
+
+  pinning_type pinning = pinning_type::none;
+
+  /** \brief The most threads that run the calls given to run_blocking(). */
+  unsigned int blocking_threads = 16;
+
+  /** \brief The most calls given to run_blocking() that can wait for a
+   * thread. The coroutines that give more are parked until there is room.
+   */
+  unsigned int blocking_queue_size = 1024;
+
+  /** \brief Returns the default options overriden by the environment. The
+   * global pool is started with them unless configure_global_pool() is called:
+   * * GAME_ENGINE_SCHEDULER: "shared_queues" or "work_stealing".
+   * * GAME_ENGINE_STARVATION_MS: the starvation limit in milliseconds.
+   * * GAME_ENGINE_THREADS: the number of worker threads.
+   * * GAME_ENGINE_MAX_THREADS: the most worker threads.
+   * * GAME_ENGINE_IDLE_TIMEOUT_MS: the idle timeout in milliseconds.
+   * * GAME_ENGINE_CPUS: a list of CPUs such as "0-3,8".
+   * * GAME_ENGINE_PINNING: "none", "cpu", "llc" or "socket".
+   * * GAME_ENGINE_BLOCKING_THREADS: the most threads for blocking calls.
+   * * GAME_ENGINE_BLOCKING_QUEUE: the most blocking calls that can wait.
+   */
+  static pool_options from_environment( );
+};
+}
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstdint>
+#include <thr_queue/work_options.h>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief Counters of the coroutine stack caches. */
+struct stack_stats
+{
+  /** \brief Stacks reused from the cache of the allocating thread. */
+  uint64_t thread_cache_hits = 0;
+
+  /** \brief Allocations that found the cache of the allocating thread empty. */
+  uint64_t thread_cache_misses = 0;
+
+  /** \brief Thread cache misses served by the cache shared by all threads. */
+  uint64_t global_cache_hits = 0;
+
+  /** \brief Stacks that had to be mapped because no cache had one. */
+  uint64_t stacks_mapped = 0;
+
+  /** \brief Bytes given back to the OS when stacks were moved to the shared
+   * cache, or when a worker parked with stacks in its own cache. It is an
+   * upper bound, some of the pages might have never been used.
+   */
+  uint64_t bytes_reclaimed = 0;
+
+  /** \brief The most bytes used by a coroutine, for each stack size class.
+   * Only measured if GAME_ENGINE_STACK_USAGE=1, which makes spawning slower.
+   */
+  uint64_t max_used_bytes[ number_stack_size_classes ] = {};
+
+  /** \brief How many coroutines would have fit in each stack size class, given
+   * the bytes they used. Every coroutine is counted in the smallest class.
+   * Only measured if GAME_ENGINE_STACK_USAGE=1.
+   */
+  uint64_t used_bytes_fit[ number_stack_size_classes ] = {};
+};
+
+/** \brief Counters of a worker thread accumulated since it was started. */
+struct worker_stats
+{
+  /** \brief Coroutines that the worker has resumed. */
+  uint64_t tasks_run = 0;
+
+  /** \brief Coroutines that the worker has stolen from other workers. */
+  uint64_t tasks_stolen = 0;
+
+  /** \brief Coroutines that the worker couldn't run because they can't be
+   * run by it (see coroutine::can_be_run_by_thread) and had to reschedule.
+   */
+  uint64_t reschedules = 0;
+
+  /** \brief Nanoseconds spent looking for and running coroutines. */
+  uint64_t busy_ns = 0;
+
+  /** \brief Nanoseconds spent blocked waiting for work. */
+  uint64_t parked_ns = 0;
+
+  /** \brief Times that the worker was woken up while blocked. */
+  uint64_t wakeups_received = 0;
+
+  /** \brief Wakeups of this worker that needed a syscall because it was
+   * parked.
+   */
+  uint64_t wakeups_sent = 0;
+
+  /** \brief Wakeups of this worker that were skipped because it was running
+   * and would find the work by itself.
+   */
+  uint64_t wakeups_avoided = 0;
+
+  /** \brief Coroutines put in the LIFO slot of the worker, see
+   * scheduler_type::work_stealing.
+   */
+  uint64_t lifo_pushes = 0;
+
+  /** \brief Coroutines that the worker ran from its LIFO slot. The rest were
+   * stolen or pushed out to its deque by newer ones.
+   */
+  uint64_t lifo_hits = 0;
+
+  /** \brief Coroutines that the worker resumed that had last run on it too.
+   * Only coroutines that aren't bound to a worker are counted. On Linux a
+   * coroutine is bound to the first worker that runs it, so it stays 0 there.
+   */
+  uint64_t affinity_hits = 0;
+
+  /** \brief Coroutines that the worker resumed that had last run on another
+   * one. Only coroutines that aren't bound to a worker are counted, see
+   * affinity_hits.
+   */
+  uint64_t affinity_misses = 0;
+
+  /** \brief Coroutines waiting in the queue of coroutines that only this
+   * worker can run, at the time of the snapshot.
+   */
+  uint64_t thread_queue_size = 0;
+
+  /** \brief Coroutines waiting in the deque of the worker, or woken up by
+   * other threads to run on it, when the pool uses the work_stealing
+   * scheduler, at the time of the snapshot.
+   */
+  uint64_t local_queue_size = 0;
+};
+
+/** \brief Counters of the threads that run the calls given to run_blocking(). */
+struct blocking_lane_stats
+{
+  /** \brief Threads that have been started, at the time of the snapshot. */
+  uint64_t threads = 0;
+
+  /** \brief Threads running a call, at the time of the snapshot. */
+  uint64_t busy_threads = 0;
+
+  /** \brief Calls waiting for a thread, at the time of the snapshot. */
+  uint64_t queue_size = 0;
+
+  /** \brief The most calls that have been waiting for a thread at once. */
+  uint64_t peak_queue_size = 0;
+
+  /** \brief Calls that have been queued. */
+  uint64_t submitted = 0;
+
+  /** \brief Calls that have returned. */
+  uint64_t completed = 0;
+
+  /** \brief Times that a coroutine was parked because the queue was full. */
+  uint64_t queue_full_waits = 0;
+
+  /** \brief Nanoseconds that the calls spent waiting for a thread. */
+  uint64_t queued_ns = 0;
+};
+
+/** \brief Counters of the global thread pool accumulated since it was started. */
+struct pool_stats
+{
+  /** \brief Wakeups of a specific worker that needed a syscall because the
+   * worker was parked. The sum of those of every worker.
+   */
+  uint64_t wakeups_sent = 0;
+
+  /** \brief Wakeups of a specific worker that were skipped because the worker
+   * was running and would find the work by itself. The sum of those of every
+   * worker.
+   */
+  uint64_t wakeups_avoided = 0;
+
+  /** \brief Coroutines waiting in the queues shared by all the workers, for
+   * each work_priority, at the time of the snapshot.
+   */
+  uint64_t work_queue_sizes[ number_work_priorities ] = {};
+
+  /** \brief Coroutines with a deadline waiting to be run, at the time of the
+   * snapshot.
+   */
+  uint64_t deadline_queue_size = 0;
+
+  /** \brief Timers that haven't expired yet, at the time of the snapshot. */
+  uint64_t pending_timers = 0;
+
+  /** \brief Worker threads that are running, at the time of the snapshot. */
+  uint64_t threads = 0;
+
+  /** \brief The most worker threads that have been running at once. */
+  uint64_t peak_threads = 0;
+
+  /** \brief Workers inside a blocking section, at the time of the snapshot.
+   * See begin_blocking().
+   */
+  uint64_t blocked_threads = 0;
+
+  /** \brief The most workers that have been inside a blocking section at once. */
+  uint64_t peak_blocked_threads = 0;
+
+  /** \brief The counters of each worker, including those that have retired. */
+  std::vector< worker_stats > workers;
+
+  stack_stats stacks;
+
+  blocking_lane_stats blocking;
+};
+
+/** \brief Returns a snapshot of the counters of the global thread pool. Every
+ * counter is read on its own, so they may not be consistent with each other
+ * while the pool is running.
+ */
+pool_stats get_pool_stats( );
+}
+}
@@ -4,15 +4,19 @@ namespace game_engine {
 namespace thr_queue {
 class coroutine;
 class queue;
+struct min_units_notifier;
 }
 }
 
 #include "thr_queue/event/future.h"
+#include "thr_queue/event/latch.h"
 #include "thr_queue/functor.h"
+#include "thr_queue/work_options.h"
 
 #include "thr_queue/thread_api.h"
 #include <deque>
 #include <functional>
+#include <memory>
 #include <vector>
 
 namespace game_engine {
@@ -44,29 +48,34 @@ constexpr steal_work_t steal_work;
 class queue
 {
 private:
-  /** A subclass of the functor template that also moves the result of the
-   * stored function to the promise type when it's ran.
+  /** A callable that also moves the result of the stored function to the
+   * promise type when it's ran.
    */
   template < typename F >
-  struct work : functor
+  struct work
   {
     using result_type = typename std::result_of< F( ) >::type;
     event::promise< result_type > prom;
     F func;
     work( F f, event::promise< result_type > p );
 
-    void operator( )( ) final override;
+    void operator( )( );
   };
 
 public:
   using callback_t = std::function< void( queue& ) >;
 
 public:
-  /** \brief Constructs a queue of a certain type. */
+  /** \brief Constructs a queue of a certain type.
+   * Work can be submitted to a parallel queue from many threads without them
+   * contending for a lock.
+   */
   queue( queue_type ty );
 
   /** \brief Constructs a queue of a certain type with a callback that will be
    * called when work is added.
+   * The callback of a parallel queue can be called concurrently by the threads
+   * that submit work to it.
    */
   queue( queue_type ty, callback_t cb );
 
@@ -76,14 +85,23 @@ public:
    */
   queue( steal_work_t, queue& other );
 
+  /** \brief Moving a queue takes queue_mut, but work is submitted to a
+   * parallel queue without it, so no other thread may submit work to either
+   * queue while it is moved.
+   */
   queue& operator=( queue&& rhs );
   queue( queue&& rhs );
 
-  ~queue( ){};
+  ~queue( );
 
-  /** \brief Adds a function to be executed to the queue. */
+  /** \brief Adds a function to be executed to the queue. opts describes how
+   * the coroutine that runs it is created and queued in the pool. A serial
+   * queue that is run by a single coroutine uses options that are enough for
+   * all of its work, with the highest priority and earliest deadline of them.
+   */
   template < typename F >
-  event::future< typename queue::work< F >::result_type > submit_work( F func );
+  event::future< typename queue::work< F >::result_type > submit_work( F func,
+                                                                       work_options opts = work_options( ) );
 
   /** \brief Appends a queue to this one.
    * Depending on what type of queue is appended and what type this queue is
@@ -115,19 +133,52 @@ public:
   queue_type type( ) const;
 
 private:
+  struct queued_work
+  {
+    inline_functor func;
+    work_options opts;
+  };
+
+  struct concurrent_work;
+
+  /** \brief Returns options that are enough to run every unit of work in the
+   * queue. The caller must hold queue_mut or be the only user of the queue.
+   */
+  work_options combined_options( ) const;
+
+  /** \brief Adds a unit of work and calls cb_added. */
+  void push_work( queued_work work );
+
+  /** \brief Adds a unit of work to whichever container the queue uses. The
+   * caller must hold queue_mut.
+   */
+  void push_work_locked( queued_work work );
+
+  /** \brief Moves the work that was submitted to from without locking to the
+   * end of work_queue.
+   */
+  void take_concurrent_work( queue& from );
+
   /** \brief A utility function that is only an implementation detail.
    * It has to be added here as a friend.
    */
-  friend std::vector< coroutine > queue_to_vec_cor( queue q, event::condition_variable* cv, event::mutex* mt,
-                                                    size_t min );
+  friend std::vector< coroutine > queue_to_vec_cor( queue q, event::latch* done,
+                                                    std::shared_ptr< min_units_notifier > notifier );
 
   friend void swap( queue& lhs, queue& rhs );
   boost::recursive_mutex queue_mut;
-  std::deque< std::unique_ptr< functor > > work_queue;
+  std::deque< queued_work > work_queue;
+  // parallel queues built with the public constructors use it instead of
+  // work_queue, so submitting doesn't take queue_mut. work_queue is then only
+  // used when the whole queue is being consumed by its only user.
+  std::unique_ptr< concurrent_work > concurrent_queue;
   queue_type typ;
   callback_t cb_added;
 };
 
+/** \brief Swaps two queues. As with moves, no other thread may submit work
+ * to either of them meanwhile.
+ */
 void swap( queue& lhs, queue& rhs );
 }
 }
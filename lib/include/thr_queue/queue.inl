@@ -19,23 +19,15 @@ bool valid_function(const std::function<T()> &f) {
 namespace game_engine {
 namespace thr_queue {
 template <typename F>
-event::future<typename queue::work<F>::result_type> queue::submit_work(F func) {
+event::future<typename queue::work<F>::result_type>
+queue::submit_work(F func, work_options opts) {
   if (!valid_function(func)) {
     throw std::runtime_error("invalid function passed");
   }
 
-  boost::lock_guard<boost::recursive_mutex> guard(queue_mut);
-
-  auto work = std::unique_ptr<queue::work<F>>(
-      new queue::work<F>(std::move(func),
-                         typename event::promise<
-                           typename queue::work<F>::result_type>()));
-  auto fut = work->prom.get_future();
-  work_queue.emplace_back(work.release());
-  if (cb_added) {
-    cb_added(*this);
-  }
-
+  event::promise<typename queue::work<F>::result_type> prom;
+  auto fut = prom.get_future();
+  push_work(queued_work{queue::work<F>(std::move(func), std::move(prom)), opts});
   return fut;
 }
 
@@ -44,7 +36,7 @@ event::future<typename queue::work<F>::result_type> queue::submit_work(F func) {
 // F is the function.
 template <typename F, typename T>
 struct worker {
-  static void do_work_and_store(F &f, event::promise<F> &prom) {
+  static void do_work_and_store(F &f, event::promise<T> &prom) {
     prom.set_value(f());
   }
 };
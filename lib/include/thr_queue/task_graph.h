@@ -0,0 +1,83 @@
+#pragma once
+
+#include "thr_queue/functor.h"
+#include "thr_queue/parallel.h"
+#include "thr_queue/work_options.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief A set of callables with dependencies between them that can be run
+ * many times.
+ * The graph is built once by adding nodes and the edges between them. Every
+ * call to run() executes every node in the global thread pool once a node
+ * has run all of its predecessors. Nodes without a path between them may run
+ * in parallel.
+ * Running the graph again does not allocate memory for the graph itself, the
+ * dependency counters of the nodes are just reset. A node that becomes ready
+ * is run by the coroutine of the node that finished last, or by the caller of
+ * run() for a root, and only the rest are spawned in new coroutines. So a
+ * chain of nodes doesn't spawn any. It is only done if the stack of that
+ * coroutine is as big as the one the node asks for, and the node then keeps
+ * the priority and deadline of that coroutine.
+ */
+class task_graph
+{
+public:
+  typedef size_t node_id;
+
+  task_graph( ) = default;
+  task_graph( const task_graph& ) = delete;
+  task_graph& operator=( const task_graph& ) = delete;
+
+  /** \brief Adds a node that calls func every time the graph is run. Its
+   * coroutine is created according to opts, if it needs one.
+   */
+  node_id add_node( inline_functor func, work_options opts = work_options( ) );
+
+  /** \brief Makes after wait for before to finish before it is run.
+   * Throws std::runtime_error if any of the nodes doesn't belong to the graph.
+   */
+  void add_edge( node_id before, node_id after );
+
+  /** \brief Returns the number of nodes in the graph. */
+  size_t size( ) const;
+
+  /** \brief Runs every node and returns when all of them have finished.
+   * If a node throws an exception the nodes that depend on it, directly or
+   * not, aren't run and the first exception is rethrown once the nodes that
+   * were already running finish.
+   * Throws std::runtime_error if the edges form a cycle.
+   * It must not be called again before the previous call returns.
+   */
+  void run( );
+
+private:
+  struct node
+  {
+    node( inline_functor f, work_options o );
+
+    inline_functor func;
+    work_options opts;
+    std::vector< node* > successors;
+    size_t predecessors = 0;
+    std::atomic< size_t > remaining{ 0 };
+    // set when a predecessor failed, the node just releases its successors.
+    std::atomic< bool > skip{ false };
+  };
+
+  void check_acyclic( );
+  void spawn_node( node& n );
+  void run_node( node& first );
+  static bool fits_inline( const node& n );
+
+  // nodes are referenced by their successors, so they can't move.
+  std::vector< std::unique_ptr< node > > nodes;
+  std::vector< node* > roots;
+  bool validated = true;
+  detail::fork_join_state state;
+};
+}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "thr_queue/cancellation.h"
+#include "thr_queue/functor.h"
+#include "thr_queue/parallel.h"
+#include "thr_queue/work_options.h"
+#include <memory>
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+class cancellation_callback;
+}
+
+/** \brief Owns the coroutines spawned through it and waits for them.
+ * Every child observes the cancellation_token of the group: once it is
+ * cancelled its suspension points throw operation_cancelled. The group is
+ * cancelled by cancel(), when a child throws any other exception, or when the
+ * group the creating coroutine belongs to is cancelled, so groups can be
+ * nested.
+ * The destructor joins the children that haven't been joined, cancelling them
+ * first if it is run because of an exception.
+ */
+class task_group
+{
+public:
+  /** \brief The children are spawned with opts unless spawn() is given others. */
+  explicit task_group( work_options opts = work_options( ) );
+
+  ~task_group( );
+
+  task_group( const task_group& ) = delete;
+  task_group& operator=( const task_group& ) = delete;
+
+  /** \brief Runs func in a new coroutine of the global pool that belongs to
+   * the group.
+   */
+  void spawn( inline_functor func );
+  void spawn( inline_functor func, work_options opts );
+
+  /** \brief Waits for every child to finish and rethrows the first exception
+   * thrown by any of them, other than operation_cancelled. More children can
+   * be spawned afterwards, but a cancelled group stays cancelled.
+   */
+  void join( );
+
+  /** \brief Makes the suspension points of the children throw
+   * operation_cancelled. Children that are waiting are woken up.
+   */
+  void cancel( );
+
+  bool is_cancelled( ) const;
+
+  cancellation_token token( ) const;
+
+private:
+  void run_child( inline_functor& func );
+
+  const work_options default_opts;
+  std::shared_ptr< detail::cancellation_state > state;
+  // the group of the creating coroutine, parent_link cancels us when it is
+  // cancelled.
+  std::shared_ptr< detail::cancellation_state > parent;
+  std::unique_ptr< detail::cancellation_callback > parent_link;
+  detail::fork_join_state children;
+  bool joined = true;
+};
+}
+}
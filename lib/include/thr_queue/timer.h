@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chrono>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief The clock used by the timed waits of the coroutines. */
+using timer_clock = std::chrono::steady_clock;
+
+/** \brief Suspends the running coroutine until deadline has passed. The
+ * worker runs other coroutines meanwhile. Outside of a coroutine it blocks the
+ * thread. Deadlines are rounded up to the next millisecond.
+ */
+void sleep_until( timer_clock::time_point deadline );
+
+/** \brief Suspends the running coroutine for at least d. */
+template < typename Rep, typename Period >
+void
+sleep_for( const std::chrono::duration< Rep, Period >& d )
+{
+  sleep_until( timer_clock::now( ) + std::chrono::duration_cast< timer_clock::duration >( d ) );
+}
+}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief Why a coroutine gave up the worker that was running it. */
+enum class block_reason : uint8_t
+{
+  finished,
+  yield,
+  mutex,
+  cond_var,
+  future,
+  channel,
+  wait_list,
+  timer,
+  aio
+};
+
+/** \brief Starts recording when coroutines are scheduled, switched in and
+ * switched out. Every thread records into its own ring buffer, which keeps the
+ * last events_per_thread events. The size only applies to threads that haven't
+ * recorded any event yet, the others keep the buffer that they have.
+ * Starting discards the events recorded before. It does nothing if tracing is
+ * already on.
+ */
+void start_tracing( size_t events_per_thread = 1 << 16 );
+
+/** \brief Stops recording events. They are kept until tracing is started
+ * again.
+ */
+void stop_tracing( );
+
+/** \brief Writes the recorded events as Chrome trace JSON, which can be loaded
+ * in chrome://tracing or Perfetto. Each thread shows the coroutines that it
+ * ran, the reason why they stopped running and when they were scheduled.
+ * Tracing should be stopped before, otherwise the events that are being
+ * overwritten may be torn.
+ */
+void dump_trace( std::ostream& out );
+}
+}
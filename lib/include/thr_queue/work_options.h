@@ -0,0 +1,85 @@
+#pragma once
+
+#include "thr_queue/timer.h"
+#include <algorithm>
+#include <cstddef>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief The size of the stack of a coroutine.
+ * * small: 16 KiB, enough for leaf functions that don't recurse.
+ * * medium: 64 KiB.
+ * * large: 256 KiB.
+ * * huge: 8 MiB, the size of the stack of a regular thread.
+ * The last page of every stack is a guard page.
+ */
+enum class stack_size_class
+{
+  small,
+  medium,
+  large,
+  huge
+};
+
+constexpr size_t number_stack_size_classes = 4;
+
+/** \brief Returns the size in bytes of the stacks of a class. */
+constexpr size_t
+stack_size_bytes( stack_size_class cls )
+{
+  return cls == stack_size_class::small
+           ? 16 * 1024
+           : cls == stack_size_class::medium ? 64 * 1024 : cls == stack_size_class::large ? 256 * 1024
+                                                                                          : 8 * 1024 * 1024;
+}
+
+/** \brief The class of a unit of work. Workers run the queued work of the
+ * highest class first, but work that has waited for longer than
+ * pool_options::starvation_limit is run ahead of the higher classes.
+ * * critical: latency sensitive work, such as render extraction or network
+ *   acks.
+ * * high, normal, low.
+ * * background: bulk work, such as asset decoding.
+ */
+enum class work_priority
+{
+  critical,
+  high,
+  normal,
+  low,
+  background
+};
+
+constexpr size_t number_work_priorities = 5;
+
+/** \brief The deadline of work that doesn't have one. */
+constexpr timer_clock::time_point no_deadline = timer_clock::time_point::max( );
+
+/** \brief Options that describe how a unit of work should be run. */
+struct work_options
+{
+  stack_size_class stack_size = stack_size_class::huge;
+
+  work_priority priority = work_priority::normal;
+
+  /** \brief Work with a deadline is queued apart and run earliest deadline
+   * first, after critical work and before the other classes.
+   */
+  timer_clock::time_point deadline = no_deadline;
+};
+
+/** \brief Returns options that are enough to run units of work that were
+ * submitted with either lhs or rhs. Used when several of them are run by a
+ * single coroutine.
+ */
+inline work_options
+combine_options( work_options lhs, work_options rhs )
+{
+  work_options ret;
+  ret.stack_size = std::max( lhs.stack_size, rhs.stack_size );
+  ret.priority   = std::min( lhs.priority, rhs.priority );
+  ret.deadline   = std::min( lhs.deadline, rhs.deadline );
+  return ret;
+}
+}
+}
@@ -2,6 +2,7 @@
 #include <aio/aio_file.h>
 #include <boost/scope_exit.hpp>
 #include <fcntl.h>
+#include <thr_queue/cancellation.h>
 #include <thr_queue/event/future.h>
 #include <thr_queue/util_queue.h>
 
@@ -109,6 +110,8 @@ file::~file( )
     return;
   }
 
+  // the file has to be closed even if the coroutine has been cancelled.
+  thr_queue::cancellation_shield shield;
   auto close_fut = close( *this )->perform( );
   close_fut.wait( );
   auto excpt = close_fut.get_exception( );
@@ -416,16 +419,18 @@ truncate( file& file, int64_t offset )
 aio_operation< void >
 close( file& fil )
 {
-  return make_aio_operation( [cblock = fil.cblock]( perform_helper< void > & ph ) mutable {
+  // it only waits for events, so the calling coroutine runs it. The threads
+  // of the blocking lane can't wait for them.
+  return make_aio_operation( [cblock = fil.cblock]( ) mutable -> thr_queue::event::future< void > {
     if ( !cblock->wait_and_set_closing( ) ) {
       thr_queue::event::promise< void > prom;
-      ph.set_future( prom.get_future( ) );
       boost::unique_lock< thr_queue::event::mutex > l( cblock->mt );
       while ( cblock->ongoing_operations != -2 ) {
         assert( cblock->ongoing_operations == -1 );
         cblock->cv.wait( l );
       }
       prom.set_value( );
+      return prom.get_future( );
     }
 
     auto uv_code = [ =, cblock = std::move( cblock ) ]( auto prom ) mutable
@@ -463,7 +468,7 @@ close( file& fil )
       uv_fs_close(
         uv_default_loop( ), &fcb_close_struct_ptr->req, fcb_close_struct_ptr->fcb_ptr->fd, close_cb );
     };
-    ph.set_future( thr_queue::event::uv_thr_cor_do< void >( std::move( uv_code ) ) );
+    return thr_queue::event::uv_thr_cor_do< void >( std::move( uv_code ) );
   } );
 }
 
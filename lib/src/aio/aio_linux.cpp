@@ -1,16 +1,18 @@
-#include "../thr_queue/global_thr_pool_impl.h"
 #include <aio/aio.h>
+#include <thr_queue/blocking_lane.h>
 
 namespace game_engine {
 namespace aio {
 void
-aio_operation_base::perform_mayblock_aio_platform( perform_helper_base&, thr_queue::coroutine cor )
+aio_operation_base::perform_mayblock_aio_platform( perform_helper_base&, thr_queue::inline_functor work )
 {
-  LOG( ) << "Scheduling cor " << boost::this_thread::get_id( );
-  assert( thr_queue::this_wthread );
-  cor.set_forbidden_thread( thr_queue::this_wthread );
-  thr_queue::global_thr_pool.schedule( std::move( cor ), true );
-  LOG( ) << "Waiting for fut_fut";
+  // the caller waits for the future to be set, so a thread that isn't a worker
+  // can just as well run the operation itself.
+  if ( !thr_queue::detail::can_use_blocking_lane( ) ) {
+    work( );
+    return;
+  }
+  thr_queue::detail::submit_blocking( std::move( work ) );
 }
 
 namespace platform {
@@ -1,7 +1,14 @@
 #include "../thr_queue/event/uv_thread.h"
 #include <aio/aio_tcp.h>
 #include <boost/core/ignore_unused.hpp>
+#include <boost/scope_exit.hpp>
+#include <thr_queue/cancellation.h>
 #include <thr_queue/util_queue.h>
+#ifndef _WIN32
+#include <climits>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
 
 namespace game_engine {
 namespace aio {
@@ -79,11 +86,8 @@ passive_tcp_socket::bind_and_listen( uint16_t port )
         assert( status >= 0 );
         auto& data = *static_cast< passive_tcp_socket::data* >( stream->data );
         assert( status == 0 );
-        thr_queue::default_par_queue( ).submit_work( [&] {
-          boost::lock_guard< thr_queue::event::mutex > lock( data.mt );
-          ++data.awaiting_accept;
-          data.cv.notify( );
-        } );
+        // the channel is unbounded, so this never fails.
+        data.pending_accepts.try_send( status );
       };
 
       const uint8_t backlog_size = 10;
@@ -112,12 +116,7 @@ passive_tcp_socket::accept( )
         accept_result proposed_result;
         bool successful_accept;
         do {
-          auto lock = boost::unique_lock< thr_queue::event::mutex >( d_l->mt );
-          while ( d_l->awaiting_accept == 0 ) {
-            d_l->cv.wait( lock );
-          }
-          --d_l->awaiting_accept;
-          lock.unlock( );
+          d_l->pending_accepts.recv( );
           successful_accept =
             uv_thr_cor_do< bool >( [& socket = d_l->socket, &proposed_result ]( auto prom ) {
               if ( int err = uv_accept( (uv_stream_t*) &socket,
@@ -157,6 +156,24 @@ active_tcp_socket::~active_tcp_socket( )
     return;
   }
   assert( !d->read_state );
+#ifndef _WIN32
+  // pending reads and writes fail with UV_ECANCELED, like they do with libuv,
+  // and the fd is only closed once none of them uses it.
+  auto released = d->io_released.get_future( );
+  release_io( *d );
+  // waits for a read or write that is creating io, and stops any other from
+  // doing it.
+  std::call_once( d->io_once, [] {} );
+  if ( d->io ) {
+    d->io->close( );
+  }
+  {
+    thr_queue::cancellation_shield shield;
+    released.wait( );
+  }
+  // it has to be unregistered before the fd is closed.
+  d->io.reset( );
+#endif
   thr_queue::event::uv_thr_cor_do< void >( [d = d]( auto prom ) {
     d->closing_prom = std::move( prom );
     uv_close( (uv_handle_t*) &d->socket,
@@ -236,6 +253,97 @@ active_tcp_socket::connect( sockaddr_storage addr )
   } );
 }
 
+#ifndef _WIN32
+thr_queue::io_handle&
+active_tcp_socket::io_of( data& d )
+{
+  std::call_once( d.io_once, [&d] {
+    uv_os_fd_t fd;
+    if ( int err = uv_fileno( (uv_handle_t*) &d.socket, &fd ) ) {
+      throw aio_runtime_error( err, "uv_fileno" );
+    }
+    // libuv has made it non blocking already.
+    d.io = std::make_unique< thr_queue::io_handle >( fd );
+  } );
+  if ( !d.io ) {
+    // the destructor got to io_once first.
+    throw aio_runtime_error( UV_ECANCELED, "io_of" );
+  }
+  return *d.io;
+}
+
+bool
+active_tcp_socket::acquire_io( data& d )
+{
+  auto users = d.io_users.load( );
+  do {
+    if ( users == 0 ) {
+      return false;
+    }
+  } while ( !d.io_users.compare_exchange_weak( users, users + 1 ) );
+  return true;
+}
+
+void
+active_tcp_socket::release_io( data& d )
+{
+  if ( --d.io_users == 0 ) {
+    d.io_released.set_value( );
+  }
+}
+
+aio_operation< active_tcp_socket::read_result >
+active_tcp_socket::read( aio_buffer::size_type min_read, aio_buffer::size_type max_read )
+{
+  return make_aio_operation( [ d = d, max_read, min_read ]( ) {
+    thr_queue::event::promise< read_result > prom;
+    auto fut = prom.get_future( );
+    read_result result;
+    result.last_status = 0;
+    if ( !acquire_io( *d ) ) {
+      result.last_status = UV_ECANCELED;
+      prom.set_value( std::move( result ) );
+      return fut;
+    }
+    BOOST_SCOPE_EXIT_ALL( &d )
+    {
+      release_io( *d );
+    };
+    auto& io   = io_of( *d );
+    result.buf = aio_buffer( max_read );
+    // like the libuv version, last_status is the result of the last read and
+    // errors are negated errno values.
+    while ( result.already_read < min_read || result.already_read == 0 ) {
+      if ( result.already_read == max_read ) {
+        break;
+      }
+      auto nread = ::recv( io.native_handle( ), result.buf.base + result.already_read,
+                           max_read - result.already_read, 0 );
+      if ( nread > 0 ) {
+        result.already_read += (aio_buffer::size_type) nread;
+        result.last_status = nread;
+      } else if ( nread == 0 ) {
+        result.last_status = UV_EOF;
+        d->read_error      = UV_EOF;
+        break;
+      } else if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+        if ( !io.wait_readable( ) ) {
+          result.last_status = UV_ECANCELED;
+          d->read_error      = UV_ECANCELED;
+          break;
+        }
+      } else if ( errno != EINTR ) {
+        result.last_status = -errno;
+        d->read_error      = -errno;
+        break;
+      }
+    }
+
+    prom.set_value( std::move( result ) );
+    return fut;
+  } );
+}
+#else
 aio_operation< active_tcp_socket::read_result >
 active_tcp_socket::read( aio_buffer::size_type min_read, aio_buffer::size_type max_read )
 {
@@ -298,6 +406,7 @@ active_tcp_socket::read( aio_buffer::size_type min_read, aio_buffer::size_type m
       } );
   } );
 }
+#endif
 
 aio_operation< active_tcp_socket::write_result >
 active_tcp_socket::write( aio_buffer buf )
@@ -314,6 +423,72 @@ struct write_internal_state
   thr_queue::event::promise< active_tcp_socket::write_result > prom;
 };
 
+#ifndef _WIN32
+aio_operation< active_tcp_socket::write_result >
+active_tcp_socket::write( std::vector< aio_buffer > buffers )
+{
+  assert( d );
+  return make_aio_operation( [ buffers = std::move( buffers ), d = d ]( ) {
+    thr_queue::event::promise< write_result > prom;
+    auto fut = prom.get_future( );
+    if ( !acquire_io( *d ) ) {
+      prom.set_value( { false, UV_ECANCELED } );
+      return fut;
+    }
+    BOOST_SCOPE_EXIT_ALL( &d )
+    {
+      release_io( *d );
+    };
+    auto& io = io_of( *d );
+
+    std::vector< iovec > iovs;
+    for ( auto& buf : buffers ) {
+      if ( buf.len > 0 ) {
+        iovs.push_back( iovec{ buf.base, buf.len } );
+      }
+    }
+
+    int status   = 0;
+    size_t first = 0;
+    while ( first < iovs.size( ) ) {
+      msghdr msg;
+      memset( &msg, 0, sizeof( msg ) );
+      msg.msg_iov    = &iovs[ first ];
+      msg.msg_iovlen = std::min< size_t >( iovs.size( ) - first, IOV_MAX );
+      // we don't want SIGPIPE if the peer has gone away.
+      auto written = ::sendmsg( io.native_handle( ), &msg, MSG_NOSIGNAL );
+      if ( written < 0 ) {
+        if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+          if ( !io.wait_writable( ) ) {
+            status = UV_ECANCELED;
+            break;
+          }
+        } else if ( errno != EINTR ) {
+          status = -errno;
+          LOG( ) << "sendmsg: " << strerror( errno );
+          break;
+        }
+        continue;
+      }
+      auto left = size_t( written );
+      while ( left > 0 ) {
+        auto& iov = iovs[ first ];
+        if ( left >= iov.iov_len ) {
+          left -= iov.iov_len;
+          ++first;
+        } else {
+          iov.iov_base = static_cast< char* >( iov.iov_base ) + left;
+          iov.iov_len -= left;
+          left = 0;
+        }
+      }
+    }
+
+    prom.set_value( { status == 0, status } );
+    return fut;
+  } );
+}
+#else
 aio_operation< active_tcp_socket::write_result >
 active_tcp_socket::write( std::vector< aio_buffer > buffers )
 {
@@ -346,6 +521,7 @@ active_tcp_socket::write( std::vector< aio_buffer > buffers )
       } );
   } );
 }
+#endif
 
 active_tcp_socket::active_tcp_socket( private_constructor ) : d( nullptr )
 {
@@ -4,9 +4,10 @@
 namespace game_engine {
 namespace aio {
 void
-aio_operation_base::perform_mayblock_aio_platform( perform_helper_base& helper, thr_queue::coroutine cor )
+aio_operation_base::perform_mayblock_aio_platform( perform_helper_base& helper,
+                                                   thr_queue::inline_functor work )
 {
-  replace_running_cor_and_jump( helper, std::move( cor ) );
+  replace_running_cor_and_jump( helper, thr_queue::coroutine( std::move( work ) ) );
 }
 
 namespace platform {
@@ -23,7 +24,7 @@ perform_helper_impl::plat_about_to_block( )
           return;
         }
         that.apc_pending_exec = false;
-        thr_queue::global_thr_pool.schedule( std::move( that.caller_coroutine.get( ) ), true );
+        thr_queue::global_thr_pool->schedule( std::move( that.caller_coroutine.get( ) ), true );
         that.caller_coroutine = boost::none;
       },
       thr_queue::this_wthread->get_internals( ).thr.native_handle( ),
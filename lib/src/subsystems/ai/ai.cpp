@@ -1,4 +1,5 @@
 #include "subsystems/ai/ai.h"
+#include "thr_queue/parallel.h"
 
 namespace game_engine {
 namespace logic {
@@ -8,10 +9,11 @@ void
 ai_subsystem::update_all( )
 {
   for ( auto& comp_vector : reg_components ) {
-    for ( auto comp_ptr : comp_vector.second ) {
+    auto& comps = comp_vector.second;
+    thr_queue::parallel_for( comps.begin( ), comps.end( ), 0, []( component* comp_ptr ) {
       auto& ent = dynamic_cast< ai_component& >( *comp_ptr );
       ent.ai_update( );
-    }
+    } );
   }
 }
 }
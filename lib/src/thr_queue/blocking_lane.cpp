@@ -0,0 +1,126 @@
+#include "blocking_lane.h"
+#include "global_thr_pool_impl.h"
+#include "thr_queue/blocking_lane.h"
+#include <algorithm>
+#include <logging/log.h>
+
+namespace game_engine {
+namespace thr_queue {
+blocking_lane::blocking_lane( unsigned int max_thr, unsigned int max_queued )
+  : max_threads( std::max( 1u, max_thr ) ), room( std::max( 1u, max_queued ) )
+{
+}
+
+blocking_lane::~blocking_lane( )
+{
+  stop( );
+}
+
+void
+blocking_lane::submit( inline_functor job )
+{
+  if ( !room.try_acquire( ) ) {
+    ++queue_full_waits;
+    room.acquire( );
+  }
+  ++submitted;
+
+  boost::unique_lock< boost::mutex > lock( mt );
+  if ( stopping ) {
+    lock.unlock( );
+    room.release( );
+    job( );
+    ++completed;
+    return;
+  }
+  jobs.push_back( queued_job{ std::move( job ), std::chrono::steady_clock::now( ) } );
+  peak_queue_size = std::max< uint64_t >( peak_queue_size, jobs.size( ) );
+  if ( jobs.size( ) > idle_threads && threads.size( ) < max_threads ) {
+    threads.emplace_back( [this] { run_thread( ); } );
+  } else {
+    cv.notify_one( );
+  }
+}
+
+void
+blocking_lane::stop( )
+{
+  std::vector< boost::thread > to_join;
+  {
+    boost::lock_guard< boost::mutex > lock( mt );
+    stopping = true;
+    to_join  = std::move( threads );
+    threads.clear( );
+  }
+  cv.notify_all( );
+  for ( auto& thr : to_join ) {
+    thr.join( );
+  }
+}
+
+blocking_lane_stats
+blocking_lane::stats( )
+{
+  blocking_lane_stats ret;
+  {
+    boost::lock_guard< boost::mutex > lock( mt );
+    ret.threads         = threads.size( );
+    ret.busy_threads    = busy_threads;
+    ret.queue_size      = jobs.size( );
+    ret.peak_queue_size = peak_queue_size;
+  }
+  ret.submitted        = submitted.load( std::memory_order_relaxed );
+  ret.completed        = completed.load( std::memory_order_relaxed );
+  ret.queue_full_waits = queue_full_waits.load( std::memory_order_relaxed );
+  ret.queued_ns        = queued_ns.load( std::memory_order_relaxed );
+  return ret;
+}
+
+void
+blocking_lane::run_thread( )
+{
+  boost::unique_lock< boost::mutex > lock( mt );
+  while ( true ) {
+    while ( jobs.empty( ) && !stopping ) {
+      ++idle_threads;
+      cv.wait( lock );
+      --idle_threads;
+    }
+    if ( jobs.empty( ) ) {
+      return;
+    }
+    auto next = std::move( jobs.front( ) );
+    jobs.pop_front( );
+    ++busy_threads;
+    lock.unlock( );
+
+    room.release( );
+    queued_ns += elapsed_ns( next.queued_at );
+    try {
+      next.job( );
+    } catch ( std::exception& e ) {
+      // run_blocking() passes the exceptions to the caller, so this is a bug.
+      LOG( ) << "caught when running a blocking call: " << e.what( );
+    }
+    ++completed;
+
+    lock.lock( );
+    --busy_threads;
+  }
+}
+
+namespace detail {
+bool
+can_use_blocking_lane( )
+{
+  return running_coroutine && this_wthread;
+}
+
+void
+submit_blocking( inline_functor job )
+{
+  global_thr_pool->submit_blocking( std::move( job ) );
+}
+}
+}
+}
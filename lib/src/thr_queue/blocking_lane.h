@@ -0,0 +1,69 @@
+#pragma once
+
+#include "thr_queue/event/semaphore.h"
+#include "thr_queue/functor.h"
+#include "thr_queue/pool_stats.h"
+#include "thr_queue/thread_api.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief Threads that run the calls that may block, away from the workers,
+ * see run_blocking().
+ * A thread is started when a call is queued and no thread is idle, up to
+ * max_threads. At most max_queued calls wait for a thread, the coroutines that
+ * queue more are parked until there is room.
+ */
+class blocking_lane
+{
+public:
+  blocking_lane( unsigned int max_threads, unsigned int max_queued );
+
+  ~blocking_lane( );
+
+  blocking_lane( const blocking_lane& ) = delete;
+  blocking_lane& operator=( const blocking_lane& ) = delete;
+
+  /** \brief Queues job. It must be called from a coroutine. */
+  void submit( inline_functor job );
+
+  /** \brief Runs the calls that are queued and joins the threads. Calls
+   * queued afterwards are run by the calling thread.
+   */
+  void stop( );
+
+  blocking_lane_stats stats( );
+
+private:
+  struct queued_job
+  {
+    inline_functor job;
+    std::chrono::steady_clock::time_point queued_at;
+  };
+
+  void run_thread( );
+
+  const unsigned int max_threads;
+  // the places left in the queue.
+  event::semaphore room;
+
+  // protects everything below but the counters.
+  boost::mutex mt;
+  boost::condition_variable cv;
+  std::deque< queued_job > jobs;
+  std::vector< boost::thread > threads;
+  unsigned int idle_threads = 0;
+  unsigned int busy_threads = 0;
+  uint64_t peak_queue_size  = 0;
+  bool stopping             = false;
+
+  std::atomic< uint64_t > submitted{ 0 };
+  std::atomic< uint64_t > completed{ 0 };
+  std::atomic< uint64_t > queue_full_waits{ 0 };
+  std::atomic< uint64_t > queued_ns{ 0 };
+};
+}
+}
@@ -0,0 +1,157 @@
+#include "cancellation_impl.h"
+#include "cor_data.h"
+#include "global_thr_pool_impl.h"
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+operation_cancelled::operation_cancelled( ) : std::runtime_error( "the task group has been cancelled" )
+{
+}
+
+cancellation_token::cancellation_token( std::shared_ptr< detail::cancellation_state > s )
+  : state( std::move( s ) )
+{
+}
+
+bool
+cancellation_token::is_cancelled( ) const
+{
+  return state && state->cancelled.load( std::memory_order_acquire );
+}
+
+void
+cancellation_token::throw_if_cancelled( ) const
+{
+  if ( is_cancelled( ) ) {
+    throw operation_cancelled( );
+  }
+}
+
+cancellation_token
+this_coroutine_token( )
+{
+  if ( !running_coroutine ) {
+    return cancellation_token( );
+  }
+  return cancellation_token( running_coroutine->data_ptr->cancellation );
+}
+
+void
+check_cancellation( )
+{
+  auto* state = detail::cancellation_state::of_running( );
+  if ( state && state->cancelled.load( std::memory_order_acquire ) ) {
+    throw operation_cancelled( );
+  }
+}
+
+cancellation_shield::cancellation_shield( )
+{
+  if ( running_coroutine ) {
+    ++running_coroutine->data_ptr->cancellation_shields;
+  }
+}
+
+cancellation_shield::~cancellation_shield( )
+{
+  if ( running_coroutine ) {
+    assert( running_coroutine->data_ptr->cancellation_shields > 0 );
+    --running_coroutine->data_ptr->cancellation_shields;
+  }
+}
+
+namespace detail {
+void
+cancellation_state::cancel( )
+{
+  std::vector< cancellation_callback* > to_run;
+  {
+    boost::lock_guard< boost::mutex > lock( mt );
+    if ( cancelled.exchange( true ) ) {
+      return;
+    }
+    for ( auto* cb = callbacks; cb; cb = cb->next ) {
+      cb->callback.take( );
+      to_run.push_back( cb );
+    }
+    callbacks = nullptr;
+  }
+
+  // the callbacks take the locks of the suspension points, which may be held
+  // while callbacks are armed, so they are run without holding ours.
+  for ( auto* cb : to_run ) {
+    cb->callback.fire( );
+  }
+}
+
+cancellation_state*
+cancellation_state::of_running( )
+{
+  if ( !running_coroutine ) {
+    return nullptr;
+  }
+  auto& data = *running_coroutine->data_ptr;
+  return data.cancellation_shields == 0 ? data.cancellation.get( ) : nullptr;
+}
+
+void
+cancellation_state::attach( coroutine& cor, std::shared_ptr< cancellation_state > s )
+{
+  cor.data_ptr->cancellation = std::move( s );
+}
+
+cancellation_callback::~cancellation_callback( )
+{
+  disarm( );
+}
+
+void
+cancellation_callback::arm( cancellation_state& s, inline_functor f )
+{
+  assert( !state && "a cancellation_callback can only be armed once" );
+  boost::lock_guard< boost::mutex > lock( s.mt );
+  if ( s.cancelled ) {
+    // the caller may hold locks that f takes.
+    deferred.deadline = timer_clock::now( );
+    deferred.callback.func = std::move( f );
+    global_thr_pool->add_timer( deferred );
+    return;
+  }
+  state         = &s;
+  callback.func = std::move( f );
+  callback.arm( );
+  next = s.callbacks;
+  if ( next ) {
+    next->prev = this;
+  }
+  s.callbacks = this;
+}
+
+void
+cancellation_callback::disarm( )
+{
+  if ( state ) {
+    {
+      boost::lock_guard< boost::mutex > lock( state->mt );
+      if ( callback.disarm( ) ) {
+        if ( prev ) {
+          prev->next = next;
+        } else {
+          state->callbacks = next;
+        }
+        if ( next ) {
+          next->prev = prev;
+        }
+      }
+    }
+    callback.wait_fired( );
+    state = nullptr;
+    prev  = nullptr;
+    next  = nullptr;
+  }
+  global_thr_pool->cancel_timer( deferred );
+}
+}
+}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "thr_queue/cancellation.h"
+#include "thr_queue/functor.h"
+#include "one_shot_callback.h"
+#include "thr_queue/thread_api.h"
+#include "timer_wheel.h"
+#include <atomic>
+
+namespace game_engine {
+namespace thr_queue {
+class coroutine;
+
+namespace detail {
+class cancellation_callback;
+
+/** \brief What a cancellation_token points to. */
+struct cancellation_state
+{
+  /** \brief Marks the state as cancelled and runs the callbacks that are
+   * registered. It does nothing if it already was.
+   */
+  void cancel( );
+
+  /** \brief Returns the state of the running coroutine, or nullptr if it has
+   * none or a cancellation_shield is active.
+   */
+  static cancellation_state* of_running( );
+
+  /** \brief Makes cor observe s, which may be null. */
+  static void attach( coroutine& cor, std::shared_ptr< cancellation_state > s );
+
+  std::atomic< bool > cancelled{ false };
+  // protects callbacks.
+  boost::mutex mt;
+  // head of a doubly linked list.
+  cancellation_callback* callbacks = nullptr;
+};
+
+/** \brief Runs a function once a cancellation_state is cancelled. Suspension
+ * points use it to wake up the coroutine that waits, the same way the
+ * callbacks of their timeouts do.
+ * The function isn't run by the thread that registers it, so it can be
+ * registered while holding the locks that the function takes.
+ */
+class cancellation_callback
+{
+public:
+  cancellation_callback( ) = default;
+  cancellation_callback( const cancellation_callback& ) = delete;
+  cancellation_callback& operator=( const cancellation_callback& ) = delete;
+  ~cancellation_callback( );
+
+  /** \brief Makes s run func when it is cancelled. If it already is, func is
+   * run by a worker of the global pool as soon as possible.
+   */
+  void arm( cancellation_state& s, inline_functor func );
+
+  /** \brief Unregisters the function, or waits until it has returned if it is
+   * already running.
+   */
+  void disarm( );
+
+private:
+  friend struct cancellation_state;
+
+  cancellation_state* state = nullptr;
+  // armed while it is linked into the list of state.
+  one_shot_callback callback;
+  cancellation_callback* prev = nullptr;
+  cancellation_callback* next = nullptr;
+  // used when the state was already cancelled when armed.
+  timer_entry deferred;
+};
+}
+}
+}
@@ -0,0 +1,90 @@
+#include "thr_queue/channel.h"
+#include "event/better_lock.h"
+#include "event/lock_unlocker.h"
+#include "global_thr_pool_impl.h"
+#include <algorithm>
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+channel_waiters::~channel_waiters( )
+{
+  assert( selectors.empty( ) && "selectors would get stuck waiting for a non-existing channel" );
+}
+
+void
+channel_waiters::park_unless( bool ( *ready )( void* ), void* ctx )
+{
+  waiters.park_unless( [&] { return ready( ctx ); }, block_reason::channel );
+}
+
+void
+channel_waiters::notify_one( )
+{
+  notify( false );
+}
+
+void
+channel_waiters::notify_all( )
+{
+  notify( true );
+}
+
+void
+channel_waiters::notify( bool all )
+{
+  waiters.notify( all, [this] {
+    for ( auto sel : selectors ) {
+      sel->signal( );
+    }
+  } );
+}
+
+void
+channel_waiters::add_selector( channel_selector* sel )
+{
+  // the selector checks the channels after this, like park_unless().
+  waiters.add_waiter( [&] { selectors.push_back( sel ); } );
+}
+
+void
+channel_waiters::remove_selector( channel_selector* sel )
+{
+  waiters.remove_waiter( [&] {
+    auto it = std::find( selectors.begin( ), selectors.end( ), sel );
+    assert( it != selectors.end( ) );
+    selectors.erase( it );
+  } );
+}
+
+void
+channel_selector::signal( )
+{
+  boost::unique_lock< boost::mutex > lock( mt );
+  signaled = true;
+  if ( parked ) {
+    auto cor = std::move( *parked );
+    parked   = boost::none;
+    lock.unlock( );
+    global_thr_pool->schedule( std::move( cor ), true );
+  }
+}
+
+void
+channel_selector::wait( )
+{
+  event::better_lock lock( mt );
+  if ( !signaled ) {
+    global_thr_pool->yield(
+      [&]( coroutine running ) {
+        event::lock_unlocker< event::better_lock > l_unlock( lock );
+        parked = std::move( running );
+      },
+      block_reason::channel );
+    lock.lock( );
+  }
+  signaled = false;
+}
+}
+}
+}
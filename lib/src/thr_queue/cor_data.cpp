@@ -42,8 +42,10 @@ cor_data::cor_data( ) : alloc_stc( )
 {
 }
 
-cor_data::cor_data( game_engine::thr_queue::functor_ptr func )
-  : alloc_stc( game_engine::thr_queue::allocate_stack( ) )
+cor_data::cor_data( game_engine::thr_queue::inline_functor func, const work_options& opts )
+  : alloc_stc( game_engine::thr_queue::allocate_stack( opts.stack_size ) )
+  , priority( opts.priority )
+  , deadline( opts.deadline )
 {
   if ( coroutine_debug( ) ) {
     boost::lock_guard< boost::mutex > l( cor_mt );
@@ -53,17 +55,20 @@ cor_data::cor_data( game_engine::thr_queue::functor_ptr func )
   }
 
   auto start_func = []( exec_ctx came_from,
-                        game_engine::thr_queue::functor_ptr f,
+                        game_engine::thr_queue::inline_functor* f_to_move,
                         game_engine::thr_queue::allocated_stack* stc_ptr ) {
     boost::ignore_unused( stc_ptr );
+    // f_to_move points to the constructor's argument, so we have to take it
+    // before going back.
+    auto f            = std::move( *f_to_move );
     auto actual_start = came_from( nullptr, nullptr );
     assert( std::get< 1 >( actual_start ) == nullptr );
     *last_jump_from = std::move( std::get< 0 >( actual_start ) );
     last_jump_from  = nullptr;
 #ifndef _WIN32
-    ( *f )( );
+    f( );
 #else
-    auto func = [ f_ptr = f.get( ), stc_ptr ]
+    auto func = [ f_ptr = &f, stc_ptr ]
     {
       __try {
         ( *f_ptr )( );
@@ -80,7 +85,7 @@ cor_data::cor_data( game_engine::thr_queue::functor_ptr func )
   boost::context::preallocated palloc( alloc_stc.sc.sp, alloc_stc.sc.size, alloc_stc.sc );
   ctx = exec_ctx( std::allocator_arg, palloc, game_engine::thr_queue::donothing_allocator( ), start_func );
   // we pass the function it has to run and then we come back.
-  auto new_ctx = std::get< 0 >( ctx( move( func ), &alloc_stc ) );
+  auto new_ctx = std::get< 0 >( ctx( &func, &alloc_stc ) );
   ctx          = std::move( new_ctx );
 }
 
@@ -2,12 +2,15 @@
 
 #include "cor_data.h"
 #include "stack_allocator.h"
+#include "thr_queue/cancellation.h"
 #include "thr_queue/coroutine.h"
 #include <boost/context/execution_context.hpp>
 
 namespace game_engine {
 namespace thr_queue {
-using exec_ctx = boost::context::execution_context< functor_ptr, allocated_stack* >;
+// the function to run is passed by pointer when the coroutine is started, and
+// moved to its stack.
+using exec_ctx = boost::context::execution_context< inline_functor*, allocated_stack* >;
 
 // We might came back from another coroutine (think about a triangle, for example)
 extern thread_local exec_ctx* last_jump_from;
@@ -22,7 +25,7 @@ struct cor_data
 
   cor_data( cor_data&& ) = delete;
 
-  cor_data( functor_ptr func );
+  cor_data( inline_functor func, const work_options& opts );
 
   cor_data& operator=( cor_data ) = delete;
 
@@ -31,6 +34,17 @@ struct cor_data
 
   game_engine::thr_queue::coroutine_type typ;
   game_engine::thr_queue::worker_thread* bound_thread = nullptr;
+  // the worker that ran the coroutine last, a hint of where its data is cached.
+  game_engine::thr_queue::worker_thread* last_worker = nullptr;
+
+  // where the coroutine is queued when it is scheduled, see work_options.
+  work_priority priority           = work_priority::normal;
+  timer_clock::time_point deadline = no_deadline;
+
+  // the cancellation state of the task group that spawned the coroutine, and
+  // how many cancellation_shields are alive in it.
+  std::shared_ptr< detail::cancellation_state > cancellation;
+  unsigned int cancellation_shields = 0;
 
   // used in the linux implementation of blocking aio operations.
   // see aio_operation_t<T>::perform() for further information.
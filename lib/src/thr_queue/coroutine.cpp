@@ -9,6 +9,12 @@ coroutine::type( ) const
   return data_ptr->typ;
 }
 
+stack_size_class
+coroutine::stack_size( ) const
+{
+  return data_ptr->alloc_stc.size_class( );
+}
+
 void
 coroutine::switch_to_from( coroutine& other )
 {
@@ -54,7 +60,8 @@ coroutine::~coroutine( )
 {
 }
 
-coroutine::coroutine( functor_ptr func ) : data_ptr( new cor_data( std::move( func ) ) )
+coroutine::coroutine( inline_functor func, work_options opts )
+  : data_ptr( new cor_data( std::move( func ), opts ) )
 {
 }
 
@@ -0,0 +1,44 @@
+#include "thr_queue/event/barrier.h"
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+barrier::barrier( std::ptrdiff_t exp ) : expected( exp ), remaining( exp )
+{
+}
+
+uint64_t
+barrier::arrive( std::ptrdiff_t drop )
+{
+  auto current = phase.load( std::memory_order_acquire );
+  if ( drop ) {
+    expected.fetch_sub( drop, std::memory_order_relaxed );
+  }
+  if ( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+    // nobody can arrive at the next phase before it starts, so the counter
+    // can be reset before that.
+    remaining.store( expected.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    // like in latch, the waiters may destroy the barrier once the phase changes.
+    waiters.notify_all_after( [this] { phase.fetch_add( 1, std::memory_order_release ); } );
+  }
+  return current;
+}
+
+void
+barrier::arrive_and_wait( )
+{
+  auto arrived_at = arrive( 0 );
+  while ( phase.load( std::memory_order_acquire ) == arrived_at ) {
+    waiters.park_unless( [&] { return phase.load( std::memory_order_acquire ) != arrived_at; } );
+  }
+  waiters.sync( );
+}
+
+void
+barrier::arrive_and_drop( )
+{
+  arrive( 1 );
+}
+}
+}
+}
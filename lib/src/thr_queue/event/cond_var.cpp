@@ -1,55 +1,127 @@
 #include "thr_queue/event/cond_var.h"
+#include "../cancellation_impl.h"
 #include "../global_thr_pool_impl.h"
 #include "better_lock.h"
 #include "lock_unlocker.h"
 #include "thr_queue/coroutine.h"
+#include <algorithm>
 
 namespace game_engine {
 namespace thr_queue {
 namespace event {
+condition_variable::condition_variable( block_reason r ) : reason( r )
+{
+}
+
 void
 condition_variable::wait( boost::unique_lock< mutex >& lock )
+{
+  park( lock, nullptr );
+}
+
+std::cv_status
+condition_variable::wait_until( boost::unique_lock< mutex >& lock, timer_clock::time_point deadline )
+{
+  return park( lock, &deadline ) ? std::cv_status::timeout : std::cv_status::no_timeout;
+}
+
+bool
+condition_variable::park( boost::unique_lock< mutex >& lock, const timer_clock::time_point* deadline )
 {
   assert( lock.owns_lock( ) );
+  auto* cancellation = detail::cancellation_state::of_running( );
+  if ( cancellation && cancellation->cancelled ) {
+    throw operation_cancelled( );
+  }
+
   boost::unique_lock< mutex > local_lock( *lock.release( ), boost::adopt_lock );
   better_lock lock_std( mt );
-  global_thr_pool.yield( [&]( coroutine running ) {
-    lock_unlocker< better_lock > l_unlock_std_mt( lock_std );
-    lock_unlocker< boost::unique_lock< mutex > > l_unlock_co_mt( local_lock );
+  bool gave_up = false;
+  timer_entry timeout;
+  detail::cancellation_callback on_cancel;
+  global_thr_pool->yield(
+    [&]( coroutine running ) {
+      lock_unlocker< better_lock > l_unlock_std_mt( lock_std );
+      lock_unlocker< boost::unique_lock< mutex > > l_unlock_co_mt( local_lock );
+
+      if ( !waiting_cors ) {
+        waiting_cors = std::make_unique< std::deque< coroutine > >( );
+      }
+      auto id = running.get_id( );
+      waiting_cors->emplace_back( std::move( running ) );
+
+      auto give_up = [this, id, &gave_up] {
+        boost::unique_lock< boost::mutex > mt_lock( mt );
+        if ( !waiting_cors ) {
+          return;
+        }
+        auto it = std::find_if( waiting_cors->begin( ), waiting_cors->end( ),
+                                [id]( const coroutine& cor ) { return cor.get_id( ) == id; } );
+        if ( it == waiting_cors->end( ) ) {
+          // notify() got it first, or we have already given up.
+          return;
+        }
+        auto cor = std::move( *it );
+        waiting_cors->erase( it );
+        mt_lock.unlock( );
+        gave_up = true;
+        global_thr_pool->schedule( std::move( cor ), true );
+      };
+      if ( cancellation ) {
+        on_cancel.arm( *cancellation, give_up );
+      }
+      if ( deadline ) {
+        timeout.deadline = *deadline;
+        timeout.callback.func = give_up;
+        global_thr_pool->add_timer( timeout );
+      }
+    },
+    reason );
 
-    waiting_cors.emplace_back( std::move( running ) );
-  } );
+  // the callbacks may still be running if notify() won the race.
+  on_cancel.disarm( );
+  if ( deadline ) {
+    global_thr_pool->cancel_timer( timeout );
+  }
 
   // If this coroutine is resumed by a thread different from the one that
-  // yielded,
-  // then it is possible that the changes to internal state of the 'lock'
-  // variable will
-  // not have been yet acknowledged by the resuming thread.
-  // This special case will lead to a difficult to debug race condition
-  // involving
-  // the owns_lock member variable.
+  // yielded, then it is possible that the changes to internal state of the
+  // 'lock' variable will not have been yet acknowledged by the resuming
+  // thread. This special case will lead to a difficult to debug race
+  // condition involving the owns_lock member variable.
   // This is why we use local_lock.
   assert( !local_lock.owns_lock( ) );
-  lock = boost::unique_lock< mutex >( *local_lock.release( ) );
+  {
+    // like std::condition_variable, the lock is held again when we throw.
+    cancellation_shield shield;
+    lock = boost::unique_lock< mutex >( *local_lock.release( ) );
+  }
+  if ( gave_up && cancellation && cancellation->cancelled ) {
+    throw operation_cancelled( );
+  }
+  return gave_up;
 }
 
 void
 condition_variable::notify( )
 {
   boost::unique_lock< boost::mutex > mt_lock( mt );
-  decltype( waiting_cors ) wc;
-  swap( wc, waiting_cors );
+  if ( !waiting_cors || waiting_cors->empty( ) ) {
+    return;
+  }
+  auto wc = std::move( waiting_cors );
   mt_lock.unlock( );
 
-  auto begin_move = std::make_move_iterator( wc.begin( ) );
-  auto end_move   = std::make_move_iterator( wc.end( ) );
-  global_thr_pool.schedule( begin_move, end_move, true );
+  auto begin_move = std::make_move_iterator( wc->begin( ) );
+  auto end_move   = std::make_move_iterator( wc->end( ) );
+  global_thr_pool->schedule( begin_move, end_move, true );
 }
 
 condition_variable::~condition_variable( )
 {
   boost::lock_guard< boost::mutex > mt_lock( mt );
-  assert( waiting_cors.size( ) == 0 && "coroutines can't be destroyed by the condition variable." );
+  assert( ( !waiting_cors || waiting_cors->empty( ) ) &&
+          "coroutines can't be destroyed by the condition variable." );
 }
 }
 }
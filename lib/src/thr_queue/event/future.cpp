@@ -1,45 +1,144 @@
 #include "../global_thr_pool_impl.h"
+#include <thr_queue/cancellation.h>
 #include <thr_queue/event/future.h>
 #include <thr_queue/util_queue.h>
 
 namespace game_engine {
 namespace thr_queue {
 namespace event {
+future_promise_priv_shared::~future_promise_priv_shared( )
+{
+  delete waiters.load( std::memory_order_relaxed );
+}
+
+promise_waiters&
+future_promise_priv_shared::get_waiters( )
+{
+  auto w = waiters.load( std::memory_order_acquire );
+  if ( !w ) {
+    auto created = new promise_waiters;
+    if ( waiters.compare_exchange_strong( w, created ) ) {
+      w = created;
+    } else {
+      delete created;
+    }
+  }
+  // pairs with the status exchange in notify_all_cvs(): either the setter sees
+  // the waiters or our caller sees the promise set.
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  return *w;
+}
+
+bool
+future_promise_priv_shared::has_continuations( )
+{
+  auto w = waiters.load( std::memory_order_acquire );
+  if ( !w ) {
+    return false;
+  }
+  boost::lock_guard< boost::mutex > l( w->continuations_mt );
+  return !w->continuations.empty( );
+}
+
 void
-future_promise_priv_shared::notify_all_cvs( functor_ptr func )
+future_promise_priv_shared::notify_all_cvs( inline_functor func )
 {
   scheduled_set_func = true;
-  auto notify_work = [ d = shared_from_this( ), func = std::move( func ) ]
-  {
-    boost::unique_lock< mutex > l( d->mt );
-    assert( d->prom_status == promise_status::alive_not_set );
-    if ( func != nullptr ) {
-      ( *func )( );
+  if ( func ) {
+    func( );
+  }
+
+  // the value is published by the exchange, readers that see alive_set don't
+  // need to lock. It is sequentially consistent so that we see the waiters
+  // if they don't see the promise set, see get_waiters().
+  auto old_status = prom_status.exchange( promise_status::alive_set );
+  assert( old_status == promise_status::alive_not_set ||
+          old_status == promise_status::alive_waiting );
+
+  if ( old_status == promise_status::alive_waiting ) {
+    // the waiter might be between marking the promise and waiting on the
+    // condition variable, locking the mutex makes sure it is waiting.
+    auto notify_work = [d = shared_from_this( )] {
+      // the waiter would never be woken up if a cancelled setter gave up.
+      cancellation_shield shield;
+      auto& w = d->get_waiters( );
+      boost::lock_guard< mutex > l( w.mt );
+      w.cv.notify( );
+    };
+
+    if ( !running_coroutine ) {
+      default_par_queue( ).submit_work( std::move( notify_work ) );
+    } else {
+      notify_work( );
     }
-    d->prom_status = promise_status::alive_set;
-    d->cv.notify( );
-    for ( auto it = d->when_any_callbacks.begin( ); it != d->when_any_callbacks.end( ); ) {
-      std::shared_ptr< condition_variable > cv_ptr( *it );
-      if ( !cv_ptr ) {
-        it = d->when_any_callbacks.erase( it );
-      } else {
-        cv_ptr->notify( );
-        ++it;
-      }
+  }
+
+  run_continuations( );
+}
+
+bool
+future_promise_priv_shared::is_set( ) const
+{
+  auto status = prom_status.load( std::memory_order_acquire );
+  return status == promise_status::alive_set || status == promise_status::dead_set;
+}
+
+void
+future_promise_priv_shared::add_continuation( inline_functor func )
+{
+  if ( !is_set( ) ) {
+    auto& w = get_waiters( );
+    boost::lock_guard< boost::mutex > l( w.continuations_mt );
+    // if the promise is already set the setter might not have seen the
+    // waiters, so we can't leave func to it.
+    if ( !w.continuations_run && !is_set( ) ) {
+      w.continuations.emplace_back( std::move( func ) );
+      return;
+    }
+  }
+
+  if ( running_coroutine ) {
+    func( );
+  } else {
+    default_par_queue( ).submit_work( std::move( func ) );
+  }
+}
+
+void
+future_promise_priv_shared::run_continuations( )
+{
+  auto w = waiters.load( );
+  if ( !w ) {
+    return;
+  }
+  std::vector< inline_functor > to_run;
+  {
+    boost::lock_guard< boost::mutex > l( w->continuations_mt );
+    w->continuations_run = true;
+    to_run.swap( w->continuations );
+  }
+
+  if ( to_run.empty( ) ) {
+    return;
+  }
+
+  auto run_all = [to_run = std::move( to_run )]( ) mutable {
+    for ( auto& func : to_run ) {
+      func( );
     }
   };
 
-  if ( !running_coroutine ) {
-    default_par_queue( ).submit_work( std::move( notify_work ) );
+  if ( running_coroutine ) {
+    run_all( );
   } else {
-    notify_work( );
+    default_par_queue( ).submit_work( std::move( run_all ) );
   }
 }
 
 void
 promise< void >::set_value( )
 {
-  if ( this->d->prom_status == promise_status::alive_set ) {
+  if ( this->d->is_set( ) ) {
     throw promise_already_set( "attempting to set an already set promise<void>" );
   }
 
@@ -49,54 +148,73 @@ promise< void >::set_value( )
 void
 future_generic_base::wait( ) const
 {
+  auto& d = get_priv( );
+  if ( d.is_set( ) ) {
+    return;
+  }
+
   if ( running_coroutine ) {
-    auto& d = get_priv( );
-    boost::unique_lock< mutex > l( d.mt );
-    while ( d.prom_status == promise_status::alive_not_set ) {
-      d.cv.wait( l );
+    auto& w = d.get_waiters( );
+    boost::unique_lock< mutex > l( w.mt );
+    auto expected = promise_status::alive_not_set;
+    d.prom_status.compare_exchange_strong( expected, promise_status::alive_waiting );
+    while ( !d.is_set( ) ) {
+      w.cv.wait( l );
     }
   } else {
     boost::promise< void > prom;
     auto fut = prom.get_future( );
-    queue q( queue_type::parallel );
-    q.submit_work( [this, &prom] {
-      wait( );
-      prom.set_value( );
-    } );
-    schedule_queue_first( std::move( q ) );
+    on_ready( [&prom] { prom.set_value( ); } );
     fut.wait( );
   }
 }
 
-std::exception_ptr
-future_generic_base::get_exception( ) const
+bool
+future_generic_base::wait_until( timer_clock::time_point deadline ) const
 {
+  auto& d = get_priv( );
+  if ( d.is_set( ) ) {
+    return true;
+  }
+
   if ( running_coroutine ) {
-    auto& d = get_priv( );
-    boost::unique_lock< mutex > l( d.mt );
-    while ( d.prom_status == promise_status::alive_not_set ) {
-      d.cv.wait( l );
+    auto& w = d.get_waiters( );
+    boost::unique_lock< mutex > l( w.mt );
+    auto expected = promise_status::alive_not_set;
+    d.prom_status.compare_exchange_strong( expected, promise_status::alive_waiting );
+    while ( !d.is_set( ) ) {
+      if ( w.cv.wait_until( l, deadline ) == std::cv_status::timeout ) {
+        return d.is_set( );
+      }
     }
-    return d.except_ptr;
+    return true;
   } else {
-    boost::promise< std::exception_ptr > prom;
-    auto fut = prom.get_future( );
-    queue q( queue_type::parallel );
-    q.submit_work( [this, &prom] {
-      auto ptr = get_exception( );
-      prom.set_value( std::move( ptr ) );
-    } );
-    schedule_queue_first( std::move( q ) );
-    return fut.get( );
+    // the continuation outlives us if the future isn't set in time.
+    auto prom = std::make_shared< boost::promise< void > >( );
+    auto fut  = prom->get_future( );
+    on_ready( [prom] { prom->set_value( ); } );
+    auto wait = std::chrono::duration_cast< std::chrono::nanoseconds >( deadline - timer_clock::now( ) );
+    return fut.wait_for( boost::chrono::nanoseconds( wait.count( ) ) ) == boost::future_status::ready;
   }
 }
 
+std::exception_ptr
+future_generic_base::get_exception( ) const
+{
+  wait( );
+  return get_priv( ).except_ptr;
+}
+
+void
+future_generic_base::on_ready( inline_functor f ) const
+{
+  get_priv( ).add_continuation( std::move( f ) );
+}
+
 bool
 future_generic_base::ready( ) const
 {
-  auto& d               = get_priv( );
-  promise_status promst = d.prom_status;
-  return promst == promise_status::alive_set || promst == promise_status::dead_set;
+  return get_priv( ).is_set( );
 }
 }
 }
@@ -0,0 +1,50 @@
+#include "thr_queue/event/latch.h"
+#include <cassert>
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+latch::latch( std::ptrdiff_t expected ) : count( expected )
+{
+}
+
+void
+latch::count_down( std::ptrdiff_t n )
+{
+  auto old = count.load( std::memory_order_relaxed );
+  do {
+    assert( old >= n && "latch counted down below zero" );
+    if ( old == n ) {
+      // a waiter may destroy the latch as soon as it sees zero, so the last
+      // decrement is made while holding the lock of the list, which wait()
+      // takes before returning.
+      waiters.notify_all_after( [this] { count.store( 0, std::memory_order_release ); } );
+      return;
+    }
+  } while ( !count.compare_exchange_weak( old, old - n, std::memory_order_acq_rel ) );
+}
+
+bool
+latch::try_wait( ) const
+{
+  return count.load( std::memory_order_acquire ) == 0;
+}
+
+void
+latch::wait( )
+{
+  while ( !try_wait( ) ) {
+    waiters.park_unless( [this] { return try_wait( ); } );
+  }
+  waiters.sync( );
+}
+
+void
+latch::arrive_and_wait( std::ptrdiff_t n )
+{
+  count_down( n );
+  wait( );
+}
+}
+}
+}
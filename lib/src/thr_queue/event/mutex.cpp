@@ -1,74 +1,275 @@
 #include "thr_queue/event/mutex.h"
+#include "../cancellation_impl.h"
 #include "../global_thr_pool_impl.h"
 #include "better_lock.h"
 #include "lock_unlocker.h"
+#include <algorithm>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
 
 namespace game_engine {
 namespace thr_queue {
 namespace event {
+namespace {
+// set in the state of a mutex while coroutines are parked waiting for it.
+const uintptr_t has_waiters = 1;
+// owner of a mutex that unlock() has handed to a waiting coroutine that
+// hasn't run yet.
+const uintptr_t handed_off = 2;
+
+const uint32_t max_spins = 100;
+const uint32_t max_backoff_log2 = 6;
+
+void
+cpu_relax( )
+{
+#if defined( _MSC_VER )
+  _mm_pause( );
+#elif defined( __i386__ ) || defined( __x86_64__ )
+  __builtin_ia32_pause( );
+#elif defined( __aarch64__ ) || defined( __arm__ )
+  asm volatile( "yield" );
+#endif
+}
+
+uintptr_t
+running_owner( )
+{
+  return reinterpret_cast< uintptr_t >( running_coroutine );
+}
+}
+
+mutex::mutex( mutex_mode m ) : mode( m )
+{
+}
 
 mutex::~mutex( )
 {
+  // unlock() may still hold mt after it has released the mutex.
   boost::lock_guard< boost::mutex > lock( mt );
-  assert( waiting_cors.size( ) == 0 && "coroutines would get stuck trying to lock a non-existing mutex" );
-  assert( owning_cor == nullptr && "can't destroy a locked mutex" );
+  assert( ( !waiting_cors || waiting_cors->empty( ) ) &&
+          "coroutines would get stuck trying to lock a non-existing mutex" );
+  assert( state == 0 && "can't destroy a locked mutex" );
 }
 
 void
 mutex::lock( )
 {
-  better_lock lock( mt, boost::defer_lock );
+  assert( running_coroutine );
+  uintptr_t expected = 0;
+  if ( state.compare_exchange_strong( expected, running_owner( ) ) ) {
+    note_acquired( );
+    return;
+  }
 
-  // we might have been scheduled by a thread that unlocked the lock, but that
-  // doesn't guarantee that another thread didn't lock this lock before we had
-  // time to run.
-  while ( true ) {
-    assert( !lock.owns_lock( ) );
-    assert( running_coroutine );
-    lock.lock( );
+  ++cnt.contended;
+  if ( mode == mutex_mode::adaptive && spin_lock( ) ) {
+    ++cnt.spin_acquired;
+    note_acquired( );
+    return;
+  }
 
-    if ( !owning_cor ) {
-      owning_cor = running_coroutine;
-      break;
+  ++cnt.parked;
+  park_lock( nullptr );
+  note_acquired( );
+}
+
+bool
+mutex::try_lock_until( timer_clock::time_point deadline )
+{
+  assert( running_coroutine );
+  if ( try_lock( ) ) {
+    return true;
+  }
+
+  ++cnt.contended;
+  if ( mode == mutex_mode::adaptive && spin_lock( ) ) {
+    ++cnt.spin_acquired;
+    note_acquired( );
+    return true;
+  }
+
+  if ( timer_clock::now( ) >= deadline ) {
+    return false;
+  }
+  ++cnt.parked;
+  if ( park_lock( &deadline ) ) {
+    note_acquired( );
+    return true;
+  }
+  return false;
+}
+
+void
+mutex::note_acquired( )
+{
+  // the owner is the only writer, so it doesn't need an atomic increment.
+  cnt.acquisitions.store( cnt.acquisitions.load( std::memory_order_relaxed ) + 1,
+                          std::memory_order_relaxed );
+}
+
+bool
+mutex::spin_lock( )
+{
+  // like glibc's adaptive mutexes, we spin up to twice as much as it usually
+  // takes and move the estimate towards the spins that we needed.
+  auto estimate = spin_estimate.load( std::memory_order_relaxed );
+  auto limit    = std::min( max_spins, 2 * estimate + 10 );
+  for ( uint32_t i = 0; i < limit; ++i ) {
+    for ( uint32_t p = 0; p < ( 1u << std::min( i, max_backoff_log2 ) ); ++p ) {
+      cpu_relax( );
     }
 
-    global_thr_pool.yield( [&]( coroutine running ) {
-      lock_unlocker< better_lock > l_unlock( lock );
-      waiting_cors.emplace_back( std::move( running ) );
-    } );
+    // once coroutines are parked the state isn't 0 until they have had it.
+    uintptr_t expected = 0;
+    if ( state.load( std::memory_order_relaxed ) == 0 &&
+         state.compare_exchange_weak( expected, running_owner( ) ) ) {
+      spin_estimate.store( estimate + ( int32_t( i ) - int32_t( estimate ) ) / 8,
+                           std::memory_order_relaxed );
+      return true;
+    }
   }
 
-  assert( lock.owns_lock( ) );
+  spin_estimate.store( estimate + ( int32_t( limit ) - int32_t( estimate ) ) / 8,
+                       std::memory_order_relaxed );
+  return false;
 }
 
 bool
-mutex::try_lock( )
+mutex::park_lock( const timer_clock::time_point* deadline )
 {
-  boost::unique_lock< boost::mutex > lock( mt );
+  auto* cancellation = detail::cancellation_state::of_running( );
+  better_lock lock( mt );
+  if ( cancellation && cancellation->cancelled ) {
+    throw operation_cancelled( );
+  }
+  // the bit is only cleared while holding mt, so once it is set unlock() sees
+  // it and hands the mutex to us instead of releasing it.
+  auto current = state.load( );
+  while ( true ) {
+    if ( current == 0 ) {
+      if ( state.compare_exchange_weak( current, running_owner( ) ) ) {
+        return true;
+      }
+    } else if ( ( current & has_waiters ) ||
+                state.compare_exchange_weak( current, current | has_waiters ) ) {
+      break;
+    }
+  }
+
+  bool gave_up = false;
+  timer_entry timeout;
+  detail::cancellation_callback on_cancel;
+  global_thr_pool->yield(
+    [&]( coroutine running ) {
+      lock_unlocker< better_lock > l_unlock( lock );
+      if ( !waiting_cors ) {
+        waiting_cors = std::make_unique< std::deque< coroutine > >( );
+      }
+      auto id = running.get_id( );
+      waiting_cors->emplace_back( std::move( running ) );
+
+      auto give_up = [this, id, &gave_up] {
+        boost::unique_lock< boost::mutex > mt_lock( mt );
+        auto it = std::find_if( waiting_cors->begin( ), waiting_cors->end( ),
+                                [id]( const coroutine& cor ) { return cor.get_id( ) == id; } );
+        if ( it == waiting_cors->end( ) ) {
+          // unlock() handed the mutex to us first, or we have already given up.
+          return;
+        }
+        auto cor = std::move( *it );
+        waiting_cors->erase( it );
+        if ( waiting_cors->empty( ) ) {
+          state &= ~has_waiters;
+        }
+        mt_lock.unlock( );
+        gave_up = true;
+        global_thr_pool->schedule( std::move( cor ), true );
+      };
+      if ( cancellation ) {
+        on_cancel.arm( *cancellation, give_up );
+      }
+      if ( deadline ) {
+        timeout.deadline = *deadline;
+        timeout.callback.func = give_up;
+        global_thr_pool->add_timer( timeout );
+      }
+    },
+    block_reason::mutex );
 
-  if ( owning_cor ) {
+  // the callbacks may still be running if unlock() won the race.
+  on_cancel.disarm( );
+  if ( deadline ) {
+    global_thr_pool->cancel_timer( timeout );
+  }
+  if ( gave_up ) {
+    if ( cancellation && cancellation->cancelled ) {
+      throw operation_cancelled( );
+    }
     return false;
-  } else {
-    owning_cor = running_coroutine;
   }
 
+  // the coroutine that unlocked the mutex handed it to us. Other coroutines
+  // may be setting or clearing the bit meanwhile.
+  current = state.load( );
+  do {
+    assert( ( current & ~has_waiters ) == handed_off );
+  } while ( !state.compare_exchange_weak( current, running_owner( ) | ( current & has_waiters ) ) );
   return true;
 }
 
+bool
+mutex::try_lock( )
+{
+  uintptr_t expected = 0;
+  if ( state.compare_exchange_strong( expected, running_owner( ) ) ) {
+    note_acquired( );
+    return true;
+  }
+  return false;
+}
+
 void
 mutex::unlock( )
 {
-  boost::unique_lock< boost::mutex > lock( mt );
-
-  assert( running_coroutine == owning_cor );
+  assert( ( state & ~has_waiters ) == running_owner( ) );
 
-  owning_cor = nullptr;
+  // nothing may touch the mutex once it has been released, its owner may
+  // destroy it right away.
+  uintptr_t expected = running_owner( );
+  if ( state.compare_exchange_strong( expected, 0 ) ) {
+    return;
+  }
 
-  if ( waiting_cors.size( ) ) {
-    auto cor = std::move( waiting_cors.front( ) );
-    waiting_cors.pop_front( );
-    global_thr_pool.schedule( std::move( cor ), true );
+  // coroutines are parked, so the mutex is passed to the first one without
+  // releasing it. If they have given up it is released while holding mt,
+  // which the destructor waits for.
+  boost::unique_lock< boost::mutex > lock( mt );
+  if ( !waiting_cors || waiting_cors->empty( ) ) {
+    state = 0;
+    return;
   }
+
+  auto cor = std::move( waiting_cors->front( ) );
+  waiting_cors->pop_front( );
+  state = handed_off | ( waiting_cors->empty( ) ? 0 : has_waiters );
+  ++cnt.handoffs;
+  lock.unlock( );
+  global_thr_pool->schedule( std::move( cor ), true );
+}
+
+mutex_stats
+mutex::stats( ) const
+{
+  mutex_stats ret;
+  ret.acquisitions  = cnt.acquisitions.load( std::memory_order_relaxed );
+  ret.contended     = cnt.contended.load( std::memory_order_relaxed );
+  ret.spin_acquired = cnt.spin_acquired.load( std::memory_order_relaxed );
+  ret.parked        = cnt.parked.load( std::memory_order_relaxed );
+  ret.handoffs      = cnt.handoffs.load( std::memory_order_relaxed );
+  return ret;
 }
 }
 }
@@ -0,0 +1,43 @@
+#include "thr_queue/event/semaphore.h"
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+semaphore::semaphore( std::ptrdiff_t initial ) : count( initial )
+{
+}
+
+void
+semaphore::acquire( )
+{
+  while ( !try_acquire( ) ) {
+    waiters.park_unless( [this] { return count.load( ) > 0; } );
+  }
+}
+
+bool
+semaphore::try_acquire( )
+{
+  auto c = count.load( std::memory_order_relaxed );
+  while ( c > 0 ) {
+    if ( count.compare_exchange_weak( c, c - 1, std::memory_order_acquire,
+                                      std::memory_order_relaxed ) ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+semaphore::release( std::ptrdiff_t n )
+{
+  count.fetch_add( n, std::memory_order_release );
+  if ( n == 1 ) {
+    waiters.notify_one( );
+  } else {
+    waiters.notify_all( );
+  }
+}
+}
+}
+}
@@ -0,0 +1,168 @@
+#include "thr_queue/event/shared_mutex.h"
+#include "../global_thr_pool_impl.h"
+#include "better_lock.h"
+#include "lock_unlocker.h"
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+namespace {
+void
+park_in( std::unique_ptr< std::deque< coroutine > >& waiting, better_lock& lock )
+{
+  global_thr_pool->yield(
+    [&]( coroutine running ) {
+      lock_unlocker< better_lock > l_unlock( lock );
+      if ( !waiting ) {
+        waiting = std::make_unique< std::deque< coroutine > >( );
+      }
+      waiting->emplace_back( std::move( running ) );
+    },
+    block_reason::mutex );
+}
+}
+
+shared_mutex::~shared_mutex( )
+{
+  boost::lock_guard< boost::mutex > lock( mt );
+  assert( ( !waiting_writers || waiting_writers->empty( ) ) &&
+          ( !waiting_readers || waiting_readers->empty( ) ) &&
+          "coroutines would get stuck trying to lock a non-existing mutex" );
+  assert( state == 0 && "can't destroy a locked mutex" );
+}
+
+void
+shared_mutex::lock( )
+{
+  assert( running_coroutine );
+  if ( !try_lock( ) ) {
+    lock_slow( );
+  }
+}
+
+bool
+shared_mutex::try_lock( )
+{
+  uint32_t expected = 0;
+  return state.compare_exchange_strong( expected, writer_held );
+}
+
+void
+shared_mutex::lock_slow( )
+{
+  better_lock lock( mt );
+  ++writers_waiting;
+  // from now on no new readers get in.
+  auto s = state.fetch_or( writer_waiting );
+  while ( !( s & writer_held ) && ( s & readers_mask ) == 0 ) {
+    uint32_t desired = writer_held | ( writers_waiting > 1 ? writer_waiting : 0 );
+    if ( state.compare_exchange_weak( s, desired ) ) {
+      --writers_waiting;
+      return;
+    }
+  }
+
+  // the last reader or the previous writer hands us the lock.
+  park_in( waiting_writers, lock );
+}
+
+void
+shared_mutex::unlock( )
+{
+  boost::unique_lock< boost::mutex > lock( mt );
+  assert( state & writer_held );
+
+  if ( waiting_writers && !waiting_writers->empty( ) ) {
+    auto cor = std::move( waiting_writers->front( ) );
+    waiting_writers->pop_front( );
+    --writers_waiting;
+    state = writer_held | ( writers_waiting > 0 ? writer_waiting : 0 );
+    lock.unlock( );
+    global_thr_pool->schedule( std::move( cor ), true );
+    return;
+  }
+
+  // a writer could be between setting writer_waiting and parking, but it does
+  // so holding mt.
+  assert( writers_waiting == 0 );
+  if ( !waiting_readers || waiting_readers->empty( ) ) {
+    state = 0;
+    return;
+  }
+
+  auto readers = std::move( waiting_readers );
+  state = uint32_t( readers->size( ) );
+  lock.unlock( );
+  auto begin_move = std::make_move_iterator( readers->begin( ) );
+  auto end_move   = std::make_move_iterator( readers->end( ) );
+  global_thr_pool->schedule( begin_move, end_move, true );
+}
+
+void
+shared_mutex::lock_shared( )
+{
+  assert( running_coroutine );
+  if ( !try_lock_shared( ) ) {
+    lock_shared_slow( );
+  }
+}
+
+bool
+shared_mutex::try_lock_shared( )
+{
+  auto s = state.load( std::memory_order_relaxed );
+  while ( !( s & ( writer_held | writer_waiting ) ) ) {
+    if ( state.compare_exchange_weak( s, s + 1, std::memory_order_acquire,
+                                      std::memory_order_relaxed ) ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+shared_mutex::lock_shared_slow( )
+{
+  better_lock lock( mt );
+  // writers only clear their flags holding mt, so if we see them now we will
+  // be woken up.
+  if ( try_lock_shared( ) ) {
+    return;
+  }
+
+  // the unlocking writer counts us as a reader before scheduling us.
+  park_in( waiting_readers, lock );
+}
+
+void
+shared_mutex::unlock_shared( )
+{
+  auto s = state.fetch_sub( 1, std::memory_order_release );
+  assert( s & readers_mask );
+  if ( ( s & readers_mask ) == 1 && ( s & writer_waiting ) ) {
+    wake_writer( );
+  }
+}
+
+void
+shared_mutex::wake_writer( )
+{
+  boost::unique_lock< boost::mutex > lock( mt );
+  // readers can't get in while writer_waiting is set, and the writers that
+  // aren't parked yet hold mt.
+  auto s = state.load( );
+  if ( ( s & writer_held ) || ( s & readers_mask ) || !waiting_writers ||
+       waiting_writers->empty( ) ) {
+    return;
+  }
+
+  auto cor = std::move( waiting_writers->front( ) );
+  waiting_writers->pop_front( );
+  --writers_waiting;
+  state = writer_held | ( writers_waiting > 0 ? writer_waiting : 0 );
+  lock.unlock( );
+  global_thr_pool->schedule( std::move( cor ), true );
+}
+}
+}
+}
@@ -0,0 +1,113 @@
+#include "thr_queue/event/wait_list.h"
+#include "../global_thr_pool_impl.h"
+#include "better_lock.h"
+#include "lock_unlocker.h"
+
+namespace game_engine {
+namespace thr_queue {
+namespace event {
+wait_list::~wait_list( )
+{
+  boost::lock_guard< boost::mutex > lock( mt );
+  assert( waiting.empty( ) && "coroutines would get stuck waiting for a non-existing list" );
+}
+
+void
+wait_list::park_unless( bool ( *ready )( void* ), void* ctx, block_reason reason )
+{
+  assert( running_coroutine );
+  better_lock lock( mt );
+  // pairs with the fence in notify(): either we see the change that makes us
+  // ready or the notifier sees us waiting.
+  ++count;
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  if ( ready( ctx ) ) {
+    --count;
+    return;
+  }
+
+  global_thr_pool->yield(
+    [&]( coroutine running ) {
+      lock_unlocker< better_lock > l_unlock( lock );
+      waiting.emplace_back( std::move( running ) );
+    },
+    reason );
+}
+
+void
+wait_list::notify_one( )
+{
+  notify( false, nullptr, nullptr );
+}
+
+void
+wait_list::notify_all( )
+{
+  notify( true, nullptr, nullptr );
+}
+
+void
+wait_list::notify( bool all, void ( *signal )( void* ), void* ctx )
+{
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  if ( count.load( std::memory_order_relaxed ) == 0 ) {
+    return;
+  }
+
+  boost::lock_guard< boost::mutex > lock( mt );
+  if ( signal ) {
+    signal( ctx );
+  }
+  if ( waiting.empty( ) ) {
+    return;
+  }
+
+  // they are scheduled while holding the lock so that the vector keeps its
+  // capacity for the next time.
+  auto end = all ? waiting.end( ) : waiting.begin( ) + 1;
+  count -= uint32_t( end - waiting.begin( ) );
+  global_thr_pool->schedule( std::make_move_iterator( waiting.begin( ) ),
+                            std::make_move_iterator( end ), true );
+  waiting.erase( waiting.begin( ), end );
+}
+
+void
+wait_list::notify_all_after( void ( *change )( void* ), void* ctx )
+{
+  boost::lock_guard< boost::mutex > lock( mt );
+  change( ctx );
+  if ( waiting.empty( ) ) {
+    return;
+  }
+  count -= uint32_t( waiting.size( ) );
+  global_thr_pool->schedule( std::make_move_iterator( waiting.begin( ) ),
+                            std::make_move_iterator( waiting.end( ) ), true );
+  waiting.clear( );
+}
+
+void
+wait_list::add_waiter( void ( *add )( void* ), void* ctx )
+{
+  boost::lock_guard< boost::mutex > lock( mt );
+  add( ctx );
+  ++count;
+  // pairs with the fence in notify(), like in park_unless().
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+}
+
+void
+wait_list::remove_waiter( void ( *remove )( void* ), void* ctx )
+{
+  boost::lock_guard< boost::mutex > lock( mt );
+  remove( ctx );
+  --count;
+}
+
+void
+wait_list::sync( )
+{
+  boost::lock_guard< boost::mutex > lock( mt );
+}
+}
+}
+}
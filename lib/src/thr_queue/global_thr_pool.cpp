@@ -1,58 +1,87 @@
 #include "global_thr_pool_impl.h"
-#include "thr_queue/event/cond_var.h"
 #include <cassert>
+#include <thr_queue/global_thr_pool.h>
+#include <thr_queue/pool_stats.h>
 #include <thr_queue/queue.h>
 #include <vector>
 
 namespace game_engine {
 namespace thr_queue {
-std::vector< coroutine >
-queue_to_vec_cor( queue q, event::condition_variable* cv, event::mutex* mt, size_t min )
+// wakes up the coroutines waiting on cv every time a unit of work completes,
+// once at least min of them have. The first min units count down the latch.
+struct min_units_notifier
 {
-  if ( cv ) {
-    assert( mt );
+  min_units_notifier( event::condition_variable& cv_, event::mutex& mt_, size_t min_ )
+    : cv( cv_ ), mt( mt_ ), min( min_ ), reached( std::ptrdiff_t( min_ ) )
+  {
   }
 
+  void unit_done( );
+
+  event::condition_variable& cv;
+  event::mutex& mt;
+  size_t min;
+  std::atomic< size_t > completed{ 0 };
+  event::latch reached;
+};
+
+void
+min_units_notifier::unit_done( )
+{
+  if ( completed.fetch_add( 1, std::memory_order_relaxed ) < min ) {
+    reached.count_down( );
+  }
+  if ( reached.try_wait( ) ) {
+    boost::lock_guard< event::mutex > lock( mt );
+    cv.notify( );
+  }
+}
+
+std::vector< coroutine >
+queue_to_vec_cor( queue q, event::latch* done, std::shared_ptr< min_units_notifier > notifier )
+{
   std::vector< coroutine > cors;
+  auto unit_done = [ done, notifier ]( ) {
+    if ( done ) {
+      done->count_down( );
+    }
+    if ( notifier ) {
+      notifier->unit_done( );
+    }
+  };
 
   if ( q.type( ) == queue_type::serial ) {
-    if ( cv ) {
-      auto func = [ q = std::move( q ), cv, mt, min ]( ) mutable
+    auto opts = q.combined_options( );
+    if ( done || notifier ) {
+      auto func = [ q = std::move( q ), unit_done ]( ) mutable
       {
-        for ( size_t i = 0; q.run_once( ); ++i ) {
-          if ( i >= min ) {
-            boost::lock_guard< event::mutex > lock( *mt );
-            cv->notify( );
-          }
+        while ( q.run_once( ) ) {
+          unit_done( );
         }
       };
-      cors.emplace_back( std::move( func ) );
+      cors.emplace_back( std::move( func ), opts );
     } else {
       auto func = [q = std::move( q )]( ) mutable
       {
         q.run_until_empty( );
       };
-      cors.emplace_back( std::move( func ) );
+      cors.emplace_back( std::move( func ), opts );
     }
   } else {
+    q.take_concurrent_work( q );
     cors.reserve( q.work_queue.size( ) );
-    if ( cv ) {
-      auto atomic = std::make_shared< std::atomic< size_t > >( 0 );
+    if ( done || notifier ) {
       for ( auto& work : q.work_queue ) {
-        auto func = [ work = std::move( work ), atomic, cv, mt, min ]( ) mutable
+        auto func = [ work = std::move( work.func ), unit_done ]( ) mutable
         {
-          ( *work )( );
-          size_t atom_val = ++( *atomic );
-          if ( atom_val >= min ) {
-            boost::lock_guard< event::mutex > lock( *mt );
-            cv->notify( );
-          }
+          work( );
+          unit_done( );
         };
-        cors.emplace_back( std::move( func ) );
+        cors.emplace_back( std::move( func ), work.opts );
       }
     } else {
       for ( auto& work : q.work_queue ) {
-        cors.emplace_back( std::move( work ) );
+        cors.emplace_back( std::move( work.func ), work.opts );
       }
     }
   }
@@ -61,36 +90,86 @@ queue_to_vec_cor( queue q, event::condition_variable* cv, event::mutex* mt, size
 }
 
 static void
-do_schedule( queue& q, event::condition_variable* cv, event::mutex* mt, size_t min, bool first )
+do_schedule( queue& q, event::latch* done, std::shared_ptr< min_units_notifier > notifier, bool first )
 {
-  auto cors       = queue_to_vec_cor( std::move( q ), cv, mt, min );
+  auto cors       = queue_to_vec_cor( std::move( q ), done, std::move( notifier ) );
   auto begin_move = std::make_move_iterator( cors.begin( ) );
   auto end_move   = std::make_move_iterator( cors.end( ) );
-  global_thr_pool.schedule( begin_move, end_move, first );
+  global_thr_pool->schedule( begin_move, end_move, first );
 }
 
 void
 schedule_queue( queue q )
 {
-  do_schedule( q, nullptr, nullptr, 0, false );
+  do_schedule( q, nullptr, nullptr, false );
 }
 
 void
 schedule_queue_first( queue q )
 {
-  do_schedule( q, nullptr, nullptr, 0, true );
+  do_schedule( q, nullptr, nullptr, true );
 }
 
 void
 schedule_queue( queue q, event::condition_variable& cv, event::mutex& mt, size_t min )
 {
-  do_schedule( q, &cv, &mt, min, false );
+  do_schedule( q, nullptr, std::make_shared< min_units_notifier >( cv, mt, min ), false );
 }
 
 void
 schedule_queue_first( queue q, event::condition_variable& cv, event::mutex& mt, size_t min )
 {
-  do_schedule( q, &cv, &mt, min, true );
+  do_schedule( q, nullptr, std::make_shared< min_units_notifier >( cv, mt, min ), true );
+}
+
+void
+schedule_queue( queue q, event::latch& done )
+{
+  do_schedule( q, &done, nullptr, false );
+}
+
+void
+schedule_queue_first( queue q, event::latch& done )
+{
+  do_schedule( q, &done, nullptr, true );
+}
+
+bool
+configure_global_pool( const pool_options& opts )
+{
+  return global_thr_pool.configure( opts );
+}
+
+void
+begin_blocking( )
+{
+  if ( this_wthread ) {
+    global_thr_pool->begin_blocking( );
+  }
+}
+
+void
+end_blocking( )
+{
+  if ( this_wthread ) {
+    global_thr_pool->end_blocking( );
+  }
+}
+
+blocking_section::blocking_section( )
+{
+  begin_blocking( );
+}
+
+blocking_section::~blocking_section( )
+{
+  end_blocking( );
+}
+
+pool_stats
+get_pool_stats( )
+{
+  return global_thr_pool->stats( );
 }
 }
 }
@@ -1,4 +1,5 @@
 #include "global_thr_pool_impl.h"
+#include "stack_allocator.h"
 
 #include <algorithm>
 #define BOOST_SCOPE_EXIT_CONFIG_USE_LAMBDAS
@@ -8,20 +9,122 @@
 
 namespace game_engine {
 namespace thr_queue {
-worker_thread_internals::worker_thread_internals( generic_work_data& dat )
-  : stopped( false )
-  , ctok( dat.work_queue )
-  , ptok( dat.work_queue )
-  , ctok_prio( dat.work_queue_prio )
-  , ptok_prio( dat.work_queue_prio )
+namespace {
+cpu_topology
+detect_topology( std::vector< unsigned int > cpus )
 {
+  std::sort( cpus.begin( ), cpus.end( ) );
+  return cpu_topology::detect( cpus );
+}
+
+// coroutines that a worker runs between two checks of its I/O.
+const int io_poll_interval = 32;
+
+uint64_t
+now_ns( )
+{
+  return std::chrono::duration_cast< std::chrono::nanoseconds >(
+           std::chrono::steady_clock::now( ).time_since_epoch( ) )
+    .count( );
+}
+}
+
+generic_work_data::generic_work_data( const pool_options& opts, unsigned int max_threads )
+  : scheduler( opts.scheduler )
+  , starvation_limit_ns(
+      std::chrono::duration_cast< std::chrono::nanoseconds >( opts.starvation_limit ).count( ) )
+  , idle_timeout( opts.idle_timeout )
+  , victims_capacity( max_threads )
+  , victims( new std::atomic< worker_thread_internals* >[ max_threads ] )
+{
+  for ( unsigned int i = 0; i < victims_capacity; ++i ) {
+    victims[ i ] = nullptr;
+  }
+}
+
+generic_work_data::~generic_work_data( )
+{
+  for ( auto& entry : deadlines.heap ) {
+    std::unique_ptr< cor_data, cor_data_deleter > destroy( entry.data );
+  }
+}
+
+uint64_t
+generic_work_data::queued_work( ) const
+{
+  uint64_t ret = deadlines.size;
+  for ( auto& lane : lanes ) {
+    ret += lane.size;
+  }
+  return ret;
+}
+
+worker_thread_internals::worker_thread_internals( generic_work_data& dat ) : stopped( false )
+{
+  lane_tokens.reserve( number_work_priorities );
+  for ( auto& lane : dat.lanes ) {
+    lane_tokens.emplace_back( lane.queue );
+  }
+}
+
+worker_thread_internals::~worker_thread_internals( )
+{
+  cor_data* left;
+  while ( local_work.pop( left ) || affine_work.try_dequeue( left ) ) {
+    std::unique_ptr< cor_data, cor_data_deleter > destroy( left );
+  }
+  std::unique_ptr< cor_data, cor_data_deleter > destroy( lifo_slot.load( ) );
 }
 
 void
 generic_worker_thread::start_thread( )
 {
-  internals.emplace( get_data( ) );
-  internals->thr = boost::thread( [this] { loop( ); } );
+  auto& dat = get_data( );
+  internals.emplace( dat );
+  if ( dat.scheduler == scheduler_type::work_stealing ) {
+    auto index = dat.victims_count.load( );
+    assert( index < dat.victims_capacity );
+    internals->victim_index = index;
+    dat.victims[ index ]    = &*internals;
+    ++dat.victims_count;
+  }
+
+  // workers are dealt round robin over the CPUs.
+  auto placement = dat.started_threads++;
+  if ( dat.topology ) {
+    auto& cpu            = dat.topology->cpus[ placement % dat.topology->cpus.size( ) ];
+    internals->llc_group = cpu.llc_group;
+    internals->package   = cpu.package;
+    if ( dat.pinning == pinning_type::cpu ) {
+      internals->pinned_cpus.push_back( cpu.id );
+    } else if ( dat.pinning == pinning_type::llc ) {
+      internals->pinned_cpus = dat.topology->llc_cpus( cpu.llc_group );
+    } else if ( dat.pinning == pinning_type::socket ) {
+      internals->pinned_cpus = dat.topology->package_cpus( cpu.package );
+    }
+  }
+  launch_thread( );
+}
+
+void
+generic_worker_thread::restart_thread( )
+{
+  // the thread has retired, so it is about to exit if it hasn't already.
+  internals->thr.join( );
+  internals->stopped = false;
+  launch_thread( );
+}
+
+void
+generic_worker_thread::launch_thread( )
+{
+  internals->thr = boost::thread( [this] {
+    auto& cpus = get_internals( ).pinned_cpus;
+    if ( !cpus.empty( ) && !pin_current_thread( cpus ) ) {
+      LOG( ) << "WARNING: Couldn't pin worker thread to its CPUs.";
+    }
+    loop( );
+  } );
 }
 
 void
@@ -37,14 +140,200 @@ generic_worker_thread::schedule_coroutine( coroutine cor )
 #endif
 }
 
+bool
+generic_worker_thread::pop_shared_work( coroutine& cor )
+{
+  auto& dat = get_data( );
+  if ( ( ++get_internals( ).shared_dequeues & 15 ) == 0 ) {
+    auto now = now_ns( );
+    for ( size_t lane = number_work_priorities - 1; lane > 0; --lane ) {
+      auto& l = dat.lanes[ lane ];
+      if ( l.size > 0 && now - l.last_served_ns.load( std::memory_order_relaxed ) > dat.starvation_limit_ns &&
+           pop_lane( lane, cor ) ) {
+        return true;
+      }
+    }
+  }
+
+  if ( pop_lane( size_t( work_priority::critical ), cor ) || pop_deadline( cor ) ) {
+    return true;
+  }
+  for ( size_t lane = size_t( work_priority::critical ) + 1; lane < number_work_priorities; ++lane ) {
+    if ( pop_lane( lane, cor ) ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+generic_worker_thread::pop_lane( size_t lane, coroutine& cor )
+{
+  auto& l = get_data( ).lanes[ lane ];
+  while ( l.size > 0 ) {
+    if ( l.queue.try_dequeue_from_producer( get_internals( ).lane_tokens[ lane ], cor ) ||
+         l.queue.try_dequeue( cor ) ) {
+      --l.size;
+      l.last_served_ns.store( now_ns( ), std::memory_order_relaxed );
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+generic_worker_thread::pop_deadline( coroutine& cor )
+{
+  auto& dl = get_data( ).deadlines;
+  if ( dl.size == 0 ) {
+    return false;
+  }
+  boost::lock_guard< boost::mutex > lock( dl.mt );
+  if ( dl.heap.empty( ) ) {
+    return false;
+  }
+  std::pop_heap( dl.heap.begin( ), dl.heap.end( ) );
+  cor.data_ptr.reset( dl.heap.back( ).data );
+  dl.heap.pop_back( );
+  --dl.size;
+  return true;
+}
+
+bool
+generic_worker_thread::pop_local_work( coroutine& cor )
+{
+  auto& internals = get_internals( );
+  cor_data* data;
+  // the coroutines in affine_work were woken up before we looked, our
+  // children can wait.
+  if ( !internals.affine_work.try_dequeue( data ) && !internals.local_work.pop( data ) ) {
+    return false;
+  }
+  cor.data_ptr.reset( data );
+  return true;
+}
+
+bool
+generic_worker_thread::pop_lifo( coroutine& cor )
+{
+  // like Go, we bound how long a coroutine that keeps spawning children can
+  // keep the worker from looking at its other queues.
+  const unsigned int max_lifo_streak = 16;
+  auto& internals = get_internals( );
+  if ( internals.lifo_streak >= max_lifo_streak ) {
+    internals.lifo_streak = 0;
+    return false;
+  }
+  cor_data* data = nullptr;
+  if ( internals.lifo_slot.load( std::memory_order_relaxed ) ) {
+    data = internals.lifo_slot.exchange( nullptr, std::memory_order_acquire );
+  }
+  if ( !data ) {
+    internals.lifo_streak = 0;
+    return false;
+  }
+  ++internals.lifo_streak;
+  bump_counter( internals.lifo_hits );
+  cor.data_ptr.reset( data );
+  return true;
+}
+
+bool
+generic_worker_thread::steal_work( coroutine& cor )
+{
+  // xorshift, we only need the victims to be spread.
+  static thread_local uint32_t seed = 0;
+  if ( seed == 0 ) {
+    seed = get_internals( ).victim_index * 2654435761u + 1;
+  }
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  auto& dat  = get_data( );
+  auto count = dat.victims_count.load( std::memory_order_acquire );
+  // the first pass only looks at workers that share our last level cache, the
+  // data of their coroutines is likely to be in it. The second one looks at
+  // the rest of our socket, whose memory is closer than that of the others.
+  const bool grouped =
+    dat.topology && ( dat.topology->number_llc_groups > 1 || dat.topology->number_packages > 1 );
+  auto& self    = get_internals( );
+  auto distance = [&self]( const worker_thread_internals& victim ) {
+    return victim.llc_group == self.llc_group ? 0 : victim.package == self.package ? 1 : 2;
+  };
+  for ( int pass = grouped ? 0 : 2; pass < 3; ++pass ) {
+    for ( unsigned int i = 0; i < count; ++i ) {
+      auto index = ( seed + i ) % count;
+      if ( index == get_internals( ).victim_index ) {
+        continue;
+      }
+      auto* victim = dat.victims[ index ].load( std::memory_order_acquire );
+      if ( !victim ) {
+        continue;
+      }
+      if ( grouped && distance( *victim ) != pass ) {
+        continue;
+      }
+      cor_data* data;
+      if ( victim->local_work.steal( data ) || victim->affine_work.try_dequeue( data ) ) {
+        cor.data_ptr.reset( data );
+        bump_counter( get_internals( ).tasks_stolen );
+        return true;
+      }
+    }
+  }
+
+  // the LIFO slots are a last resort, their owners are about to run them.
+  for ( unsigned int i = 0; i < count; ++i ) {
+    auto index   = ( seed + i ) % count;
+    auto* victim = dat.victims[ index ].load( std::memory_order_acquire );
+    if ( index == get_internals( ).victim_index || !victim ||
+         !victim->lifo_slot.load( std::memory_order_relaxed ) ) {
+      continue;
+    }
+    if ( auto* data = victim->lifo_slot.exchange( nullptr, std::memory_order_acquire ) ) {
+      cor.data_ptr.reset( data );
+      bump_counter( get_internals( ).tasks_stolen );
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+generic_worker_thread::stealable_work( )
+{
+  auto& dat  = get_data( );
+  auto count = dat.victims_count.load( std::memory_order_acquire );
+  for ( unsigned int i = 0; i < count; ++i ) {
+    auto* victim = dat.victims[ i ].load( std::memory_order_acquire );
+    if ( victim && ( victim->local_work.size_approx( ) > 0 || victim->affine_work.size_approx( ) > 0 ||
+                     victim->lifo_slot.load( ) ) ) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void
 generic_worker_thread::do_work( )
 {
+  const auto start = std::chrono::steady_clock::now( );
   bool could_work;
   int number_units_of_work   = 0;
   bool only_run_thread_queue = false;
+  const bool stealing        = get_data( ).scheduler == scheduler_type::work_stealing;
+  // a worker that has just been woken up is searching for work until it finds
+  // some. While somebody searches, schedulers don't wake up other workers.
+  bool searching = stealing;
+  if ( searching ) {
+    ++get_data( ).searching_threads;
+  }
   do {
     could_work = false;
+    // work that comes from the worker's own queues isn't accounted in
+    // working_threads, that way it doesn't touch shared cache lines.
+    bool shared_work = false;
 
     coroutine work_to_do;
 
@@ -54,6 +343,10 @@ generic_worker_thread::do_work( )
       goto do_work;
     }
 
+    if ( stealing && !only_run_thread_queue && pop_lifo( work_to_do ) ) {
+      goto do_work;
+    }
+
     while ( get_internals( ).thread_queue_size > 0 ) {
       if ( get_internals( ).thread_queue.try_dequeue( work_to_do ) ) {
         --get_internals( ).thread_queue_size;
@@ -61,51 +354,76 @@ generic_worker_thread::do_work( )
       }
     }
 
-    while ( get_data( ).work_queue_prio_size > 0 && !only_run_thread_queue ) {
-      if ( get_data( ).work_queue_prio.try_dequeue_from_producer( internals->ptok_prio, work_to_do ) ||
-           get_data( ).work_queue_prio.try_dequeue( work_to_do ) ) {
-        --get_data( ).work_queue_prio_size;
-        goto do_work;
-      }
+    if ( stealing && !only_run_thread_queue && pop_local_work( work_to_do ) ) {
+      goto do_work;
     }
 
-    while ( get_data( ).work_queue_size > 0 && !only_run_thread_queue ) {
-      if ( get_data( ).work_queue.try_dequeue_from_producer( internals->ptok, work_to_do ) ||
-           get_data( ).work_queue.try_dequeue( work_to_do ) ) {
-        --get_data( ).work_queue_size;
-        goto do_work;
-      }
-      if ( get_data( ).work_queue_prio.try_dequeue_from_producer( internals->ptok_prio, work_to_do ) ||
-           get_data( ).work_queue_prio.try_dequeue( work_to_do ) ) {
-        --get_data( ).work_queue_prio_size;
-        goto do_work;
-      }
+    shared_work = true;
+
+    if ( !only_run_thread_queue && pop_shared_work( work_to_do ) ) {
+      goto do_work;
+    }
+
+    if ( stealing && !only_run_thread_queue && steal_work( work_to_do ) ) {
+      shared_work = false;
+      goto do_work;
     }
 
     could_work = false;
     break;
 
   do_work:
-    ++get_data( ).working_threads;
+    if ( searching ) {
+      // we might not be the only one with work to do.
+      searching = false;
+      if ( --get_data( ).searching_threads == 0 ) {
+        global_thr_pool->wakeup_thief( );
+      }
+    }
+    if ( shared_work ) {
+      ++get_data( ).working_threads;
+    }
     BOOST_SCOPE_EXIT_ALL( & )
     {
-      --get_data( ).working_threads;
+      if ( shared_work ) {
+        --get_data( ).working_threads;
+      }
     };
     if ( !work_to_do.can_be_run_by_thread( this_wthread ) ) {
       // we reschedule it and hope it is run by a different thread.
       LOG( ) << "Rescheduling cor: " << work_to_do.get_id( ) << " thr id: " << boost::this_thread::get_id( );
-      global_thr_pool.schedule( std::move( work_to_do ), true );
+      bump_counter( get_internals( ).reschedules );
+      global_thr_pool->schedule( std::move( work_to_do ), true );
       only_run_thread_queue = true;
       continue;
     }
     ++number_units_of_work;
+    bump_counter( get_internals( ).tasks_run );
     could_work        = true;
     running_coroutine = &work_to_do;
 
     work_to_do.set_forbidden_thread( nullptr );
+    // bound coroutines can only run here, they tell nothing about affinity.
+    auto* last = work_to_do.data_ptr->last_worker;
+    if ( last && !work_to_do.data_ptr->bound_thread ) {
+      auto& internals = get_internals( );
+      bump_counter( last == this_wthread ? internals.affinity_hits : internals.affinity_misses );
+    }
+    work_to_do.data_ptr->last_worker = this_wthread;
+
+    // the coroutine may be gone once it has run, so we keep its id.
+    std::intptr_t traced_id = 0;
+    if ( tracing( ) ) {
+      traced_id          = work_to_do.get_id( );
+      trace_block_reason = block_reason::finished;
+      record_trace_event( trace_event_type::switch_in, traced_id, block_reason::finished );
+    }
 
     work_to_do.switch_to_from( *master_coroutine );
     assert( running_coroutine == &work_to_do );
+    if ( traced_id != 0 ) {
+      record_trace_event( trace_event_type::switch_out, traced_id, trace_block_reason );
+    }
     if ( *after_yield ) {
       ( *after_yield )( std::move( work_to_do ) );
       *after_yield = nullptr;
@@ -114,8 +432,18 @@ generic_worker_thread::do_work( )
 
     // if we think that other threads are waiting apart
     // from this one, we wake them up.
-    global_thr_pool.plat_wakeup_threads( );
+    global_thr_pool->plat_wakeup_threads( );
+
+    // the fds of the coroutines waiting for I/O are only registered with this
+    // worker, which doesn't look at them while it keeps finding work.
+    if ( number_units_of_work % io_poll_interval == 0 ) {
+      poll_io( );
+    }
   } while ( could_work );
+  if ( searching ) {
+    --get_data( ).searching_threads;
+  }
+  bump_counter( get_internals( ).busy_ns, elapsed_ns( start ) );
   LOG( ) << "Thread " << boost::this_thread::get_id( ) << " performed " << number_units_of_work;
 }
 
@@ -140,20 +468,28 @@ worker_thread::~worker_thread( )
   assert( get_internals( ).stopped );
 }
 
-global_thread_pool::global_thread_pool( )
-  : hardware_concurrency( std::max( 1u, boost::thread::hardware_concurrency( ) ) )
-  , work_data( hardware_concurrency )
+global_thread_pool::global_thread_pool( pool_options opts )
+  : topology( detect_topology( opts.cpus ) )
+  , hardware_concurrency( topology.cpus.size( ) )
+  // a coroutine that runs a blocking aio operation can't be run by the worker
+  // that scheduled it, so we need at least two.
+  , min_workers( std::max( 2u, opts.threads ? opts.threads : hardware_concurrency ) )
+  , max_workers( std::max( min_workers, opts.max_threads ? opts.max_threads : min_workers + 64 ) )
+  , work_data( hardware_concurrency, opts, max_workers )
+  , blocking( opts.blocking_threads, opts.blocking_queue_size )
 {
-  auto c_threads = hardware_concurrency + 8;
-
+  work_data.topology = &topology;
+  work_data.pinning  = opts.pinning;
   boost::lock_guard< boost::mutex > lock( threads_mt );
-  for ( size_t i = 0; i < c_threads; ++i ) {
-    threads.emplace_back( work_data );
+  for ( size_t i = 0; i < min_workers; ++i ) {
+    add_worker( );
   }
 }
 
 global_thread_pool::~global_thread_pool( )
 {
+  // the blocking calls that are queued may wake up coroutines.
+  blocking.stop( );
   boost::unique_lock< boost::mutex > l( threads_mt );
   work_data.shutting_down = true;
   for ( auto it = threads.begin( ); it != threads.end( ); ) {
@@ -183,6 +519,300 @@ global_thread_pool::schedule( coroutine cor, bool first )
   schedule( move_iter, move_iter + 1, first );
 }
 
+bool
+global_thread_pool::schedule_local( coroutine& cor )
+{
+  // the deques aren't ordered by priority.
+  if ( !this_wthread || work_data.scheduler != scheduler_type::work_stealing ||
+       cor.data_ptr->priority != work_priority::normal || cor.data_ptr->deadline != no_deadline ||
+       !cor.can_be_run_by_thread( this_wthread ) ) {
+    return false;
+  }
+  this_wthread->get_internals( ).local_work.push( cor.data_ptr.release( ) );
+  return true;
+}
+
+bool
+global_thread_pool::schedule_lifo( coroutine& cor, bool first )
+{
+  if ( !this_wthread || work_data.scheduler != scheduler_type::work_stealing ||
+       cor.data_ptr->priority != work_priority::normal || cor.data_ptr->deadline != no_deadline ||
+       !cor.can_be_run_by_thread( this_wthread ) ) {
+    return false;
+  }
+  // a freshly spawned child, or a coroutine whose data is likely in our cache.
+  auto* last = cor.data_ptr->last_worker;
+  if ( first ? last != this_wthread : last != nullptr ) {
+    return false;
+  }
+  auto& internals = this_wthread->get_internals( );
+  bump_counter( internals.lifo_pushes );
+  auto* kicked = internals.lifo_slot.exchange( cor.data_ptr.release( ), std::memory_order_acq_rel );
+  if ( kicked ) {
+    internals.local_work.push( kicked );
+  }
+  return true;
+}
+
+bool
+global_thread_pool::schedule_affine( coroutine& cor )
+{
+  auto* last = cor.data_ptr->last_worker;
+  if ( !last || last == this_wthread || work_data.scheduler != scheduler_type::work_stealing ||
+       cor.data_ptr->priority != work_priority::normal || cor.data_ptr->deadline != no_deadline ||
+       !cor.can_be_run_by_thread( last ) ) {
+    return false;
+  }
+  auto& internals = last->get_internals( );
+  internals.affine_work.enqueue( cor.data_ptr.release( ) );
+  last->wakeup( );
+  // the worker may have retired, see retire_worker().
+  if ( internals.stopped ) {
+    revive_worker( *last );
+  }
+  return true;
+}
+
+void
+global_thread_pool::schedule_deadline( coroutine cor )
+{
+  auto& dl = work_data.deadlines;
+  boost::lock_guard< boost::mutex > lock( dl.mt );
+  dl.heap.push_back( { cor.data_ptr->deadline, cor.data_ptr.release( ) } );
+  std::push_heap( dl.heap.begin( ), dl.heap.end( ) );
+  ++dl.size;
+}
+
+void
+global_thread_pool::enqueue_lane( size_t lane,
+                                  std::move_iterator< std::vector< coroutine >::iterator > begin,
+                                  size_t count )
+{
+  auto& l = work_data.lanes[ lane ];
+  // the lane starts aging when it stops being empty.
+  if ( l.size.fetch_add( count ) == 0 ) {
+    l.last_served_ns.store( now_ns( ), std::memory_order_relaxed );
+  }
+  if ( this_wthread ) {
+    l.queue.enqueue_bulk( this_wthread->get_internals( ).lane_tokens[ lane ], begin, count );
+  } else {
+    l.queue.enqueue_bulk( begin, count );
+  }
+}
+
+void
+global_thread_pool::wakeup_thief( )
+{
+  // pairs with the increment of sleeping_threads done by the workers before
+  // they check for stealable work one last time.
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  if ( work_data.searching_threads == 0 && work_data.sleeping_threads > 0 ) {
+    plat_wakeup_one( );
+  }
+}
+
+pool_stats
+global_thread_pool::stats( )
+{
+  pool_stats ret;
+  {
+    boost::lock_guard< boost::mutex > lock( threads_mt );
+    ret.threads      = live_workers;
+    ret.peak_threads = peak_workers;
+    ret.workers.reserve( threads.size( ) );
+    for ( auto& thr : threads ) {
+      auto& internals = thr.get_internals( );
+      worker_stats w;
+      w.tasks_run         = internals.tasks_run.load( std::memory_order_relaxed );
+      w.tasks_stolen      = internals.tasks_stolen.load( std::memory_order_relaxed );
+      w.reschedules       = internals.reschedules.load( std::memory_order_relaxed );
+      w.busy_ns           = internals.busy_ns.load( std::memory_order_relaxed );
+      w.parked_ns         = internals.parked_ns.load( std::memory_order_relaxed );
+      w.wakeups_received  = internals.wakeups_received.load( std::memory_order_relaxed );
+      w.wakeups_sent      = internals.wakeups_sent.load( std::memory_order_relaxed );
+      w.wakeups_avoided   = internals.wakeups_avoided.load( std::memory_order_relaxed );
+      w.lifo_pushes       = internals.lifo_pushes.load( std::memory_order_relaxed );
+      w.lifo_hits         = internals.lifo_hits.load( std::memory_order_relaxed );
+      w.affinity_hits     = internals.affinity_hits.load( std::memory_order_relaxed );
+      w.affinity_misses   = internals.affinity_misses.load( std::memory_order_relaxed );
+      w.thread_queue_size = internals.thread_queue_size.load( std::memory_order_relaxed );
+      w.local_queue_size  = internals.local_work.size_approx( ) + internals.affine_work.size_approx( );
+      ret.wakeups_sent += w.wakeups_sent;
+      ret.wakeups_avoided += w.wakeups_avoided;
+      ret.workers.push_back( w );
+    }
+  }
+  for ( size_t lane = 0; lane < number_work_priorities; ++lane ) {
+    ret.work_queue_sizes[ lane ] = work_data.lanes[ lane ].size.load( std::memory_order_relaxed );
+  }
+  ret.deadline_queue_size = work_data.deadlines.size.load( std::memory_order_relaxed );
+  {
+    boost::lock_guard< boost::mutex > lock( timers_mt );
+    ret.pending_timers = timers.size( );
+  }
+  ret.blocked_threads      = blocked_workers.load( std::memory_order_relaxed );
+  ret.peak_blocked_threads = peak_blocked_workers.load( std::memory_order_relaxed );
+  ret.stacks               = get_stack_stats( );
+  ret.blocking             = blocking.stats( );
+  return ret;
+}
+
+bool
+global_thread_pool::saturated( )
+{
+  uint64_t queued = work_data.queued_work( );
+  // we can't know how much work the other workers have in their deques
+  // without touching their cache lines, so we only count ours.
+  if ( this_wthread && work_data.scheduler == scheduler_type::work_stealing ) {
+    queued += this_wthread->get_internals( ).local_work.size_approx( );
+  }
+  return queued >= hardware_concurrency;
+}
+
+unsigned int
+global_thread_pool::concurrency( ) const
+{
+  return hardware_concurrency;
+}
+
+void
+global_thread_pool::add_timer( timer_entry& e )
+{
+  boost::lock_guard< boost::mutex > lock( timers_mt );
+  e.callback.arm( );
+  timers.add( e );
+  if ( e.tick < timers_armed_tick ) {
+    timers_armed_tick = e.tick;
+    plat_arm_timer( e.tick );
+  }
+}
+
+bool
+global_thread_pool::cancel_timer( timer_entry& e )
+{
+  {
+    boost::lock_guard< boost::mutex > lock( timers_mt );
+    if ( e.callback.disarm( ) ) {
+      timers.remove( e );
+      return true;
+    }
+  }
+  e.callback.wait_fired( );
+  return false;
+}
+
+void
+global_thread_pool::run_timers( )
+{
+  static thread_local std::vector< timer_entry* > expired;
+  {
+    boost::lock_guard< boost::mutex > lock( timers_mt );
+    timers.advance( timer_wheel::clock::now( ), expired );
+    for ( auto* e : expired ) {
+      e->callback.take( );
+    }
+    // the platform timer may have fired early or for entries that have been
+    // cancelled, we always arm it again.
+    timers_armed_tick = timers.next_expiry( );
+    plat_arm_timer( timers_armed_tick );
+  }
+
+  for ( auto* e : expired ) {
+    e->callback.fire( );
+  }
+  expired.clear( );
+}
+
+void
+global_thread_pool::begin_blocking( )
+{
+  auto blocked = ++blocked_workers;
+  auto peak    = peak_blocked_workers.load( std::memory_order_relaxed );
+  while ( blocked > peak && !peak_blocked_workers.compare_exchange_weak( peak, blocked ) ) {
+  }
+
+  // usually there are enough workers left, then we don't need the lock.
+  if ( live_workers >= blocked_workers + min_workers ) {
+    return;
+  }
+  boost::lock_guard< boost::mutex > lock( threads_mt );
+  // live_workers may include some that have just stopped blocking, in which
+  // case the new worker will retire once it has been idle for a while.
+  if ( live_workers < blocked_workers + min_workers ) {
+    add_worker( );
+  }
+}
+
+void
+global_thread_pool::end_blocking( )
+{
+  assert( blocked_workers > 0 );
+  --blocked_workers;
+}
+
+bool
+global_thread_pool::retire_worker( worker_thread& thr )
+{
+  boost::lock_guard< boost::mutex > lock( threads_mt );
+  if ( work_data.shutting_down || live_workers <= blocked_workers + min_workers ) {
+    return false;
+  }
+  // pairs with the check of stopped done by the schedulers after they have
+  // pushed to the thread queue, see schedule().
+  auto& internals = thr.get_internals( );
+  internals.stopped = true;
+  if ( internals.thread_queue_size > 0 || internals.local_work.size_approx( ) > 0 ||
+       internals.affine_work.size_approx( ) > 0 || internals.lifo_slot.load( ) ) {
+    internals.stopped = false;
+    return false;
+  }
+  // pairs with begin_blocking(), which checks live_workers without the lock
+  // after incrementing blocked_workers: either it sees the decrement or we see
+  // its increment.
+  if ( --live_workers < blocked_workers + min_workers ) {
+    ++live_workers;
+    internals.stopped = false;
+    return false;
+  }
+  return true;
+}
+
+void
+global_thread_pool::submit_blocking( inline_functor job )
+{
+  blocking.submit( std::move( job ) );
+}
+
+void
+global_thread_pool::add_worker( )
+{
+  if ( work_data.shutting_down ) {
+    return;
+  }
+  auto retired = std::find_if( threads.begin( ), threads.end( ), []( worker_thread& thr ) {
+    return thr.get_internals( ).stopped.load( );
+  } );
+  if ( retired != threads.end( ) ) {
+    retired->restart_thread( );
+  } else if ( threads.size( ) < max_workers ) {
+    threads.emplace_back( work_data );
+  } else {
+    return;
+  }
+  peak_workers = std::max( peak_workers, ++live_workers );
+}
+
+void
+global_thread_pool::revive_worker( worker_thread& thr )
+{
+  boost::lock_guard< boost::mutex > lock( threads_mt );
+  if ( work_data.shutting_down || !thr.get_internals( ).stopped ) {
+    return;
+  }
+  thr.restart_thread( );
+  peak_workers = std::max( peak_workers, ++live_workers );
+}
+
 void
 global_thread_pool::yield( )
 {
@@ -193,18 +823,21 @@ global_thread_pool::yield( )
 }
 
 void
-global_thread_pool::yield( after_yield_f func )
+global_thread_pool::yield( after_yield_f func, block_reason reason )
 {
+  if ( tracing( ) ) {
+    trace_block_reason = reason;
+  }
   *after_yield = std::move( func );
   yield( );
 }
 
 void
-global_thread_pool::yield_to( coroutine next, after_yield_f after_yield )
+global_thread_pool::yield_to( coroutine next, after_yield_f after_yield, block_reason reason )
 {
   assert( !run_next );
   run_next = std::move( next );
-  yield( std::move( after_yield ) );
+  yield( std::move( after_yield ), reason );
 }
 
 thread_local global_thread_pool::after_yield_f* after_yield = nullptr;
@@ -212,6 +845,55 @@ thread_local coroutine* master_coroutine                    = nullptr;
 thread_local coroutine* running_coroutine                   = nullptr;
 thread_local boost::optional< coroutine > run_next;
 thread_local worker_thread* this_wthread = nullptr;
-global_thread_pool global_thr_pool;
+
+namespace {
+struct pool_config
+{
+  boost::mutex mt;
+  boost::optional< pool_options > opts;
+  bool taken = false;
+};
+
+pool_config&
+get_pool_config( )
+{
+  static pool_config config;
+  return config;
+}
+
+pool_options
+take_pool_options( )
+{
+  auto& config = get_pool_config( );
+  boost::lock_guard< boost::mutex > lock( config.mt );
+  config.taken = true;
+  return config.opts ? *config.opts : pool_options::from_environment( );
+}
+}
+
+bool
+global_pool_handle::configure( const pool_options& opts )
+{
+  auto& config = get_pool_config( );
+  boost::lock_guard< boost::mutex > lock( config.mt );
+  if ( config.taken ) {
+    return false;
+  }
+  config.opts = opts;
+  return true;
+}
+
+global_thread_pool*
+global_pool_handle::start( )
+{
+  // the workers may use the pool before its constructor returns, they wait
+  // for it here.
+  static global_thread_pool pool( take_pool_options( ) );
+  instance.store( &pool, std::memory_order_release );
+  return &pool;
+}
+
+std::atomic< global_thread_pool* > global_pool_handle::instance{ nullptr };
+global_pool_handle global_thr_pool;
 }
 }
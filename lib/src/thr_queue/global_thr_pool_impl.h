@@ -1,41 +1,159 @@
 #pragma once
 
+#include "blocking_lane.h"
 #include "thr_queue/coroutine.h"
+#include "thr_queue/pool_options.h"
+#include "thr_queue/pool_stats.h"
 #include "thr_queue/thread_api.h"
+#include "timer_wheel.h"
+#include "topology.h"
+#include "trace_impl.h"
+#include "work_stealing_deque.h"
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <concurrentqueue.h>
+#include <iterator>
 #include <list>
 #include <memory>
 #include <stack>
+#include <vector>
 
 namespace game_engine {
 namespace thr_queue {
+struct worker_thread_internals;
+
+/** \brief The queue of the coroutines of a work_priority. */
+struct work_lane
+{
+  moodycamel::ConcurrentQueue< coroutine > queue;
+  std::atomic< uint64_t > size{ 0 };
+  // when a coroutine was last dequeued, or when the lane stopped being empty.
+  std::atomic< uint64_t > last_served_ns{ 0 };
+};
+
+/** \brief The coroutines that have a deadline, ordered by it. */
+struct deadline_lane
+{
+  struct entry
+  {
+    timer_clock::time_point deadline;
+    cor_data* data;
+
+    bool
+    operator<( const entry& rhs ) const
+    {
+      // std::push_heap builds a max heap.
+      return deadline > rhs.deadline;
+    }
+  };
+
+  boost::mutex mt;
+  std::vector< entry > heap;
+  std::atomic< uint64_t > size{ 0 };
+};
+
 struct generic_work_data
 {
-  moodycamel::ConcurrentQueue< coroutine > work_queue;
-  moodycamel::ConcurrentQueue< coroutine > work_queue_prio;
-  std::atomic< uint64_t > work_queue_size{ 0 };
-  std::atomic< uint64_t > work_queue_prio_size{ 0 };
+  generic_work_data( const pool_options& opts, unsigned int max_threads );
+
+  ~generic_work_data( );
+
+  /** \brief Returns the number of coroutines in the shared queues. */
+  uint64_t queued_work( ) const;
+
+  const scheduler_type scheduler;
+  const uint64_t starvation_limit_ns;
+  const std::chrono::milliseconds idle_timeout;
+  work_lane lanes[ number_work_priorities ];
+  deadline_lane deadlines;
   std::atomic< unsigned int > working_threads{ 0 };
   std::atomic< unsigned int > number_threads{ 0 };
   std::atomic< bool > shutting_down{ false };
+
+  // set by the pool before it starts the workers.
+  const cpu_topology* topology = nullptr;
+  pinning_type pinning         = pinning_type::none;
+  // the number of workers that have been started, used to place them.
+  std::atomic< unsigned int > started_threads{ 0 };
+
+  // used by the work_stealing scheduler.
+  std::atomic< unsigned int > sleeping_threads{ 0 };
+  std::atomic< unsigned int > searching_threads{ 0 };
+  const unsigned int victims_capacity;
+  std::atomic< unsigned int > victims_count{ 0 };
+  std::unique_ptr< std::atomic< worker_thread_internals* >[] > victims;
 };
 
 struct worker_thread_internals
 {
   worker_thread_internals( generic_work_data& dat );
 
+  ~worker_thread_internals( );
+
   std::atomic< bool > stopped;
-  moodycamel::ConsumerToken ctok;
-  moodycamel::ProducerToken ptok;
-  moodycamel::ConsumerToken ctok_prio;
-  moodycamel::ProducerToken ptok_prio;
+  // one for each lane.
+  std::vector< moodycamel::ProducerToken > lane_tokens;
+  // dequeues from the shared lanes, used to check for starving lanes now and
+  // then.
+  unsigned int shared_dequeues = 0;
   moodycamel::ConcurrentQueue< coroutine > thread_queue;
   std::atomic< unsigned int > thread_queue_size{ 0 };
+  // only used by the work_stealing scheduler. Other workers steal from it.
+  work_stealing_deque< cor_data* > local_work;
+  // only used by the work_stealing scheduler. The coroutine that the worker
+  // runs next: the last child it spawned, or a coroutine that last ran on it
+  // and that it has woken up. Thieves may take it.
+  std::atomic< cor_data* > lifo_slot{ nullptr };
+  // only used by the work_stealing scheduler. Coroutines that last ran on the
+  // worker and have been woken up by other threads, which can't push to
+  // local_work. Thieves may take them. On Linux a coroutine that ran is bound
+  // to its worker and goes to thread_queue instead, so it stays empty there.
+  moodycamel::ConcurrentQueue< cor_data* > affine_work;
+  // coroutines run in a row from lifo_slot.
+  unsigned int lifo_streak  = 0;
+  unsigned int victim_index = 0;
+  // the LLC group and the socket of the CPU the worker was placed on. Thieves
+  // look at the workers of their own group first, then at those of their
+  // socket.
+  unsigned int llc_group = 0;
+  unsigned int package   = 0;
+  // the CPUs the thread is pinned to, empty if it isn't.
+  std::vector< unsigned int > pinned_cpus;
+  // wakeups of this worker that did or didn't need a syscall.
+  std::atomic< uint64_t > wakeups_sent{ 0 };
+  std::atomic< uint64_t > wakeups_avoided{ 0 };
+  // only written by the worker, see worker_stats.
+  std::atomic< uint64_t > tasks_run{ 0 };
+  std::atomic< uint64_t > tasks_stolen{ 0 };
+  std::atomic< uint64_t > reschedules{ 0 };
+  std::atomic< uint64_t > busy_ns{ 0 };
+  std::atomic< uint64_t > parked_ns{ 0 };
+  std::atomic< uint64_t > wakeups_received{ 0 };
+  std::atomic< uint64_t > lifo_pushes{ 0 };
+  std::atomic< uint64_t > lifo_hits{ 0 };
+  std::atomic< uint64_t > affinity_hits{ 0 };
+  std::atomic< uint64_t > affinity_misses{ 0 };
   boost::thread thr;
 };
 
+/** \brief Adds n to a counter that is only written by the calling thread.
+ * Readers may see a stale value but it doesn't need a locked instruction.
+ */
+inline void
+bump_counter( std::atomic< uint64_t >& counter, uint64_t n = 1 )
+{
+  counter.store( counter.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+}
+
+/** \brief Returns the nanoseconds elapsed since start. */
+inline uint64_t
+elapsed_ns( std::chrono::steady_clock::time_point start )
+{
+  return std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now( ) - start )
+    .count( );
+}
+
 class base_worker_thread
 {
 protected:
@@ -50,6 +168,11 @@ protected:
   virtual generic_work_data& get_data( ) = 0;
 
   virtual worker_thread_internals& get_internals( ) = 0;
+
+  virtual bool stealable_work( ) = 0;
+
+  /** \brief Resumes the coroutines whose I/O is ready, without blocking. */
+  virtual void poll_io( ) = 0;
 };
 }
 }
@@ -73,9 +196,38 @@ protected:
 
   void start_thread( ) final override;
 
+  /** \brief Starts the thread again after it has exited because it was idle.
+   * The queues and counters of the worker are kept.
+   */
+  void restart_thread( );
+
   void schedule_coroutine( coroutine cor );
 
+  /** \brief Returns whether another worker has work that we could steal. */
+  bool stealable_work( ) final override;
+
 private:
+  /** \brief Dequeues from the shared lanes in priority order, unless a lane has
+   * been starving for longer than the limit.
+   */
+  bool pop_shared_work( coroutine& cor );
+
+  bool pop_lane( size_t lane, coroutine& cor );
+
+  bool pop_deadline( coroutine& cor );
+
+  /** \brief Takes a coroutine from affine_work or else from the deque. */
+  bool pop_local_work( coroutine& cor );
+
+  /** \brief Takes the coroutine in the LIFO slot unless the worker has run
+   * too many of them in a row.
+   */
+  bool pop_lifo( coroutine& cor );
+
+  bool steal_work( coroutine& cor );
+
+  void launch_thread( );
+
   boost::optional< worker_thread_internals > internals;
 };
 
@@ -91,8 +243,12 @@ public:
   ~worker_thread( );
 
   using generic_worker_thread::get_internals;
+  using generic_worker_thread::restart_thread;
   using generic_worker_thread::schedule_coroutine;
   using platform::worker_thread_impl::wakeup;
+#ifndef _WIN32
+  using platform::worker_thread_impl::wait_io;
+#endif
 };
 #ifdef _MSC_VER
 #pragma warning( pop )
@@ -103,7 +259,7 @@ class global_thread_pool
 public:
   using after_yield_f = std::function< void( coroutine ) >;
 
-  global_thread_pool( );
+  global_thread_pool( pool_options opts = pool_options::from_environment( ) );
 
   ~global_thread_pool( );
 
@@ -112,24 +268,161 @@ public:
   template < typename InputIt >
   void schedule( InputIt begin, InputIt end, bool first );
 
-  void yield( after_yield_f func );
+  /** \brief Switches to the master coroutine of the worker, which calls func
+   * with the running coroutine. reason is only used when tracing.
+   */
+  void yield( after_yield_f func, block_reason reason = block_reason::yield );
 
-  void yield_to( coroutine next, after_yield_f after_yield );
+  /** \brief Like yield() but next is run right after, by the same worker. */
+  void yield_to( coroutine next, after_yield_f after_yield, block_reason reason = block_reason::yield );
 
   void plat_wakeup_threads( );
 
+  /** \brief Wakes up one sleeping worker, whether there is work for it or not. */
+  void plat_wakeup_one( );
+
+  /** \brief Wakes up a worker so that it steals work if nobody is already
+   * looking for it.
+   */
+  void wakeup_thief( );
+
+  pool_stats stats( );
+
+  /** \brief Returns whether there is at least as much queued work as threads
+   * that can run it.
+   */
+  bool saturated( );
+
+  /** \brief Returns the number of threads that run work concurrently. */
+  unsigned int concurrency( ) const;
+
+  /** \brief Makes a worker run the callback of e once its deadline has
+   * passed. e must not be armed already.
+   */
+  void add_timer( timer_entry& e );
+
+  /** \brief Unlinks e if its callback hasn't been run. Otherwise it waits
+   * until the callback has returned. Returns whether e was unlinked.
+   */
+  bool cancel_timer( timer_entry& e );
+
+  /** \brief Runs the callbacks of the timers that have expired and arms the
+   * platform timer for the next ones. The workers call it when it fires.
+   */
+  void run_timers( );
+
+  /** \brief Called by a worker before it runs something that may block it.
+   * If fewer than the minimum number of workers are left running coroutines
+   * another one is started, up to the maximum.
+   */
+  void begin_blocking( );
+
+  /** \brief Called by a worker after it has returned from begin_blocking(). */
+  void end_blocking( );
+
+  /** \brief Called by a worker that has been idle for longer than the idle
+   * timeout. Returns whether it has to exit, which is only the case if there
+   * are more workers than the minimum and nothing has been scheduled to it.
+   */
+  bool retire_worker( worker_thread& thr );
+
+  /** \brief Queues job on the threads for blocking calls. See run_blocking(). */
+  void submit_blocking( inline_functor job );
+
 private:
+  /** \brief Starts a worker, reusing one that has retired if there is any.
+   * threads_mt must be held.
+   */
+  void add_worker( );
+
+  /** \brief Restarts thr if it has retired. */
+  void revive_worker( worker_thread& thr );
+
+  /** \brief Makes a worker call run_timers() once tick is reached, or never if
+   * it is timer_wheel::no_expiry.
+   */
+  void plat_arm_timer( uint64_t tick );
+
+  /** \brief Pushes cor to the deque of the calling worker if the pool uses the
+   * work_stealing scheduler and cor has normal priority and no deadline.
+   * Returns whether it did.
+   */
+  bool schedule_local( coroutine& cor );
+
+  /** \brief Puts cor in the LIFO slot of the calling worker if schedule_local
+   * would take it and it either has never run or last ran on this worker and
+   * is being resumed. The coroutine that was in the slot is moved to the
+   * deque. Returns whether it did.
+   */
+  bool schedule_lifo( coroutine& cor, bool first );
+
+  /** \brief Pushes cor to the affine_work queue of the worker it last ran on
+   * if that isn't the calling thread, the pool uses the work_stealing
+   * scheduler and cor has normal priority and no deadline. Returns whether it
+   * did.
+   */
+  bool schedule_affine( coroutine& cor );
+
+  /** \brief Adds cor to the deadline lane. */
+  void schedule_deadline( coroutine cor );
+
+  /** \brief Adds the coroutines in [begin, begin + count) to a lane. */
+  void enqueue_lane( size_t lane,
+                     std::move_iterator< std::vector< coroutine >::iterator > begin,
+                     size_t count );
+
   boost::mutex threads_mt;
   std::list< worker_thread > threads;
+  const cpu_topology topology;
+  // the number of CPUs the pool can use.
   const unsigned int hardware_concurrency;
+  const unsigned int min_workers;
+  const unsigned int max_workers;
   work_data_combined work_data;
+  // workers whose thread is running, and the most there have been. They are
+  // only changed while holding threads_mt, but begin_blocking() reads
+  // live_workers without it.
+  std::atomic< unsigned int > live_workers{ 0 };
+  unsigned int peak_workers = 0;
+  std::atomic< unsigned int > blocked_workers{ 0 };
+  std::atomic< unsigned int > peak_blocked_workers{ 0 };
+
+  boost::mutex timers_mt;
+  timer_wheel timers;
+  // the tick for which the platform timer is armed.
+  uint64_t timers_armed_tick = timer_wheel::no_expiry;
+
+  blocking_lane blocking;
 
   void yield( );
 
   void yield_to( coroutine next );
 };
 
-extern global_thread_pool global_thr_pool;
+/** \brief Starts the global pool on first use, with the options given to
+ * configure() or pool_options::from_environment().
+ */
+class global_pool_handle
+{
+public:
+  global_thread_pool* operator->( ) const
+  {
+    auto* pool = instance.load( std::memory_order_acquire );
+    return pool ? pool : start( );
+  }
+
+  /** \brief Sets the options of the pool, returns false if it has already
+   * been started.
+   */
+  bool configure( const pool_options& opts );
+
+private:
+  static global_thread_pool* start( );
+
+  static std::atomic< global_thread_pool* > instance;
+};
+
+extern global_pool_handle global_thr_pool;
 
 extern thread_local global_thread_pool::after_yield_f* after_yield;
 extern thread_local coroutine* master_coroutine;
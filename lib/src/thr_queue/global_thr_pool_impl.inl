@@ -1,11 +1,19 @@
 #pragma once
 
 #include <algorithm>
+#include <boost/core/ignore_unused.hpp>
 #include "global_thr_pool_impl.h"
 #include "cor_data.h"
 
 namespace game_engine {
 namespace thr_queue {
+// coroutines that were already running and are scheduled first go one class
+// up, so that they finish what they started before new work of their class.
+inline size_t lane_index(const cor_data &data, bool first) {
+  auto lane = size_t(data.priority);
+  return first && lane > 0 ? lane - 1 : lane;
+}
+
 template <typename InputIt>
 void global_thread_pool::schedule(InputIt begin, InputIt end, bool first) {
   static_assert(std::is_same<coroutine&&, decltype(*begin)>::value, "InputIt needs to move the coroutines");
@@ -15,46 +23,59 @@ void global_thread_pool::schedule(InputIt begin, InputIt end, bool first) {
   	return;
   }
 
-#ifndef _WIN32
+  const bool traced = tracing();
   std::vector<coroutine> tmp_buffer;
   tmp_buffer.reserve(count);
 
+  bool pushed_local = false;
+  bool pushed_deadline = false;
   for (auto it = begin; it != end; ++it) {
     auto cor = *it;
+    if (traced) {
+      record_trace_event(trace_event_type::schedule, cor.get_id(), block_reason::finished);
+    }
+#ifndef _WIN32
     if (cor.data_ptr->bound_thread) {
       auto *thr = cor.data_ptr->bound_thread;
       thr->schedule_coroutine(std::move(cor));
+      // the worker may have retired, see retire_worker().
+      if (thr->get_internals().stopped) {
+        revive_worker(*thr);
+      }
+      continue;
+    }
+#endif
+    if (cor.data_ptr->deadline != no_deadline) {
+      schedule_deadline(std::move(cor));
+      pushed_deadline = true;
+    } else if (first && schedule_affine(cor)) {
+      pushed_local = true;
+    } else if (count == 1 && schedule_lifo(cor, first)) {
+      pushed_local = true;
+    } else if (schedule_local(cor)) {
+      pushed_local = true;
     } else {
       tmp_buffer.emplace_back(std::move(cor));
     }
   }
 
-  auto tmp_begin = std::make_move_iterator(tmp_buffer.begin());
-  auto tmp_size = tmp_buffer.size();
-#else 
-  auto tmp_begin = begin;
-  auto tmp_size = count;
-#endif
+  if (pushed_local) {
+    wakeup_thief();
+  }
 
-  if (tmp_size == 0)
+  if (tmp_buffer.empty() && !pushed_deadline)
     return;
 
-  if (this_wthread) {
-    if (first) {
-      work_data.work_queue_prio_size += tmp_size;
-      work_data.work_queue_prio.enqueue_bulk(this_wthread->get_internals().ptok_prio, tmp_begin, tmp_size);
-    } else {
-      work_data.work_queue_size += tmp_size;
-      work_data.work_queue.enqueue_bulk(this_wthread->get_internals().ptok, tmp_begin, tmp_size);
-    }
-  } else {
-    if (first) {
-      work_data.work_queue_prio_size += tmp_size;
-      work_data.work_queue_prio.enqueue_bulk(tmp_begin, tmp_size);
-    } else {
-      work_data.work_queue_size += tmp_size;
-      work_data.work_queue.enqueue_bulk(tmp_begin, tmp_size);
+  // the coroutines usually share their options, so we enqueue runs of them
+  // that go to the same lane at once.
+  for (size_t i = 0; i < tmp_buffer.size();) {
+    auto lane = lane_index(*tmp_buffer[i].data_ptr, first);
+    auto j = i + 1;
+    while (j < tmp_buffer.size() && lane_index(*tmp_buffer[j].data_ptr, first) == lane) {
+      ++j;
     }
+    enqueue_lane(lane, std::make_move_iterator(tmp_buffer.begin() + i), j - i);
+    i = j;
   }
 
   plat_wakeup_threads();
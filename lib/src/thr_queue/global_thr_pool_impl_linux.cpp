@@ -1,59 +1,81 @@
-#define BOOST_SCOPE_EXIT_CONFIG_USE_LAMBDAS
-
 #include "global_thr_pool_impl.h"
-#include <boost/scope_exit.hpp>
+#include "cancellation_impl.h"
+#include "event/better_lock.h"
+#include "event/lock_unlocker.h"
+#include "stack_allocator.h"
 #include <logging/log.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#ifndef EPOLLEXCLUSIVE
+// the headers of glibc older than 2.24 don't define it.
+#define EPOLLEXCLUSIVE ( 1u << 28 )
+#endif
 
 namespace game_engine {
 namespace thr_queue {
 namespace platform {
-worker_thread_impl::worker_thread_impl( work_data& dat ) : data( dat )
-{
-}
-
-worker_thread_impl::~worker_thread_impl( )
-{
-}
-
-void
-worker_thread_impl::loop( )
+worker_thread_impl::worker_thread_impl( work_data& dat )
+  : data( dat )
+  , idle_slot( dat.idle_workers.add_worker( *this ) )
 {
-  static int set_usr2_sigaction = [] {
-    struct sigaction sigact;
-    sigact.sa_handler = []( int ) {};
-    sigact.sa_flags   = 0;
-    if ( sigemptyset( &sigact.sa_mask ) ) {
-      std::ostringstream ss;
-      ss << "sigemptyset failed: " << strerror( errno );
-      LOG( ) << ss.str( );
-      throw std::runtime_error( ss.str( ) );
-    }
-    if ( sigaction( SIGUSR2, &sigact, nullptr ) ) {
-      std::ostringstream ss;
-      ss << "sigaction failed: " << strerror( errno );
-      LOG( ) << ss.str( );
-      throw std::runtime_error( ss.str( ) );
-    }
-    return 0;
-  }( );
-  boost::ignore_unused( set_usr2_sigaction );
-  assert( set_usr2_sigaction == 0 );
-  sigset_t usr2_blocked_set, original_set;
-  if ( sigemptyset( &usr2_blocked_set ) || sigemptyset( &original_set ) ) {
+  park_eventfd = eventfd( 0, EFD_NONBLOCK );
+  if ( park_eventfd == -1 ) {
+    std::ostringstream ss;
+    ss << "Error creating park_eventfd: " << strerror( errno );
+    LOG( ) << ss.str( );
+    throw std::runtime_error( ss.str( ) );
+  }
+  park_epoll_fd = epoll_create1( 0 );
+  if ( park_epoll_fd == -1 ) {
     std::ostringstream ss;
-    ss << "sigemptyset failed: " << strerror( errno );
+    ss << "Error creating worker epoll fd: " << strerror( errno );
     LOG( ) << ss.str( );
+    close( park_eventfd );
     throw std::runtime_error( ss.str( ) );
   }
-  if ( sigaddset( &usr2_blocked_set, SIGUSR2 ) ) {
+
+  // every write to an edge triggered eventfd is reported once, so waking up
+  // only costs the write.
+  epoll_event add_park_epoll;
+  add_park_epoll.events   = EPOLLIN | EPOLLET;
+  add_park_epoll.data.ptr = &park_eventfd;
+  // EPOLLEXCLUSIVE makes the kernel wake up only one of the workers blocked on
+  // timer_fd instead of all of them. Kernels older than 4.5 reject it with
+  // EINVAL, there every worker wakes up and all but one find no timer to run.
+  epoll_event add_timer_epoll;
+  add_timer_epoll.events   = EPOLLIN | EPOLLEXCLUSIVE;
+  add_timer_epoll.data.ptr = &data.timer_fd;
+  auto add_timer_fd        = [&]( ) {
+    if ( epoll_ctl( park_epoll_fd, EPOLL_CTL_ADD, data.timer_fd, &add_timer_epoll ) == 0 ) {
+      return true;
+    }
+    if ( errno != EINVAL ) {
+      return false;
+    }
+    add_timer_epoll.events = EPOLLIN;
+    return epoll_ctl( park_epoll_fd, EPOLL_CTL_ADD, data.timer_fd, &add_timer_epoll ) == 0;
+  };
+  if ( epoll_ctl( park_epoll_fd, EPOLL_CTL_ADD, park_eventfd, &add_park_epoll ) == -1 || !add_timer_fd( ) ) {
     std::ostringstream ss;
-    ss << "sigaddset failed: " << strerror( errno );
+    ss << "Error adding park_eventfd and timer_fd to worker epoll: " << strerror( errno );
     LOG( ) << ss.str( );
+    close( park_epoll_fd );
+    close( park_eventfd );
     throw std::runtime_error( ss.str( ) );
   }
-  pthread_sigmask( SIG_BLOCK, &usr2_blocked_set, &original_set );
+}
+
+worker_thread_impl::~worker_thread_impl( )
+{
+  data.idle_workers.remove_worker( idle_slot );
+  close( park_epoll_fd );
+  close( park_eventfd );
+}
 
+void
+worker_thread_impl::loop( )
+{
   ++data.number_threads;
   try {
     this_wthread = (thr_queue::worker_thread*) ( this );
@@ -63,73 +85,86 @@ worker_thread_impl::loop( )
     after_yield      = &after_yield_f;
 
     epoll_event epoll_entry;
+    // workers that have been idle for long enough may retire.
+    auto last_wakeup = std::chrono::steady_clock::now( );
+    const auto poll_ms = std::max( 1, std::min( 1000, int( data.idle_timeout.count( ) ) ) );
+
+    // work that a waker might have missed because we weren't parked yet.
+    auto has_work = [&] {
+      return get_internals( ).thread_queue_size > 0 || data.queued_work( ) > data.working_threads ||
+             ( data.scheduler == scheduler_type::work_stealing && stealable_work( ) );
+    };
 
     auto wait_cond = [&] {
       memset( &epoll_entry, 0, sizeof( epoll_entry ) );
-      data.semaphore.acquire( );
-      int epoll_ret;
-      while ( true ) {
-        if ( get_internals( ).thread_queue_size > 0 ) {
-          epoll_entry.data.ptr = &data.wakeup_any_eventfd;
+      epoll_entry.data.ptr = &park_eventfd;
+      if ( get_internals( ).thread_queue_size > 0 ) {
+        return true;
+      }
+
+      // the schedulers publish their coroutines before they look for a parked
+      // worker, so either one of them sees us parked and unparks us or we see
+      // their coroutine in has_work().
+      ++data.sleeping_threads;
+      parked = true;
+      if ( !idle_listed.exchange( true ) ) {
+        data.idle_workers.push( idle_slot );
+      }
+      if ( has_work( ) ) {
+        // if somebody unparked us already its write is reported by the next
+        // epoll_wait, which is harmless.
+        parked = false;
+        --data.sleeping_threads;
+        return true;
+      }
+      reclaim_cached_stacks( );
+      auto wait_time  = data.shutting_down ? 0 : poll_ms;
+      auto park_start = std::chrono::steady_clock::now( );
+      int epoll_ret   = epoll_wait( park_epoll_fd, &epoll_entry, 1, wait_time );
+      parked          = false;
+      --data.sleeping_threads;
+      bump_counter( get_internals( ).parked_ns, elapsed_ns( park_start ) );
+      if ( epoll_ret > 0 ) {
+        bump_counter( get_internals( ).wakeups_received );
+        last_wakeup = std::chrono::steady_clock::now( );
+      }
+
+      if ( epoll_ret == 0 ) {
+        if ( wait_time == 0 ) {
+          return false;
+        } else if ( std::chrono::steady_clock::now( ) - last_wakeup >= data.idle_timeout && io_waiters == 0 &&
+                    global_thr_pool->retire_worker( *this_wthread ) ) {
+          LOG( ) << "Worker thread retiring after being idle.";
+          return false;
+        } else {
+          epoll_entry.data.ptr = &park_eventfd;
           return true;
         }
-        auto wait_time = data.shutting_down ? 0 : 1000;
-        epoll_ret      = epoll_pwait( data.epoll_fd, &epoll_entry, 1, wait_time, &original_set );
-        if ( epoll_ret == 0 ) {
-          if ( wait_time == 0 ) {
-            return false;
-          } else {
-            epoll_entry.data.ptr = &data.wakeup_any_eventfd;
-            return true;
-          }
-        } else if ( epoll_ret == 1 ) { // success
-          break;
-        } else if ( errno == EINTR ) {
-          epoll_entry.data.ptr = &data.wakeup_any_eventfd;
-          LOG( ) << "recv USR2 " << boost::this_thread::get_id( );
+      } else if ( epoll_ret == -1 ) {
+        if ( errno == EINTR ) {
+          epoll_entry.data.ptr = &park_eventfd;
           return true;
-        } else {
-          std::ostringstream ss;
-          ss << "Error epolling: " << strerror( errno );
-          LOG( ) << ss.str( );
-          return false;
         }
+        std::ostringstream ss;
+        ss << "Error epolling: " << strerror( errno );
+        LOG( ) << ss.str( );
+        return false;
       }
 
-      if ( epoll_entry.data.ptr == &data.wakeup_any_eventfd ) {
-        eventfd_t val;
-        int efd_read_ret = eventfd_read( data.wakeup_any_eventfd, &val );
-        LOG( ) << boost::this_thread::get_id( ) << ' ' << val;
-
-        BOOST_SCOPE_EXIT( this )
-        {
-          epoll_event readd_wakeup_epoll;
-          readd_wakeup_epoll.events   = EPOLLIN | EPOLLONESHOT;
-          readd_wakeup_epoll.data.ptr = &data.wakeup_any_eventfd;
-          int epoll_ctl_ret =
-            epoll_ctl( data.epoll_fd, EPOLL_CTL_MOD, data.wakeup_any_eventfd, &readd_wakeup_epoll );
-          if ( epoll_ctl_ret == -1 ) {
-            std::ostringstream ss;
-            ss << "Error readding wakeup_any_eventfd to global epoll: " << strerror( errno );
-            LOG( ) << ss.str( );
-            throw std::runtime_error( ss.str( ) );
-          }
-        };
-
-        if ( efd_read_ret != 0 ) {
-          std::ostringstream ss;
-          ss << "Error when decreasing the wakeup_any_eventfd counter: " << strerror( errno );
-          LOG( ) << ss.str( );
-          throw std::runtime_error( ss.str( ) );
-        }
+      if ( epoll_entry.data.ptr == &data.timer_fd ) {
+        read_timer_fd( );
       }
 
       return true;
     };
 
     while ( wait_cond( ) ) {
-      if ( epoll_entry.data.ptr != &data.wakeup_any_eventfd ) {
+      if ( epoll_entry.data.ptr == &data.timer_fd ) {
+        global_thr_pool->run_timers( );
+        do_work( );
+      } else if ( epoll_entry.data.ptr != &park_eventfd ) {
         handle_io_operation( epoll_entry );
+        do_work( );
       } else {
         do_work( );
       }
@@ -137,161 +172,331 @@ worker_thread_impl::loop( )
   } catch ( std::exception& e ) {
     LOG( ) << "caught when worker thread was stopping: " << e.what( );
   }
-  data.semaphore.release( );
   --data.number_threads;
   get_internals( ).stopped = true;
 }
 
-void worker_thread_impl::handle_io_operation( epoll_event )
+void
+worker_thread_impl::read_timer_fd( )
 {
-  abort( );
+  uint64_t expirations;
+  // another worker may have read it first.
+  if ( read( data.timer_fd, &expirations, sizeof( expirations ) ) == -1 && errno != EAGAIN ) {
+    std::ostringstream ss;
+    ss << "Error when reading timer_fd: " << strerror( errno );
+    LOG( ) << ss.str( );
+    throw std::runtime_error( ss.str( ) );
+  }
 }
 
 void
-worker_thread_impl::wakeup( )
+worker_thread_impl::poll_io( )
 {
-  if ( int error = pthread_kill( get_internals( ).thr.native_handle( ), SIGUSR2 ) ) {
-    LOG( ) << "pthread_kill failed: " << strerror( error );
+  epoll_event events[ 16 ];
+  int epoll_ret = epoll_wait( park_epoll_fd, events, 16, 0 );
+  for ( int i = 0; i < epoll_ret; ++i ) {
+    if ( events[ i ].data.ptr == &data.timer_fd ) {
+      read_timer_fd( );
+      global_thr_pool->run_timers( );
+    } else if ( events[ i ].data.ptr != &park_eventfd ) {
+      handle_io_operation( events[ i ] );
+    }
   }
-  LOG( ) << "USR2 " << get_internals( ).thr.get_id( );
 }
 
-generic_work_data&
-worker_thread_impl::get_data( )
+void
+worker_thread_impl::handle_io_operation( epoll_event epoll_ev )
 {
-  return data;
+  // errors and hang ups wake up both directions, the operation that is retried
+  // reports them.
+  const uint32_t ready_events[ 2 ] = { EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR,
+                                       EPOLLOUT | EPOLLHUP | EPOLLERR };
+  auto& state = *static_cast< detail::io_state* >( epoll_ev.data.ptr );
+  boost::optional< coroutine > woken[ 2 ];
+  {
+    boost::lock_guard< boost::mutex > lock( state.mt );
+    for ( int i = 0; i < 2; ++i ) {
+      auto& dir = state.directions[ i ];
+      if ( dir.worker != this || !( epoll_ev.events & ready_events[ i ] ) ) {
+        continue;
+      }
+      if ( dir.waiter ) {
+        woken[ i ] = std::move( dir.waiter );
+        dir.waiter = boost::none;
+      } else {
+        dir.ready = true;
+      }
+    }
+  }
+
+  for ( auto& cor : woken ) {
+    if ( !cor ) {
+      continue;
+    }
+    // the coroutine was parked by this worker, so we can usually skip the
+    // queues.
+    if ( !run_next && cor->can_be_run_by_thread( this_wthread ) ) {
+      if ( tracing( ) ) {
+        record_trace_event( trace_event_type::schedule, cor->get_id( ), block_reason::finished );
+      }
+      run_next = std::move( *cor );
+    } else {
+      global_thr_pool->schedule( std::move( *cor ), true );
+    }
+  }
 }
 
-work_data::work_data( unsigned int concurrency ) : concurrency_max( concurrency ), semaphore( concurrency )
+void
+worker_thread_impl::set_io_events( detail::io_state& state, uint32_t old_events, uint32_t new_events )
 {
-  epoll_fd = epoll_create( 1 );
-  if ( epoll_fd == -1 ) {
-    std::ostringstream ss;
-    ss << "Error creating global epoll fd: " << strerror( errno );
-    LOG( ) << ss.str( );
-    throw std::runtime_error( ss.str( ) );
-  }
-  wakeup_any_eventfd = eventfd( 0, 0 );
-  if ( wakeup_any_eventfd == -1 ) {
-    std::ostringstream ss;
-    ss << "Error creating wakeup_any_eventfd: " << strerror( errno );
-    LOG( ) << ss.str( );
-    throw std::runtime_error( ss.str( ) );
+  if ( old_events == new_events ) {
+    return;
   }
-  epoll_event add_wakeup_epoll;
-  add_wakeup_epoll.events   = EPOLLIN | EPOLLONESHOT;
-  add_wakeup_epoll.data.ptr = &wakeup_any_eventfd;
-  int epoll_ctl_ret         = epoll_ctl( epoll_fd, EPOLL_CTL_ADD, wakeup_any_eventfd, &add_wakeup_epoll );
-  if ( epoll_ctl_ret == -1 ) {
+  int op = old_events == 0 ? EPOLL_CTL_ADD : new_events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+  epoll_event ev;
+  ev.events   = new_events | EPOLLET;
+  ev.data.ptr = &state;
+  if ( epoll_ctl( park_epoll_fd, op, state.fd, &ev ) == -1 ) {
     std::ostringstream ss;
-    ss << "Error adding wakeup_any_eventfd to global epoll: " << strerror( errno );
+    ss << "Error registering fd " << state.fd << " in worker epoll: " << strerror( errno );
     LOG( ) << ss.str( );
     throw std::runtime_error( ss.str( ) );
   }
 }
 
-work_data::~work_data( )
+bool
+worker_thread_impl::wait_io( detail::io_state& state, int direction, const std::atomic< bool >& closed )
 {
-  int close_ret;
-  while ( true ) {
-    close_ret = close( epoll_fd );
-    if ( close_ret == 0 ) {
-      break;
-    } else if ( errno == EINTR ) {
-      continue;
-    } else {
-      std::ostringstream ss;
-      ss << "Error closing global epoll: " << strerror( errno );
-      LOG( ) << ss.str( );
-      break;
+  auto* cancellation = detail::cancellation_state::of_running( );
+  if ( cancellation && cancellation->cancelled ) {
+    throw operation_cancelled( );
+  }
+
+  event::better_lock lock( state.mt );
+  if ( closed ) {
+    return false;
+  }
+  auto& wanted = state.directions[ direction ];
+  if ( wanted.ready ) {
+    wanted.ready = false;
+    return true;
+  }
+  if ( wanted.waiter ) {
+    throw std::logic_error( "a coroutine is already waiting for this direction of the fd" );
+  }
+  if ( wanted.worker != this ) {
+    // the fd stays registered where it is for the other direction, epoll sets
+    // can share fds.
+    auto* previous       = wanted.worker;
+    auto previous_events = state.events_for( previous );
+    auto own_events      = state.events_for( this );
+    wanted.worker        = this;
+    if ( previous ) {
+      previous->set_io_events( state, previous_events, state.events_for( previous ) );
     }
+    // if the fd is already ready epoll reports it right away.
+    set_io_events( state, own_events, state.events_for( this ) );
+  }
+
+  bool gave_up = false;
+  detail::cancellation_callback on_cancel;
+  ++io_waiters;
+  global_thr_pool->yield(
+    [&]( coroutine running ) {
+      event::lock_unlocker< event::better_lock > l_unlock( lock );
+      auto id       = running.get_id( );
+      wanted.waiter = std::move( running );
+      if ( cancellation ) {
+        on_cancel.arm( *cancellation, [&state, &wanted, &gave_up, id] {
+          boost::unique_lock< boost::mutex > mt_lock( state.mt );
+          if ( !wanted.waiter || wanted.waiter->get_id( ) != id ) {
+            // the fd got ready first.
+            return;
+          }
+          auto cor      = std::move( *wanted.waiter );
+          wanted.waiter = boost::none;
+          mt_lock.unlock( );
+          gave_up = true;
+          global_thr_pool->schedule( std::move( cor ), true );
+        } );
+      }
+    },
+    block_reason::aio );
+  --io_waiters;
+
+  // the callback may still be running if the fd got ready first.
+  on_cancel.disarm( );
+  if ( gave_up ) {
+    throw operation_cancelled( );
   }
+  return !closed;
 }
 
-epoll_access_semaphore::epoll_access_semaphore( unsigned int state ) : initial_state( state )
+void
+worker_thread_impl::wakeup( )
 {
-  int sem_init_ret = sem_init( &sem, 0, state );
-  if ( sem_init_ret != 0 ) {
+  // a running worker will find the coroutine before it parks again, so we only
+  // need a syscall if it is blocked in epoll_wait.
+  if ( !unpark( ) ) {
+    get_internals( ).wakeups_avoided.fetch_add( 1, std::memory_order_relaxed );
+  }
+}
+
+bool
+worker_thread_impl::unpark( )
+{
+  if ( !parked || !parked.exchange( false ) ) {
+    return false;
+  }
+  get_internals( ).wakeups_sent.fetch_add( 1, std::memory_order_relaxed );
+  if ( eventfd_write( park_eventfd, 1 ) != 0 ) {
+    LOG( ) << "Error when writing to park_eventfd: " << strerror( errno );
+  }
+  return true;
+}
+
+generic_work_data&
+worker_thread_impl::get_data( )
+{
+  return data;
+}
+
+work_data::work_data( unsigned int concurrency, const pool_options& opts, unsigned int max_threads )
+  : generic_work_data( opts, max_threads )
+  , concurrency_max( concurrency )
+  , idle_workers( max_threads )
+{
+  timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+  if ( timer_fd == -1 ) {
     std::ostringstream ss;
-    ss << "Error constructing semaphore: " << strerror( errno );
+    ss << "Error creating timer_fd: " << strerror( errno );
     LOG( ) << ss.str( );
     throw std::runtime_error( ss.str( ) );
   }
 }
 
-epoll_access_semaphore::~epoll_access_semaphore( )
+work_data::~work_data( )
+{
+  close( timer_fd );
+}
+
+}
+
+namespace detail {
+uint32_t
+io_state::events_for( const platform::worker_thread_impl* worker ) const
+{
+  uint32_t ret = 0;
+  if ( worker && directions[ read ].worker == worker ) {
+    ret |= EPOLLIN | EPOLLRDHUP;
+  }
+  if ( worker && directions[ write ].worker == worker ) {
+    ret |= EPOLLOUT;
+  }
+  return ret;
+}
+}
+
+namespace platform {
+idle_worker_stack::idle_worker_stack( unsigned int capacity )
+  : capacity( capacity )
+  , workers( new std::atomic< worker_thread_impl* >[ capacity ] )
+  , next( new std::atomic< uint32_t >[ capacity ] )
 {
-  int sem_val;
-  sem_getvalue( &sem, &sem_val );
-  if ( (unsigned int) sem_val != initial_state ) {
-    LOG( ) << "Warning: destructing semaphore with state that differs from "
-              "initial one: "
-           << "current = " << sem_val << ", initial = " << initial_state;
+  for ( unsigned int i = 0; i < capacity; ++i ) {
+    workers[ i ] = nullptr;
+    next[ i ]    = 0;
   }
-  int sem_destroy_ret = sem_destroy( &sem );
-  boost::ignore_unused( sem_destroy_ret );
-  assert( sem_destroy_ret == 0 );
-  // sem_destroy only fails if sem is not a semaphore.
+}
+
+unsigned int
+idle_worker_stack::add_worker( worker_thread_impl& worker )
+{
+  auto slot = count++;
+  assert( slot < capacity );
+  workers[ slot ].store( &worker, std::memory_order_release );
+  return slot + 1;
 }
 
 void
-epoll_access_semaphore::acquire( )
+idle_worker_stack::remove_worker( unsigned int slot )
 {
-  boost::unique_lock< boost::mutex > lock( mt );
-  if ( acquiring_threads.count( boost::this_thread::get_id( ) ) == 0 ) {
-    lock.unlock( );
-    while ( true ) {
-      int sem_wait_ret = sem_wait( &sem );
-      if ( sem_wait_ret == 0 ) { // success
-        break;
-      } else if ( errno == EINTR ) {
-        continue;
-      } else {
-        std::ostringstream ss;
-        ss << "Error waiting on semaphore: " << strerror( errno );
-        LOG( ) << ss.str( );
-        throw std::runtime_error( ss.str( ) );
+  // the slot may still be in the stack, pop() skips it.
+  workers[ slot - 1 ].store( nullptr, std::memory_order_release );
+}
+
+void
+idle_worker_stack::push( unsigned int slot )
+{
+  auto old_head = head.load( std::memory_order_relaxed );
+  uint64_t new_head;
+  do {
+    next[ slot - 1 ].store( uint32_t( old_head & slot_mask ), std::memory_order_relaxed );
+    new_head = ( ( old_head >> 32 ) + 1 ) << 32 | slot;
+  } while ( !head.compare_exchange_weak( old_head, new_head, std::memory_order_seq_cst ) );
+}
+
+worker_thread_impl*
+idle_worker_stack::pop( )
+{
+  auto old_head = head.load( std::memory_order_seq_cst );
+  while ( true ) {
+    auto slot = unsigned( old_head & slot_mask );
+    if ( slot == 0 ) {
+      return nullptr;
+    }
+    // if the slot is popped and pushed again meanwhile the tag has changed, so
+    // a stale next is never installed.
+    auto new_head = ( ( old_head >> 32 ) + 1 ) << 32 | next[ slot - 1 ].load( std::memory_order_relaxed );
+    if ( head.compare_exchange_weak( old_head, new_head, std::memory_order_seq_cst ) ) {
+      if ( auto* worker = workers[ slot - 1 ].load( std::memory_order_acquire ) ) {
+        return worker;
       }
+      old_head = head.load( std::memory_order_seq_cst );
     }
-    lock.lock( );
-    auto emplace_res = acquiring_threads.emplace( boost::this_thread::get_id( ) );
-    boost::ignore_unused( emplace_res );
-    assert( emplace_res.second );
-  } else {
-    return;
   }
 }
+}
 
 void
-epoll_access_semaphore::release( )
+global_thread_pool::plat_wakeup_threads( )
 {
-  boost::unique_lock< boost::mutex > lock( mt );
-  if ( acquiring_threads.count( boost::this_thread::get_id( ) ) == 1 ) {
-    int sem_post_ret = sem_post( &sem );
-    boost::ignore_unused( sem_post_ret );
-    assert( sem_post_ret == 0 );
-    auto erase_ret = acquiring_threads.erase( boost::this_thread::get_id( ) );
-    boost::ignore_unused( erase_ret );
-    assert( erase_ret == 1 );
-  } else {
-    LOG( ) << "Warning: a thread that has not acquired the semaphore has tried "
-              "to release it";
+  auto ammount_work = work_data.queued_work( );
+  if ( work_data.working_threads < ammount_work ) {
+    plat_wakeup_one( );
   }
 }
+
+void
+global_thread_pool::plat_arm_timer( uint64_t tick )
+{
+  // a zeroed it_value disarms the timer.
+  itimerspec spec;
+  memset( &spec, 0, sizeof( spec ) );
+  if ( tick != timer_wheel::no_expiry ) {
+    // steady_clock is CLOCK_MONOTONIC, so we can use absolute times.
+    auto since_epoch      = timers.to_time_point( tick ).time_since_epoch( );
+    auto secs             = std::chrono::duration_cast< std::chrono::seconds >( since_epoch );
+    spec.it_value.tv_sec  = secs.count( );
+    spec.it_value.tv_nsec = std::chrono::duration_cast< std::chrono::nanoseconds >( since_epoch - secs ).count( );
+  }
+  if ( timerfd_settime( work_data.timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr ) == -1 ) {
+    std::ostringstream ss;
+    ss << "Error when arming timer_fd: " << strerror( errno );
+    LOG( ) << ss.str( );
+    throw std::runtime_error( ss.str( ) );
+  }
 }
 
 void
-global_thread_pool::plat_wakeup_threads( )
+global_thread_pool::plat_wakeup_one( )
 {
-  auto ammount_work = work_data.work_queue_size + work_data.work_queue_prio_size;
-  if ( work_data.working_threads < ammount_work ) {
-    int write_ret = eventfd_write( work_data.wakeup_any_eventfd, 1 );
-    LOG( ) << "Wrote to eventfd";
-    if ( write_ret != 0 ) {
-      std::ostringstream ss;
-      ss << "Error when writing to eventfd to wakeup a thread: " << strerror( errno );
-      LOG( ) << ss.str( );
-      throw std::runtime_error( ss.str( ) );
+  // entries are stale if their worker found work before parking, we skip them
+  // until we find one that is parked.
+  while ( auto* worker = work_data.idle_workers.pop( ) ) {
+    worker->idle_listed = false;
+    if ( worker->unpark( ) ) {
+      return;
     }
   }
 }
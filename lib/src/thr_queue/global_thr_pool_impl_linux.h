@@ -1,41 +1,100 @@
 #pragma once
 
 #include <atomic>
-#include <semaphore.h>
-#include <set>
+#include <boost/optional.hpp>
+#include <memory>
 #include <sys/epoll.h>
+#include <thr_queue/coroutine.h>
 #include <thr_queue/thread_api.h>
 
 namespace game_engine {
 namespace thr_queue {
+class global_thread_pool;
+
+namespace platform {
+class worker_thread_impl;
+}
+
+namespace detail {
+/** \brief What an io_handle points to. The states are reused but never freed,
+ * so an event that is reported after its handle has been destroyed can only
+ * wake up the coroutines of a later handle spuriously.
+ */
+struct io_state
+{
+  enum
+  {
+    read,
+    write
+  };
+
+  struct direction
+  {
+    // the worker whose park_epoll_fd has fd registered for this direction.
+    platform::worker_thread_impl* worker = nullptr;
+    // an edge that no coroutine was waiting for.
+    bool ready = false;
+    boost::optional< coroutine > waiter;
+  };
+
+  /** \brief Returns the events that fd is registered for in the epoll set of
+   * worker.
+   */
+  uint32_t events_for( const platform::worker_thread_impl* worker ) const;
+
+  // protects the directions.
+  boost::mutex mt;
+  int fd = -1;
+  direction directions[ 2 ];
+};
+}
+
 namespace platform {
-class epoll_access_semaphore
+
+/** \brief A lock free stack of the workers that are about to park or are
+ * parked. Waking up a worker pops it, so no worker is woken up twice and no
+ * syscall is made when none is idle.
+ * Workers are referred to by their slot, the head is tagged with a counter
+ * to avoid the ABA problem.
+ */
+class idle_worker_stack
 {
 public:
-  epoll_access_semaphore( unsigned int state );
-  ~epoll_access_semaphore( );
+  idle_worker_stack( unsigned int capacity );
+
+  /** \brief Returns the slot of a new worker, they start at one. */
+  unsigned int add_worker( worker_thread_impl& worker );
 
-  void acquire( );
+  /** \brief Clears the slot of a worker that is being destroyed. */
+  void remove_worker( unsigned int slot );
 
-  void release( );
+  void push( unsigned int slot );
+
+  /** \brief Returns the worker that was pushed last, or nullptr if there is
+   * none. The worker may have been destroyed, in which case it keeps popping.
+   */
+  worker_thread_impl* pop( );
 
 private:
-  using thread_id_type = decltype( boost::this_thread::get_id( ) );
-  sem_t sem;
-  std::set< thread_id_type > acquiring_threads;
-  boost::mutex mt;
-  const unsigned int initial_state;
+  static const uint64_t slot_mask = 0xffffffff;
+
+  const unsigned int capacity;
+  std::atomic< unsigned int > count{ 0 };
+  // slots are one based, zero means the end of the stack.
+  std::atomic< uint64_t > head{ 0 };
+  std::unique_ptr< std::atomic< worker_thread_impl* >[] > workers;
+  std::unique_ptr< std::atomic< uint32_t >[] > next;
 };
 
 struct work_data : generic_work_data
 {
-  work_data( unsigned int concurrency );
+  work_data( unsigned int concurrency, const pool_options& opts, unsigned int max_threads );
   ~work_data( );
 
-  int epoll_fd;
-  int wakeup_any_eventfd;
+  // every worker waits on it, it is armed for the next timer to expire.
+  int timer_fd;
   const unsigned int concurrency_max;
-  epoll_access_semaphore semaphore;
+  idle_worker_stack idle_workers;
 };
 
 class worker_thread_impl : public virtual base_worker_thread
@@ -44,14 +103,62 @@ public:
   worker_thread_impl( work_data& dat );
   ~worker_thread_impl( );
 
+  /** \brief Changes the events that the epoll set of the worker reports for
+   * the fd of state from old_events to new_events, either of which may be
+   * zero.
+   */
+  void set_io_events( detail::io_state& state, uint32_t old_events, uint32_t new_events );
+
+  /** \brief Registers the fd of state for direction in the epoll set of this
+   * worker, which has to be the one running the calling coroutine, and parks
+   * the coroutine until the worker sees it become ready. Returns false once
+   * closed is set, which io_handle::close() does while holding the lock of
+   * state.
+   */
+  bool wait_io( detail::io_state& state, int direction, const std::atomic< bool >& closed );
+
 protected:
   void loop( ) override;
+  /** \brief Resumes the coroutines waiting for the fd of an io_state that
+   * epoll_ev reports as ready. The first one that this worker can run is run
+   * next.
+   */
   void handle_io_operation( epoll_event epoll_ev );
+  /** \brief Handles the events of the epoll set of the worker without
+   * blocking. A busy worker doesn't reach epoll_wait() in loop(), so do_work()
+   * calls it now and then.
+   */
+  void poll_io( ) override;
   void wakeup( ) override;
   generic_work_data& get_data( ) override;
 
 private:
+  friend class thr_queue::global_thread_pool;
+
+  /** \brief Writes to park_eventfd if the worker is parked. Returns whether
+   * it was.
+   */
+  bool unpark( );
+
+  /** \brief Consumes the expirations of timer_fd. */
+  void read_timer_fd( );
+
   work_data& data;
+  // true while the worker is blocked, or about to block, in epoll_wait. The
+  // thread that sets it back to false is the one that writes to park_eventfd.
+  std::atomic< bool > parked{ false };
+  // whether the worker is in data.idle_workers. Only the thread that pops it
+  // sets it back to false.
+  std::atomic< bool > idle_listed{ false };
+  const unsigned int idle_slot;
+  // coroutines parked in wait_io(). The worker can't retire while there are
+  // any, since only it is told when their fds are ready. They may be resumed
+  // by other workers.
+  std::atomic< unsigned int > io_waiters{ 0 };
+  // edge triggered, so it never has to be read.
+  int park_eventfd;
+  // contains park_eventfd and the timer_fd shared by all workers.
+  int park_epoll_fd;
 };
 }
 }
@@ -1,5 +1,7 @@
 #define BOOST_SCOPE_EXIT_CONFIG_USE_LAMBDAS
 #include "global_thr_pool_impl.h"
+#include "stack_allocator.h"
+#include <algorithm>
 #include <boost/scope_exit.hpp>
 #include <logging/log.h>
 
@@ -8,12 +10,35 @@ namespace thr_queue {
 void
 global_thread_pool::plat_wakeup_threads( )
 {
-  auto ammount_work = work_data.work_queue_size + work_data.work_queue_prio_size;
+  auto ammount_work = work_data.queued_work( );
   if ( work_data.working_threads < ammount_work ) {
-    PostQueuedCompletionStatus( work_data.iocp, 0, work_data.queue_completionkey, nullptr );
+    plat_wakeup_one( );
   }
 }
 
+void
+global_thread_pool::plat_wakeup_one( )
+{
+  PostQueuedCompletionStatus( work_data.iocp, 0, work_data.queue_completionkey, nullptr );
+}
+
+void
+global_thread_pool::plat_arm_timer( uint64_t tick )
+{
+  if ( tick == timer_wheel::no_expiry ) {
+    SetThreadpoolTimer( work_data.timer, nullptr, 0, 0 );
+    return;
+  }
+  // negative due times are relative, in units of 100 ns.
+  auto wait = std::chrono::duration_cast< std::chrono::nanoseconds >( timers.to_time_point( tick ) -
+                                                                      timer_wheel::clock::now( ) );
+  LONGLONG due = -std::max< LONGLONG >( 1, wait.count( ) / 100 );
+  FILETIME due_time;
+  due_time.dwLowDateTime  = DWORD( due & 0xFFFFFFFF );
+  due_time.dwHighDateTime = DWORD( due >> 32 );
+  SetThreadpoolTimer( work_data.timer, &due_time, 0, 0 );
+}
+
 namespace platform {
 worker_thread_impl::worker_thread_impl( work_data& dat ) : data( dat )
 {
@@ -31,17 +56,41 @@ worker_thread_impl::loop( )
     after_yield      = &after_yield_f;
 
     OVERLAPPED_ENTRY olapped_entry;
+    // workers that have been idle for long enough may retire.
+    auto last_wakeup   = std::chrono::steady_clock::now( );
+    const auto idle_ms = int( data.idle_timeout.count( ) );
+    const auto poll_ms = DWORD( std::max< int >( 1, std::min< int >( 1000, idle_ms ) ) );
 
     auto wait_cond = [&] {
       while ( true ) {
-        auto wait_time = data.shutting_down ? 0 : INFINITE;
+        auto wait_time = data.shutting_down ? 0 : poll_ms;
         ULONG removed_entries;
+        ++data.sleeping_threads;
+        if ( data.scheduler == scheduler_type::work_stealing && stealable_work( ) ) {
+          --data.sleeping_threads;
+          olapped_entry.lpCompletionKey = data.queue_completionkey;
+          break;
+        }
+        reclaim_cached_stacks( );
+        auto park_start = std::chrono::steady_clock::now( );
         auto wait_iocp =
           GetQueuedCompletionStatusEx( data.iocp, &olapped_entry, 1, &removed_entries, wait_time, true );
+        --data.sleeping_threads;
+        bump_counter( get_internals( ).parked_ns, elapsed_ns( park_start ) );
+        if ( wait_iocp ) {
+          bump_counter( get_internals( ).wakeups_received );
+          last_wakeup = std::chrono::steady_clock::now( );
+        }
         if ( !wait_iocp ) {
           auto err = GetLastError( );
           if ( err == WAIT_IO_COMPLETION ) {
             continue;
+          } else if ( err == WAIT_TIMEOUT && wait_time != 0 ) {
+            if ( std::chrono::steady_clock::now( ) - last_wakeup >= data.idle_timeout &&
+                 global_thr_pool->retire_worker( *this_wthread ) ) {
+              return false;
+            }
+            continue;
           } else {
             if ( err != WAIT_TIMEOUT ) {
               LOG( ) << "GetQueuedCompletionStatus: " << err;
@@ -56,7 +105,10 @@ worker_thread_impl::loop( )
     };
 
     do {
-      if ( olapped_entry.lpCompletionKey != data.queue_completionkey ) {
+      if ( olapped_entry.lpCompletionKey == data.timer_completionkey ) {
+        global_thr_pool->run_timers( );
+        do_work( );
+      } else if ( olapped_entry.lpCompletionKey != data.queue_completionkey ) {
         handle_io_operation( olapped_entry );
       } else {
         do_work( );
@@ -74,6 +126,11 @@ worker_thread_impl::handle_io_operation( OVERLAPPED_ENTRY olapped_entry )
 {
 }
 
+void
+worker_thread_impl::poll_io( )
+{
+}
+
 void
 worker_thread_impl::wakeup( )
 {
@@ -86,13 +143,23 @@ worker_thread_impl::get_data( )
   return data;
 }
 
-work_data::work_data( unsigned int concurrency )
+work_data::work_data( unsigned int concurrency, const pool_options& opts, unsigned int max_threads )
+  : generic_work_data( opts, max_threads )
 {
-  iocp = CreateIoCompletionPort( INVALID_HANDLE_VALUE, nullptr, 0, concurrency );
+  iocp  = CreateIoCompletionPort( INVALID_HANDLE_VALUE, nullptr, 0, concurrency );
+  timer = CreateThreadpoolTimer(
+    []( PTP_CALLBACK_INSTANCE, PVOID ctx, PTP_TIMER ) {
+      auto* dat = static_cast< work_data* >( ctx );
+      PostQueuedCompletionStatus( dat->iocp, 0, dat->timer_completionkey, nullptr );
+    },
+    this, nullptr );
 }
 
 work_data::~work_data( )
 {
+  SetThreadpoolTimer( timer, nullptr, 0, 0 );
+  WaitForThreadpoolTimerCallbacks( timer, true );
+  CloseThreadpoolTimer( timer );
   CloseHandle( iocp );
 }
 }
@@ -6,11 +6,14 @@ namespace thr_queue {
 namespace platform {
 struct work_data : generic_work_data
 {
-  work_data( unsigned int concurrency );
+  work_data( unsigned int concurrency, const pool_options& opts, unsigned int max_threads );
   ~work_data( );
 
   HANDLE iocp;
+  // posts timer_completionkey to iocp when it expires.
+  PTP_TIMER timer;
   const ULONG queue_completionkey = 0x1;
+  const ULONG timer_completionkey = 0x2;
 };
 
 class worker_thread_impl : public virtual base_worker_thread
@@ -21,6 +24,8 @@ public:
 protected:
   void loop( ) override;
   void handle_io_operation( OVERLAPPED_ENTRY olapped_entry );
+  /** \brief Does nothing, every worker waits on the completion port. */
+  void poll_io( ) override;
   void wakeup( ) override;
   generic_work_data& get_data( ) override;
 
@@ -0,0 +1,151 @@
+#include "thr_queue/io_wait.h"
+#include "global_thr_pool_impl.h"
+#include <deque>
+#include <logging/log.h>
+#include <poll.h>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+namespace {
+/** \brief Hands out io_states, which are never freed, see io_state. */
+class io_state_pool
+{
+public:
+  detail::io_state*
+  acquire( )
+  {
+    boost::lock_guard< boost::mutex > lock( mt );
+    if ( free_states.empty( ) ) {
+      // a deque doesn't move its elements when it grows.
+      states.emplace_back( );
+      return &states.back( );
+    }
+    auto* ret = free_states.back( );
+    free_states.pop_back( );
+    return ret;
+  }
+
+  void
+  release( detail::io_state* state )
+  {
+    boost::lock_guard< boost::mutex > lock( mt );
+    free_states.push_back( state );
+  }
+
+private:
+  boost::mutex mt;
+  std::deque< detail::io_state > states;
+  std::vector< detail::io_state* > free_states;
+};
+
+io_state_pool&
+state_pool( )
+{
+  // leaked, so that late events never see a destroyed state.
+  static auto* pool = new io_state_pool;
+  return *pool;
+}
+}
+
+io_handle::io_handle( io_descriptor f ) : fd( f ), state( state_pool( ).acquire( ) )
+{
+  boost::lock_guard< boost::mutex > lock( state->mt );
+  state->fd = fd;
+}
+
+io_handle::~io_handle( )
+{
+  {
+    boost::lock_guard< boost::mutex > lock( state->mt );
+    auto& read_dir  = state->directions[ detail::io_state::read ];
+    auto& write_dir = state->directions[ detail::io_state::write ];
+    assert( !read_dir.waiter && !write_dir.waiter &&
+            "an io_handle can't be destroyed while a coroutine waits" );
+    try {
+      if ( read_dir.worker ) {
+        read_dir.worker->set_io_events( *state, state->events_for( read_dir.worker ), 0 );
+      }
+      if ( write_dir.worker && write_dir.worker != read_dir.worker ) {
+        write_dir.worker->set_io_events( *state, state->events_for( write_dir.worker ), 0 );
+      }
+    } catch ( std::exception& e ) {
+      LOG( ) << "caught when destroying an io_handle: " << e.what( );
+    }
+    for ( auto& dir : state->directions ) {
+      dir = detail::io_state::direction( );
+    }
+    state->fd = -1;
+  }
+  state_pool( ).release( state );
+}
+
+bool
+io_handle::wait_readable( )
+{
+  return wait( detail::io_state::read );
+}
+
+bool
+io_handle::wait_writable( )
+{
+  return wait( detail::io_state::write );
+}
+
+void
+io_handle::close( )
+{
+  boost::optional< coroutine > woken[ 2 ];
+  {
+    // wait_io() checks the flag while holding the lock, so it either sees it
+    // or has parked by the time we look for waiters.
+    boost::lock_guard< boost::mutex > lock( state->mt );
+    closed = true;
+    for ( int i = 0; i < 2; ++i ) {
+      auto& dir = state->directions[ i ];
+      if ( dir.waiter ) {
+        woken[ i ] = std::move( dir.waiter );
+        dir.waiter = boost::none;
+      }
+    }
+  }
+  for ( auto& cor : woken ) {
+    if ( cor ) {
+      global_thr_pool->schedule( std::move( *cor ), true );
+    }
+  }
+}
+
+io_descriptor
+io_handle::native_handle( ) const
+{
+  return fd;
+}
+
+bool
+io_handle::wait( int direction )
+{
+  if ( running_coroutine && this_wthread ) {
+    return this_wthread->wait_io( *state, direction, closed );
+  }
+
+  pollfd poll_fd;
+  poll_fd.fd     = fd;
+  poll_fd.events = direction == detail::io_state::read ? POLLIN : POLLOUT;
+  // close() can't interrupt poll(), so the flag is checked now and then.
+  while ( !closed ) {
+    poll_fd.revents = 0;
+    int poll_ret    = poll( &poll_fd, 1, 50 );
+    if ( poll_ret > 0 ) {
+      return true;
+    } else if ( poll_ret == -1 && errno != EINTR ) {
+      std::ostringstream ss;
+      ss << "Error polling fd " << fd << ": " << strerror( errno );
+      LOG( ) << ss.str( );
+      throw std::runtime_error( ss.str( ) );
+    }
+  }
+  return false;
+}
+}
+}
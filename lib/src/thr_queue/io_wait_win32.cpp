@@ -0,0 +1,69 @@
+#include "thr_queue/io_wait.h"
+#include "thr_queue/cancellation.h"
+#include "thr_queue/global_thr_pool.h"
+#include <logging/log.h>
+#include <sstream>
+#include <stdexcept>
+#include <winsock2.h>
+
+namespace game_engine {
+namespace thr_queue {
+// IOCP reports completions rather than readiness, so waiting blocks the worker
+// and another one is started meanwhile.
+io_handle::io_handle( io_descriptor f ) : fd( f ), state( nullptr )
+{
+}
+
+io_handle::~io_handle( )
+{
+}
+
+bool
+io_handle::wait_readable( )
+{
+  return wait( POLLRDNORM );
+}
+
+bool
+io_handle::wait_writable( )
+{
+  return wait( POLLWRNORM );
+}
+
+void
+io_handle::close( )
+{
+  closed = true;
+}
+
+io_descriptor
+io_handle::native_handle( ) const
+{
+  return fd;
+}
+
+bool
+io_handle::wait( int events )
+{
+  check_cancellation( );
+  blocking_section blocking;
+  WSAPOLLFD poll_fd;
+  poll_fd.fd     = SOCKET( fd );
+  poll_fd.events = SHORT( events );
+  // close() can't interrupt WSAPoll(), so the flag is checked now and then.
+  while ( !closed ) {
+    poll_fd.revents = 0;
+    int poll_ret    = WSAPoll( &poll_fd, 1, 50 );
+    if ( poll_ret > 0 ) {
+      return true;
+    } else if ( poll_ret == SOCKET_ERROR ) {
+      std::ostringstream ss;
+      ss << "Error polling socket: " << WSAGetLastError( );
+      LOG( ) << ss.str( );
+      throw std::runtime_error( ss.str( ) );
+    }
+  }
+  return false;
+}
+}
+}
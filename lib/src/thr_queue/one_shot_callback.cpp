@@ -0,0 +1,55 @@
+#include "one_shot_callback.h"
+#include "thr_queue/thread_api.h"
+#include <cassert>
+
+namespace game_engine {
+namespace thr_queue {
+void
+one_shot_callback::arm( )
+{
+  assert( state == state_t::idle );
+  assert( func );
+  state = state_t::armed;
+}
+
+bool
+one_shot_callback::disarm( )
+{
+  if ( state.load( std::memory_order_relaxed ) != state_t::armed ) {
+    return false;
+  }
+  state = state_t::idle;
+  return true;
+}
+
+void
+one_shot_callback::take( )
+{
+  assert( state == state_t::armed );
+  state = state_t::firing;
+}
+
+void
+one_shot_callback::fire( )
+{
+  func( );
+  // the owner may destroy us as soon as we are idle.
+  state.store( state_t::idle, std::memory_order_release );
+}
+
+void
+one_shot_callback::wait_fired( ) const
+{
+  // callbacks only reschedule coroutines, so this doesn't take long.
+  while ( state.load( std::memory_order_acquire ) == state_t::firing ) {
+    boost::this_thread::yield( );
+  }
+}
+
+bool
+one_shot_callback::idle( ) const
+{
+  return state.load( std::memory_order_acquire ) == state_t::idle;
+}
+}
+}
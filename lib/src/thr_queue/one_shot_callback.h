@@ -0,0 +1,55 @@
+#pragma once
+
+#include "thr_queue/functor.h"
+#include <atomic>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief A function that is registered in a list, such as the timer wheel
+ * or the callbacks of a cancellation_state, and run at most once each time
+ * it is registered.
+ * arm(), disarm() and take() are called while holding the lock of the list.
+ * The function is run by fire() after releasing it, because it takes the
+ * locks of suspension points, which may be held while arming it.
+ */
+class one_shot_callback
+{
+public:
+  one_shot_callback( ) = default;
+  one_shot_callback( const one_shot_callback& ) = delete;
+  one_shot_callback& operator=( const one_shot_callback& ) = delete;
+
+  /** \brief Marks func as registered. It must not be already. */
+  void arm( );
+
+  /** \brief Marks func as unregistered if it still is, then the caller has to
+   * unlink it. Returns false if it wasn't registered or has been taken.
+   */
+  bool disarm( );
+
+  /** \brief Marks func as taken out of the list to be run by fire(). */
+  void take( );
+
+  /** \brief Runs func after take() and marks it as unregistered. */
+  void fire( );
+
+  /** \brief Waits until a fire() that may be running has returned. */
+  void wait_fired( ) const;
+
+  /** \brief Returns whether func is neither registered nor running. */
+  bool idle( ) const;
+
+  inline_functor func;
+
+private:
+  enum class state_t
+  {
+    idle,
+    armed,
+    firing
+  };
+
+  std::atomic< state_t > state{ state_t::idle };
+};
+}
+}
@@ -0,0 +1,101 @@
+#include "global_thr_pool_impl.h"
+#include "thr_queue/cancellation.h"
+#include "thr_queue/parallel.h"
+#include "thr_queue/util_queue.h"
+
+namespace game_engine {
+namespace thr_queue {
+namespace detail {
+void
+fork_join_state::add( )
+{
+  pending.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void
+fork_join_state::done( )
+{
+  if ( --pending == 0 ) {
+    // join() returns, destroying us, as soon as it sees finished, so we have
+    // to set it while holding the lock. Chunks of a cancelled task group still
+    // have to get here.
+    cancellation_shield shield;
+    boost::lock_guard< event::mutex > lock( mt );
+    finished = true;
+    cv.notify( );
+  }
+}
+
+void
+fork_join_state::join( )
+{
+  // if we are the last chunk to finish nobody else will touch the state.
+  if ( --pending != 0 ) {
+    // the chunks may reference the stack of the caller, so we wait for them
+    // even if it is cancelled.
+    cancellation_shield shield;
+    boost::unique_lock< event::mutex > lock( mt );
+    while ( !finished ) {
+      cv.wait( lock );
+    }
+  }
+  if ( failed ) {
+    std::rethrow_exception( error );
+  }
+}
+
+void
+fork_join_state::fail( std::exception_ptr e )
+{
+  if ( !failed.exchange( true ) ) {
+    error = std::move( e );
+  }
+}
+
+bool
+fork_join_state::has_failed( ) const
+{
+  return failed;
+}
+
+void
+fork_join_state::reset( )
+{
+  pending = 1;
+  failed = false;
+  error = nullptr;
+  finished = false;
+}
+
+bool
+pool_saturated( )
+{
+  return global_thr_pool->saturated( );
+}
+
+unsigned int
+pool_concurrency( )
+{
+  return global_thr_pool->concurrency( );
+}
+
+bool
+in_coroutine( )
+{
+  return running_coroutine != nullptr;
+}
+
+void
+spawn( inline_functor f, work_options opts )
+{
+  global_thr_pool->schedule( coroutine( std::move( f ), opts ), false );
+}
+
+void
+run_in_coroutine( inline_functor f )
+{
+  default_par_queue( ).submit_work( std::move( f ) ).wait( );
+}
+}
+}
+}
@@ -0,0 +1,84 @@
+#include "thr_queue/pool_options.h"
+#include "topology.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace game_engine {
+namespace thr_queue {
+pool_options
+pool_options::from_environment( )
+{
+  // the global pool is built during static initialization, so we can't rely
+  // on logging being ready here.
+  pool_options opts;
+
+  if ( auto ptr = getenv( "GAME_ENGINE_SCHEDULER" ) ) {
+    if ( strcmp( ptr, "work_stealing" ) == 0 ) {
+      opts.scheduler = scheduler_type::work_stealing;
+    } else if ( strcmp( ptr, "shared_queues" ) == 0 ) {
+      opts.scheduler = scheduler_type::shared_queues;
+    }
+  }
+
+  if ( auto ptr = getenv( "GAME_ENGINE_STARVATION_MS" ) ) {
+    auto ms = atoi( ptr );
+    if ( ms > 0 ) {
+      opts.starvation_limit = std::chrono::milliseconds( ms );
+    }
+  }
+
+  if ( auto ptr = getenv( "GAME_ENGINE_THREADS" ) ) {
+    auto threads = atoi( ptr );
+    if ( threads > 0 ) {
+      opts.threads = threads;
+    }
+  }
+
+  if ( auto ptr = getenv( "GAME_ENGINE_MAX_THREADS" ) ) {
+    auto threads = atoi( ptr );
+    if ( threads > 0 ) {
+      opts.max_threads = threads;
+    }
+  }
+
+  if ( auto ptr = getenv( "GAME_ENGINE_IDLE_TIMEOUT_MS" ) ) {
+    auto ms = atoi( ptr );
+    if ( ms > 0 ) {
+      opts.idle_timeout = std::chrono::milliseconds( ms );
+    }
+  }
+
+  if ( auto ptr = getenv( "GAME_ENGINE_CPUS" ) ) {
+    opts.cpus = parse_cpu_list( ptr );
+  }
+
+  if ( auto ptr = getenv( "GAME_ENGINE_PINNING" ) ) {
+    if ( strcmp( ptr, "none" ) == 0 ) {
+      opts.pinning = pinning_type::none;
+    } else if ( strcmp( ptr, "cpu" ) == 0 ) {
+      opts.pinning = pinning_type::cpu;
+    } else if ( strcmp( ptr, "llc" ) == 0 ) {
+      opts.pinning = pinning_type::llc;
+    } else if ( strcmp( ptr, "socket" ) == 0 ) {
+      opts.pinning = pinning_type::socket;
+    }
+  }
+
+  if ( auto ptr = getenv( "GAME_ENGINE_BLOCKING_THREADS" ) ) {
+    auto threads = atoi( ptr );
+    if ( threads > 0 ) {
+      opts.blocking_threads = threads;
+    }
+  }
+
+  if ( auto ptr = getenv( "GAME_ENGINE_BLOCKING_QUEUE" ) ) {
+    auto size = atoi( ptr );
+    if ( size > 0 ) {
+      opts.blocking_queue_size = size;
+    }
+  }
+
+  return opts;
+}
+}
+}
@@ -4,18 +4,29 @@
 #include "thr_queue/global_thr_pool.h"
 #include "thr_queue/queue.h"
 #include "thr_queue/thread_api.h"
+#include <concurrentqueue.h>
 
 namespace game_engine {
 namespace thr_queue {
+struct queue::concurrent_work
+{
+  // no preallocated blocks, most queues are short lived.
+  moodycamel::ConcurrentQueue< queued_work > items{ 0 };
+};
+
 void
 swap( queue& lhs, queue& rhs )
 {
+  // the locks only keep out the users of work_queue, push_work() enqueues to
+  // concurrent_queue without them. Locking there too would make every parallel
+  // submitter contend, so queues aren't swapped while work is submitted.
   boost::lock( lhs.queue_mut, rhs.queue_mut );
   boost::lock_guard< boost::recursive_mutex > lock_lhs( lhs.queue_mut, boost::adopt_lock );
   boost::lock_guard< boost::recursive_mutex > lock_rhs( rhs.queue_mut, boost::adopt_lock );
 
   using std::swap;
   swap( lhs.work_queue, rhs.work_queue );
+  swap( lhs.concurrent_queue, rhs.concurrent_queue );
   swap( lhs.typ, rhs.typ );
   swap( lhs.cb_added, rhs.cb_added );
 }
@@ -28,60 +39,120 @@ queue::queue( queue&& rhs ) : typ( queue_type::parallel )
 queue&
 queue::operator=( queue&& rhs )
 {
-  queue temp( queue_type::parallel );
-  using std::swap;
-  swap( temp, rhs );
+  // the move constructor doesn't allocate a concurrent_work.
+  queue temp( std::move( rhs ) );
   swap( *this, temp );
   return *this;
 }
 
-queue::queue( queue_type ty ) : typ( ty )
+queue::queue( queue_type ty ) : queue( ty, nullptr )
 {
 }
 
 queue::queue( queue_type ty, queue::callback_t cb ) : typ( ty ), cb_added( std::move( cb ) )
 {
+  if ( typ == queue_type::parallel ) {
+    concurrent_queue.reset( new concurrent_work );
+  }
 }
 
 queue::queue( steal_work_t, queue& other )
 {
+  // work_queue is empty if the other queue uses concurrent_queue, so we
+  // don't need to lock it.
+  if ( other.concurrent_queue ) {
+    typ = other.typ;
+    take_concurrent_work( other );
+    return;
+  }
   boost::unique_lock< boost::recursive_mutex > lock( other.queue_mut );
   typ        = other.typ;
   work_queue = std::move( other.work_queue );
 }
 
+queue::~queue( )
+{
+}
+
+void
+queue::push_work( queued_work work )
+{
+  if ( concurrent_queue ) {
+    concurrent_queue->items.enqueue( std::move( work ) );
+    if ( cb_added ) {
+      cb_added( *this );
+    }
+    return;
+  }
+
+  boost::lock_guard< boost::recursive_mutex > guard( queue_mut );
+  work_queue.push_back( std::move( work ) );
+  if ( cb_added ) {
+    cb_added( *this );
+  }
+}
+
+void
+queue::push_work_locked( queued_work work )
+{
+  if ( concurrent_queue ) {
+    concurrent_queue->items.enqueue( std::move( work ) );
+  } else {
+    work_queue.push_back( std::move( work ) );
+  }
+}
+
+void
+queue::take_concurrent_work( queue& from )
+{
+  if ( !from.concurrent_queue ) {
+    return;
+  }
+  auto& items = from.concurrent_queue->items;
+  while ( items.try_dequeue_bulk( std::back_inserter( work_queue ), items.size_approx( ) + 1 ) > 0 ) {
+  }
+}
+
 void
 queue::append_queue( queue q )
 {
+  // nobody else can add work to q, so its work can be kept in work_queue.
+  q.take_concurrent_work( q );
+
   boost::lock( queue_mut, q.queue_mut );
   boost::lock_guard< boost::recursive_mutex > my_lock( queue_mut, boost::adopt_lock );
   boost::lock_guard< boost::recursive_mutex > q_lock( q.queue_mut, boost::adopt_lock );
 
   if ( typ == q.typ ) {
-    std::move( q.work_queue.begin( ), q.work_queue.end( ), std::back_inserter( work_queue ) );
+    if ( concurrent_queue ) {
+      concurrent_queue->items.enqueue_bulk( std::make_move_iterator( q.work_queue.begin( ) ), q.work_queue.size( ) );
+      q.work_queue.clear( );
+    } else {
+      std::move( q.work_queue.begin( ), q.work_queue.end( ), std::back_inserter( work_queue ) );
+    }
 
   } else if ( typ == queue_type::parallel && q.typ == queue_type::serial ) {
+    auto opts = q.combined_options( );
     auto func = [q = std::move( q )]( ) mutable
     {
       q.run_until_empty( );
     };
 
-    work_queue.emplace_back( new spec_functor< decltype( func ) >( std::move( func ) ) );
+    push_work_locked( { std::move( func ), opts } );
 
   } else if ( typ == queue_type::serial && q.typ == queue_type::parallel ) {
 
     auto func = [q = std::move( q )]( ) mutable
     {
-      event::mutex mt;
-      event::condition_variable cv;
-      boost::unique_lock< event::mutex > lock( mt );
-
-      auto size = q.work_queue.size( );
-      schedule_queue_first( std::move( q ), cv, mt, size );
-      cv.wait( lock );
+      event::latch done( q.work_queue.size( ) );
+      schedule_queue_first( std::move( q ), done );
+      done.wait( );
     };
 
-    work_queue.emplace_back( new spec_functor< decltype( func ) >( std::move( func ) ) );
+    // it only schedules the work and waits for it.
+    work_options opts;
+    opts.stack_size = stack_size_class::medium;
+    work_queue.push_back( { std::move( func ), opts } );
   }
 
   if ( cb_added ) {
@@ -92,12 +163,21 @@ queue::append_queue( queue q )
 bool
 queue::run_once( )
 {
+  if ( concurrent_queue ) {
+    queued_work work;
+    if ( !concurrent_queue->items.try_dequeue( work ) ) {
+      return false;
+    }
+    work.func( );
+    return true;
+  }
+
   boost::unique_lock< boost::recursive_mutex > lock( queue_mut );
 
   if ( work_queue.size( ) == 0 ) {
     return false;
   }
-  auto work = std::move( work_queue.front( ) );
+  auto work = std::move( work_queue.front( ).func );
   work_queue.pop_front( );
 
   // we want to allow another thread to call this member function while we are
@@ -105,17 +185,23 @@ queue::run_once( )
   if ( typ == queue_type::parallel ) {
     lock.unlock( );
   }
-  ( *work )( );
+  work( );
   return true;
 }
 
 void
 queue::run_until_empty( )
 {
+  if ( concurrent_queue ) {
+    queued_work work;
+    while ( concurrent_queue->items.try_dequeue( work ) ) {
+      work.func( );
+    }
+  }
   while ( work_queue.size( ) > 0 ) {
-    auto work = std::move( work_queue.front( ) );
+    auto work = std::move( work_queue.front( ).func );
     work_queue.pop_front( );
-    ( *work )( );
+    work( );
   }
 }
 
@@ -124,5 +210,18 @@ queue::type( ) const
 {
   return typ;
 }
+
+work_options
+queue::combined_options( ) const
+{
+  if ( work_queue.empty( ) ) {
+    return work_options( );
+  }
+  auto opts = work_queue.front( ).opts;
+  for ( auto& work : work_queue ) {
+    opts = combine_options( opts, work.opts );
+  }
+  return opts;
+}
 }
 }
@@ -1,29 +1,129 @@
 #include "stack_allocator.h"
 #include "thr_queue/thread_api.h"
+#include <algorithm>
 #include <concurrentqueue.h>
+#include <cstdlib>
+#include <cstring>
 #include <logging/log.h>
 #include <random>
+#include <vector>
 
 namespace game_engine {
 namespace thr_queue {
 const stack_props_t stack_props;
-moodycamel::ConcurrentQueue< allocated_stack > used_stacks;
+static moodycamel::ConcurrentQueue< allocated_stack > used_stacks[ number_stack_size_classes ];
 constexpr auto used_stack_lifetime = std::chrono::seconds( 10 );
 
+// stacks released by a thread are first kept in its own cache, so that
+// coroutines spawned by the same thread reuse them without touching the shared
+// queue, and with their pages still resident.
+constexpr size_t thread_cache_capacity[ number_stack_size_classes ] = { 16, 8, 4, 4 };
+// hits are counted per thread and only added to the shared counter every once
+// in a while.
+constexpr uint64_t thread_cache_hits_flush = 64;
+
+static std::atomic< uint64_t > thread_cache_hits{ 0 };
+static std::atomic< uint64_t > thread_cache_misses{ 0 };
+static std::atomic< uint64_t > global_cache_hits{ 0 };
+static std::atomic< uint64_t > stacks_mapped{ 0 };
+static std::atomic< uint64_t > bytes_reclaimed{ 0 };
+static std::atomic< uint64_t > max_used_bytes[ number_stack_size_classes ];
+static std::atomic< uint64_t > used_bytes_fit[ number_stack_size_classes ];
+
+struct thread_stack_cache
+{
+  thread_stack_cache( );
+  ~thread_stack_cache( );
+
+  std::vector< allocated_stack > stacks[ number_stack_size_classes ];
+  // how many of the stacks at the front of each vector have had their pages
+  // reclaimed since they were released.
+  size_t reclaimed[ number_stack_size_classes ] = {};
+  uint64_t unflushed_hits                       = 0;
+};
+
+// coroutines can be destroyed by the destructors of other thread_local
+// objects, after the cache is gone.
+static thread_local bool thread_cache_destroyed = false;
+static thread_local thread_stack_cache thread_cache;
+
+thread_stack_cache::thread_stack_cache( )
+{
+  for ( size_t i = 0; i < number_stack_size_classes; ++i ) {
+    stacks[ i ].reserve( thread_cache_capacity[ i ] );
+  }
+}
+
+thread_stack_cache::~thread_stack_cache( )
+{
+  thread_cache_hits.fetch_add( unflushed_hits, std::memory_order_relaxed );
+  thread_cache_destroyed = true;
+}
+
+bool
+stack_props_t::measure_usage_from_environment( )
+{
+  // stack_props is constructed during static initialization, we can't log.
+  auto ptr = getenv( "GAME_ENGINE_STACK_USAGE" );
+  return ptr && strcmp( ptr, "1" ) == 0;
+}
+
 allocated_stack
-allocate_stack( )
+allocate_stack( stack_size_class cls )
 {
-  auto now = std::chrono::system_clock::now( );
-  allocated_stack deqd;
-  while ( used_stacks.try_dequeue( deqd ) ) {
-    if ( ( now - deqd.last_release ) < used_stack_lifetime ) {
-      break;
+  auto reuse_or_map = [cls]( ) {
+    auto index = size_t( cls );
+    if ( !thread_cache_destroyed && !thread_cache.stacks[ index ].empty( ) ) {
+      auto& cache = thread_cache;
+      auto stack  = std::move( cache.stacks[ index ].back( ) );
+      cache.stacks[ index ].pop_back( );
+      cache.reclaimed[ index ] = std::min( cache.reclaimed[ index ], cache.stacks[ index ].size( ) );
+      if ( ++cache.unflushed_hits == thread_cache_hits_flush ) {
+        thread_cache_hits.fetch_add( cache.unflushed_hits, std::memory_order_relaxed );
+        cache.unflushed_hits = 0;
+      }
+      return stack;
     }
+    thread_cache_misses.fetch_add( 1, std::memory_order_relaxed );
+
+    auto now = std::chrono::system_clock::now( );
+    allocated_stack deqd;
+    while ( used_stacks[ index ].try_dequeue( deqd ) ) {
+      if ( ( now - deqd.last_release ) < used_stack_lifetime ) {
+        break;
+      }
+    }
+    if ( deqd.bottom_of_stack ) {
+      global_cache_hits.fetch_add( 1, std::memory_order_relaxed );
+      return deqd;
+    } else {
+      stacks_mapped.fetch_add( 1, std::memory_order_relaxed );
+      return allocated_stack( allocated_stack::alloc( ), cls );
+    }
+  };
+
+  auto stack = reuse_or_map( );
+  if ( stack_props.measure_usage ) {
+    stack.plat_paint( );
+  }
+  return stack;
+}
+
+static void
+record_usage( stack_size_class cls, size_t used )
+{
+  auto& max_used = max_used_bytes[ size_t( cls ) ];
+  auto prev      = max_used.load( std::memory_order_relaxed );
+  while ( prev < used && !max_used.compare_exchange_weak( prev, used, std::memory_order_relaxed ) ) {
   }
-  if ( deqd.bottom_of_stack ) {
-    return deqd;
-  } else {
-    return allocated_stack( allocated_stack::alloc( ) );
+  // the smallest class that would have been enough, the guard page is not
+  // usable.
+  for ( size_t i = 0; i < number_stack_size_classes; ++i ) {
+    if ( used + stack_props.page_size <= stack_size_bytes( stack_size_class( i ) ) ||
+         i + 1 == number_stack_size_classes ) {
+      used_bytes_fit[ i ].fetch_add( 1, std::memory_order_relaxed );
+      break;
+    }
   }
 }
 
@@ -31,20 +131,71 @@ void
 release_stack( allocated_stack stack )
 {
   stack.release( );
-  if ( stack.bottom_of_stack ) {
-    used_stacks.enqueue( std::move( stack ) );
+  if ( !stack.bottom_of_stack ) {
+    return;
+  }
+  if ( stack_props.measure_usage ) {
+    record_usage( stack.cls, stack.plat_used_bytes( ) );
+  }
+  auto index = size_t( stack.cls );
+  if ( !thread_cache_destroyed && thread_cache.stacks[ index ].size( ) < thread_cache_capacity[ index ] ) {
+    thread_cache.stacks[ index ].push_back( std::move( stack ) );
+    return;
+  }
+  // the stack might stay in the shared queue for a while, so we give back the
+  // pages that lie past the part we expect every coroutine to use.
+  auto reclaimed = stack.plat_reclaim( stack_props.keep_resident_size );
+  bytes_reclaimed.fetch_add( reclaimed, std::memory_order_relaxed );
+  used_stacks[ index ].enqueue( std::move( stack ) );
+}
+
+void
+reclaim_cached_stacks( )
+{
+  if ( thread_cache_destroyed ) {
+    return;
+  }
+  uint64_t reclaimed = 0;
+  for ( size_t i = 0; i < number_stack_size_classes; ++i ) {
+    auto& stacks = thread_cache.stacks[ i ];
+    for ( size_t j = thread_cache.reclaimed[ i ]; j < stacks.size( ); ++j ) {
+      reclaimed += stacks[ j ].plat_reclaim( stack_props.keep_resident_size );
+    }
+    thread_cache.reclaimed[ i ] = stacks.size( );
+  }
+  if ( reclaimed ) {
+    bytes_reclaimed.fetch_add( reclaimed, std::memory_order_relaxed );
   }
 }
 
+stack_stats
+get_stack_stats( )
+{
+  stack_stats ret;
+  ret.thread_cache_hits   = thread_cache_hits.load( std::memory_order_relaxed );
+  ret.thread_cache_misses = thread_cache_misses.load( std::memory_order_relaxed );
+  ret.global_cache_hits   = global_cache_hits.load( std::memory_order_relaxed );
+  ret.stacks_mapped       = stacks_mapped.load( std::memory_order_relaxed );
+  ret.bytes_reclaimed     = bytes_reclaimed.load( std::memory_order_relaxed );
+  for ( size_t i = 0; i < number_stack_size_classes; ++i ) {
+    ret.max_used_bytes[ i ] = max_used_bytes[ i ].load( std::memory_order_relaxed );
+    ret.used_bytes_fit[ i ] = used_bytes_fit[ i ].load( std::memory_order_relaxed );
+  }
+  return ret;
+}
+
 allocated_stack::allocated_stack( allocated_stack&& other )
-  : last_release( std::move( other.last_release ) ), sc( other.sc ), bottom_of_stack( other.bottom_of_stack )
+  : last_release( std::move( other.last_release ) )
+  , cls( other.cls )
+  , sc( other.sc )
+  , bottom_of_stack( other.bottom_of_stack )
 {
   other.sc.sp           = nullptr;
   other.sc.size         = 0;
   other.bottom_of_stack = 0;
 }
 
-allocated_stack::allocated_stack( ) : bottom_of_stack( nullptr )
+allocated_stack::allocated_stack( ) : cls( stack_size_class::huge ), bottom_of_stack( nullptr )
 {
   sc.sp   = nullptr;
   sc.size = 0;
@@ -53,15 +204,21 @@ allocated_stack::allocated_stack( ) : bottom_of_stack( nullptr )
 allocated_stack&
 allocated_stack::operator=( allocated_stack rhs )
 {
+  // rhs gets our old stack, and unmaps it.
   using std::swap;
   swap( last_release, rhs.last_release );
+  swap( cls, rhs.cls );
   swap( bottom_of_stack, rhs.bottom_of_stack );
-  sc          = rhs.sc;
-  rhs.sc.sp   = 0;
-  rhs.sc.size = 0;
+  swap( sc, rhs.sc );
   return *this;
 }
 
+stack_size_class
+allocated_stack::size_class( ) const
+{
+  return cls;
+}
+
 void
 allocated_stack::release( )
 {
@@ -4,6 +4,8 @@
 #include <boost/context/stack_context.hpp>
 #include <boost/context/stack_traits.hpp>
 #include <chrono>
+#include <thr_queue/pool_stats.h>
+#include <thr_queue/work_options.h>
 
 #ifndef _WIN32
 #include "stack_allocator_linux.h"
@@ -15,21 +17,28 @@ namespace game_engine {
 namespace thr_queue {
 struct stack_props_t
 {
-  static constexpr size_t stack_size = 8 * 1024 * 1024;
+  // pages closer than this to the top of a stack are not reclaimed when it is
+  // moved to the shared cache.
+  static constexpr size_t keep_resident_size = 64 * 1024;
   size_t page_size;
-  size_t max_stack_size_in_pages;
   size_t min_stack_size_in_pages;
+  // if set, stacks are painted when they are allocated so that we can measure
+  // how much of them was used when they are released.
+  bool measure_usage;
 
   stack_props_t( )
     : page_size( boost::context::stack_traits::page_size( ) )
-    , max_stack_size_in_pages( stack_size / page_size )
 #ifndef _WIN32
     , min_stack_size_in_pages( 0 )
 #else
     , min_stack_size_in_pages( 20 ) // boost bug #12340
 #endif
+    , measure_usage( measure_usage_from_environment( ) )
   {
   }
+
+private:
+  static bool measure_usage_from_environment( );
 };
 
 extern const stack_props_t stack_props;
@@ -51,18 +60,35 @@ public:
 
   allocated_stack& operator=( allocated_stack );
 
+  stack_size_class size_class( ) const;
+
 private:
   struct alloc
   {
   };
-  allocated_stack( alloc );
+  allocated_stack( alloc, stack_size_class cls );
 
   void release( );
 
-  friend allocated_stack allocate_stack( );
+  /** \brief Fills the stack with a pattern that plat_used_bytes looks for. */
+  void plat_paint( );
+
+  /** \brief Returns how many bytes of the stack have been used since it was
+   * painted. */
+  size_t plat_used_bytes( ) const;
+
+  /** \brief Returns to the OS the pages of the stack that are further than
+   * keep_bytes from its top. The contents of the pages are lost. Returns how
+   * many bytes were given back, some of which might have never been resident.
+   */
+  size_t plat_reclaim( size_t keep_bytes );
+
+  friend allocated_stack allocate_stack( stack_size_class cls );
 
   friend void release_stack( allocated_stack );
 
+  friend void reclaim_cached_stacks( );
+
   friend struct cor_data;
 
   friend struct platform::allocated_stack;
@@ -72,14 +98,28 @@ private:
 #endif
 private:
   std::chrono::system_clock::time_point last_release;
+  stack_size_class cls;
   boost::context::stack_context sc;
   uint8_t* bottom_of_stack;
 };
 
-allocated_stack allocate_stack( );
+/** \brief Returns a stack of the class cls, reusing a released one if
+ * possible.
+ */
+allocated_stack allocate_stack( stack_size_class cls );
 
 void release_stack( allocated_stack stack );
 
+/** \brief Gives back to the OS the deep pages of the stacks in the cache of
+ * the calling thread, like release_stack() does for the stacks it moves to
+ * the shared cache. It is called by workers before they park, the stacks
+ * they release while they are busy keep their pages so that reusing them
+ * doesn't fault.
+ */
+void reclaim_cached_stacks( );
+
+stack_stats get_stack_stats( );
+
 class donothing_allocator
 {
 public:
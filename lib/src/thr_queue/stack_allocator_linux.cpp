@@ -1,19 +1,18 @@
 #include "stack_allocator.h"
 #include "global_thr_pool_impl.h"
+#include <algorithm>
 #include <logging/log.h>
 #include <sys/mman.h>
 
 namespace game_engine {
 namespace thr_queue {
-allocated_stack::allocated_stack( alloc )
+allocated_stack::allocated_stack( alloc, stack_size_class size_cls ) : cls( size_cls )
 {
-  sc.size         = stack_props.stack_size;
-  bottom_of_stack = (uint8_t*) mmap( nullptr,
-                                     sc.size,
-                                     PROT_READ | PROT_WRITE,
-                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_GROWSDOWN | MAP_STACK,
-                                     -1,
-                                     0 );
+  // the whole stack is mapped at once, so MAP_GROWSDOWN would only make the
+  // kernel keep a gap below it.
+  sc.size = stack_size_bytes( cls );
+  bottom_of_stack =
+    (uint8_t*) mmap( nullptr, sc.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0 );
   if ( bottom_of_stack == MAP_FAILED ) {
     LOG( ) << "mmap failed:" << strerror( errno );
     throw std::system_error( errno, std::system_category( ) );
@@ -34,6 +33,60 @@ allocated_stack::~allocated_stack( )
   }
 }
 
+// what plat_paint fills stacks with.
+constexpr uint64_t stack_paint = 0xdeadbeefcafebabe;
+
+void
+allocated_stack::plat_paint( )
+{
+  auto begin = (uint64_t*) ( bottom_of_stack + stack_props.page_size );
+  auto end   = (uint64_t*) sc.sp;
+  std::fill( begin, end, stack_paint );
+}
+
+size_t
+allocated_stack::plat_used_bytes( ) const
+{
+  // the stack grows downwards, the first word that was overwritten marks how
+  // deep it got.
+  auto begin = (const uint64_t*) ( bottom_of_stack + stack_props.page_size );
+  auto end   = (const uint64_t*) sc.sp;
+  auto used  = std::find_if( begin, end, []( uint64_t word ) { return word != stack_paint; } );
+  return (const uint8_t*) end - (const uint8_t*) used;
+}
+
+size_t
+allocated_stack::plat_reclaim( size_t keep_bytes )
+{
+  auto page_size = stack_props.page_size;
+  // the lowest page is the guard page.
+  auto begin = bottom_of_stack + page_size;
+  auto end   = (uint8_t*) sc.sp - ( keep_bytes + page_size - 1 ) / page_size * page_size;
+  if ( end <= begin ) {
+    return 0;
+  }
+  size_t length = end - begin;
+#ifdef MADV_FREE
+  // MADV_FREE is cheaper because the kernel only takes the pages when it needs
+  // them, but it is not supported before Linux 4.5.
+  static std::atomic< bool > madv_free_supported{ true };
+  if ( madv_free_supported.load( std::memory_order_relaxed ) ) {
+    if ( madvise( begin, length, MADV_FREE ) == 0 ) {
+      return length;
+    } else if ( errno != EINVAL ) {
+      LOG( ) << "madvise failed: " << strerror( errno );
+      return 0;
+    }
+    madv_free_supported = false;
+  }
+#endif
+  if ( madvise( begin, length, MADV_DONTNEED ) != 0 ) {
+    LOG( ) << "madvise failed: " << strerror( errno );
+    return 0;
+  }
+  return length;
+}
+
 void
 platform::allocated_stack::plat_release( )
 {
@@ -16,9 +16,9 @@ namespace game_engine {
 namespace thr_queue {
 std::atomic< double > ewma_stack_size{ 1 };
 
-allocated_stack::allocated_stack( alloc )
+allocated_stack::allocated_stack( alloc, stack_size_class size_cls ) : cls( size_cls )
 {
-  sc.size         = stack_props.stack_size;
+  sc.size         = stack_size_bytes( cls );
   bottom_of_stack = (uint8_t*) VirtualAlloc( nullptr, sc.size, MEM_RESERVE, PAGE_READWRITE );
   assert( bottom_of_stack );
   sc.sp = bottom_of_stack + sc.size;
@@ -34,7 +34,9 @@ allocated_stack::allocated_stack( alloc )
   } else {
     pages = 1;
   }
-  pages             = std::max( stack_props.min_stack_size_in_pages, pages );
+  pages = std::max( stack_props.min_stack_size_in_pages, pages );
+  // leave a guard page
+  pages             = std::min( sc.size / stack_props.page_size - 1, pages );
   auto commit_bytes = pages * stack_props.page_size;
   auto ret = VirtualAlloc( (uint8_t*) sc.sp - commit_bytes, commit_bytes, MEM_COMMIT, PAGE_READWRITE );
   boost::ignore_unused( ret );
@@ -50,6 +52,36 @@ allocated_stack::~allocated_stack( )
   assert( ret );
 }
 
+void
+allocated_stack::plat_paint( )
+{
+  // pages are committed on demand, so we already know how many were used.
+}
+
+size_t
+allocated_stack::plat_used_bytes( ) const
+{
+  return pages * stack_props.page_size;
+}
+
+size_t
+allocated_stack::plat_reclaim( size_t keep_bytes )
+{
+  // only the pages at the top of the stack are committed. MEM_RESET keeps them
+  // committed, so SEH_filter_except_add_page doesn't need to know about it.
+  auto keep_pages = ( keep_bytes + stack_props.page_size - 1 ) / stack_props.page_size;
+  if ( pages <= keep_pages ) {
+    return 0;
+  }
+  auto length = ( pages - keep_pages ) * stack_props.page_size;
+  auto begin  = (uint8_t*) sc.sp - pages * stack_props.page_size;
+  if ( !VirtualAlloc( begin, length, MEM_RESET, PAGE_READWRITE ) ) {
+    LOG( ) << "VirtualAlloc(MEM_RESET) failed: " << GetLastError( );
+    return 0;
+  }
+  return length;
+}
+
 int
 platform::SEH_filter_except_add_page( thr_queue::allocated_stack* stc, _EXCEPTION_POINTERS* ep )
 {
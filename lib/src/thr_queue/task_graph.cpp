@@ -0,0 +1,164 @@
+#include "thr_queue/task_graph.h"
+#include "global_thr_pool_impl.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace game_engine {
+namespace thr_queue {
+task_graph::node::node( inline_functor f, work_options o ) : func( std::move( f ) ), opts( o )
+{
+}
+
+task_graph::node_id
+task_graph::add_node( inline_functor func, work_options opts )
+{
+  nodes.emplace_back( std::make_unique< node >( std::move( func ), opts ) );
+  validated = false;
+  return nodes.size( ) - 1;
+}
+
+void
+task_graph::add_edge( node_id before, node_id after )
+{
+  if ( before >= nodes.size( ) || after >= nodes.size( ) ) {
+    std::ostringstream ss;
+    ss << "task_graph::add_edge: invalid node " << ( before >= nodes.size( ) ? before : after )
+       << ", the graph has " << nodes.size( ) << " nodes.";
+    throw std::runtime_error( ss.str( ) );
+  }
+  nodes[ before ]->successors.push_back( nodes[ after ].get( ) );
+  ++nodes[ after ]->predecessors;
+  validated = false;
+}
+
+size_t
+task_graph::size( ) const
+{
+  return nodes.size( );
+}
+
+void
+task_graph::check_acyclic( )
+{
+  roots.clear( );
+  for ( auto& n : nodes ) {
+    n->remaining = n->predecessors;
+    if ( n->predecessors == 0 ) {
+      roots.push_back( n.get( ) );
+    }
+  }
+
+  // Kahn's algorithm: if some node can't be reached by removing the edges of
+  // the nodes that are ready, there is a cycle.
+  std::vector< node* > ready( roots );
+  size_t visited = 0;
+  while ( !ready.empty( ) ) {
+    auto n = ready.back( );
+    ready.pop_back( );
+    ++visited;
+    for ( auto succ : n->successors ) {
+      if ( --succ->remaining == 0 ) {
+        ready.push_back( succ );
+      }
+    }
+  }
+
+  if ( visited != nodes.size( ) ) {
+    std::ostringstream ss;
+    ss << "task_graph::run: the edges form a cycle, only " << visited << " of " << nodes.size( )
+       << " nodes can run.";
+    throw std::runtime_error( ss.str( ) );
+  }
+  validated = true;
+}
+
+void
+task_graph::spawn_node( node& n )
+{
+  detail::spawn( [ this, ptr = &n ] { run_node( *ptr ); }, n.opts );
+}
+
+bool
+task_graph::fits_inline( const node& n )
+{
+  return n.opts.stack_size <= running_coroutine->stack_size( );
+}
+
+void
+task_graph::run_node( node& first )
+{
+  // the first successor that becomes ready is run by this coroutine instead of
+  // a new one, so a chain of nodes is run without spawning anything.
+  for ( node* n = &first; n; ) {
+    if ( !n->skip ) {
+      try {
+        n->func( );
+      } catch ( ... ) {
+        n->skip = true;
+        state.fail( std::current_exception( ) );
+      }
+    }
+
+    node* next = nullptr;
+    for ( auto succ : n->successors ) {
+      if ( n->skip ) {
+        succ->skip = true;
+      }
+      // the last predecessor to finish runs the successor.
+      if ( succ->remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+        if ( !next && fits_inline( *succ ) ) {
+          next = succ;
+        } else {
+          spawn_node( *succ );
+        }
+      }
+    }
+    state.done( );
+    n = next;
+  }
+}
+
+void
+task_graph::run( )
+{
+  if ( !detail::in_coroutine( ) ) {
+    std::exception_ptr error;
+    detail::run_in_coroutine( [&] {
+      try {
+        run( );
+      } catch ( ... ) {
+        error = std::current_exception( );
+      }
+    } );
+    if ( error ) {
+      std::rethrow_exception( error );
+    }
+    return;
+  }
+
+  if ( !validated ) {
+    check_acyclic( );
+  }
+
+  state.reset( );
+  for ( auto& n : nodes ) {
+    n->remaining.store( n->predecessors, std::memory_order_relaxed );
+    n->skip.store( false, std::memory_order_relaxed );
+    state.add( );
+  }
+  // the caller runs a root itself while the rest are spawned.
+  node* first = nullptr;
+  for ( auto n : roots ) {
+    if ( !first && fits_inline( *n ) ) {
+      first = n;
+    } else {
+      spawn_node( *n );
+    }
+  }
+  if ( first ) {
+    run_node( *first );
+  }
+  state.join( );
+}
+}
+}
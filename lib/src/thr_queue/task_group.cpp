@@ -0,0 +1,125 @@
+#include "thr_queue/task_group.h"
+#include "cancellation_impl.h"
+#include "global_thr_pool_impl.h"
+#include <exception>
+#include <logging/log.h>
+
+namespace game_engine {
+namespace thr_queue {
+task_group::task_group( work_options opts )
+  : default_opts( opts ), state( std::make_shared< detail::cancellation_state >( ) )
+{
+  parent = this_coroutine_token( ).state;
+  if ( !parent ) {
+    return;
+  }
+  parent_link = std::make_unique< detail::cancellation_callback >( );
+  if ( parent->cancelled ) {
+    state->cancel( );
+  } else {
+    parent_link->arm( *parent, [s = state] { s->cancel( ); } );
+  }
+}
+
+task_group::~task_group( )
+{
+  if ( joined ) {
+    return;
+  }
+  // the children may reference the objects that are being unwound.
+  if ( std::uncaught_exception( ) ) {
+    cancel( );
+  }
+  try {
+    join( );
+  } catch ( std::exception& e ) {
+    LOG( ) << "A child of a task_group that was destroyed without joining it threw: " << e.what( );
+  }
+}
+
+void
+task_group::spawn( inline_functor func )
+{
+  spawn( std::move( func ), default_opts );
+}
+
+void
+task_group::spawn( inline_functor func, work_options opts )
+{
+  children.add( );
+  joined = false;
+  coroutine cor( [ this, func = std::move( func ) ]( ) mutable { run_child( func ); }, opts );
+  detail::cancellation_state::attach( cor, state );
+  global_thr_pool->schedule( std::move( cor ), false );
+}
+
+void
+task_group::run_child( inline_functor& func )
+{
+  // children that haven't started when the group is cancelled aren't run.
+  if ( !state->cancelled ) {
+    try {
+      func( );
+    } catch ( const operation_cancelled& ) {
+    } catch ( ... ) {
+      children.fail( std::current_exception( ) );
+      state->cancel( );
+    }
+  }
+  children.done( );
+}
+
+void
+task_group::join( )
+{
+  if ( joined ) {
+    return;
+  }
+
+  if ( !detail::in_coroutine( ) ) {
+    std::exception_ptr error;
+    detail::run_in_coroutine( [&] {
+      try {
+        join( );
+      } catch ( ... ) {
+        error = std::current_exception( );
+      }
+    } );
+    if ( error ) {
+      std::rethrow_exception( error );
+    }
+    return;
+  }
+
+  joined = true;
+  std::exception_ptr error;
+  try {
+    children.join( );
+  } catch ( ... ) {
+    error = std::current_exception( );
+  }
+  children.reset( );
+  if ( error ) {
+    std::rethrow_exception( error );
+  }
+}
+
+void
+task_group::cancel( )
+{
+  state->cancel( );
+}
+
+bool
+task_group::is_cancelled( ) const
+{
+  return state->cancelled;
+}
+
+cancellation_token
+task_group::token( ) const
+{
+  return cancellation_token( state );
+}
+}
+}
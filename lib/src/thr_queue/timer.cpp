@@ -0,0 +1,30 @@
+#include "thr_queue/timer.h"
+#include "global_thr_pool_impl.h"
+#include <thread>
+
+namespace game_engine {
+namespace thr_queue {
+void
+sleep_until( timer_clock::time_point deadline )
+{
+  if ( !running_coroutine ) {
+    std::this_thread::sleep_until( deadline );
+    return;
+  }
+  if ( timer_clock::now( ) >= deadline ) {
+    return;
+  }
+
+  timer_entry entry;
+  entry.deadline = deadline;
+  global_thr_pool->yield(
+    [&entry]( coroutine running ) {
+      entry.callback.func = [cor = std::move( running )]( ) mutable {
+        global_thr_pool->schedule( std::move( cor ), true );
+      };
+      global_thr_pool->add_timer( entry );
+    },
+    block_reason::timer );
+}
+}
+}
@@ -0,0 +1,190 @@
+#include "timer_wheel.h"
+#include "global_thr_pool_impl.h"
+#include <algorithm>
+#include <cassert>
+
+namespace game_engine {
+namespace thr_queue {
+namespace {
+uint64_t
+level_span( unsigned int level )
+{
+  return uint64_t( 1 ) << ( timer_wheel::level_bits * level );
+}
+}
+
+timer_entry::~timer_entry( )
+{
+  if ( !callback.idle( ) ) {
+    global_thr_pool->cancel_timer( *this );
+  }
+}
+
+const uint64_t timer_wheel::no_expiry;
+
+timer_wheel::timer_wheel( ) : epoch( clock::now( ) )
+{
+}
+
+void
+timer_wheel::add( timer_entry& e )
+{
+  // deadlines are rounded up so that entries never expire early.
+  e.tick = std::max( to_tick( e.deadline ), current + 1 );
+  place( e );
+  ++count;
+}
+
+void
+timer_wheel::remove( timer_entry& e )
+{
+  assert( e.list );
+  unlink( e );
+  --count;
+}
+
+void
+timer_wheel::advance( clock::time_point now, std::vector< timer_entry* >& expired )
+{
+  if ( now <= epoch ) {
+    return;
+  }
+  auto target = uint64_t( std::chrono::duration_cast< std::chrono::milliseconds >( now - epoch ).count( ) );
+  if ( count == 0 ) {
+    current = std::max( current, target );
+    return;
+  }
+
+  while ( current < target && count > 0 ) {
+    // the wheel may not have been advanced for a long time, we jump to the
+    // next tick that expires or moves entries down.
+    if ( !wheel[ 0 ][ ( current + 1 ) & ( slots - 1 ) ] ) {
+      current = std::max( current, std::min( next_expiry( ), target ) - 1 );
+    }
+    ++current;
+    // the entries of the slots that start now move down, the higher levels
+    // go first because they may move entries to slots of the lower ones that
+    // also start now.
+    if ( ( current & ( level_span( levels ) - 1 ) ) == 0 ) {
+      cascade( overflow );
+    }
+    for ( unsigned int level = levels - 1; level > 0; --level ) {
+      if ( ( current & ( level_span( level ) - 1 ) ) == 0 ) {
+        cascade( wheel[ level ][ ( current >> ( level_bits * level ) ) & ( slots - 1 ) ] );
+      }
+    }
+
+    auto& slot = wheel[ 0 ][ current & ( slots - 1 ) ];
+    while ( slot ) {
+      auto& e = *slot;
+      assert( e.tick == current );
+      unlink( e );
+      --count;
+      expired.push_back( &e );
+    }
+  }
+  current = std::max( current, target );
+}
+
+uint64_t
+timer_wheel::next_expiry( ) const
+{
+  if ( count == 0 ) {
+    return no_expiry;
+  }
+
+  auto ret = no_expiry;
+  for ( unsigned int level = 0; level < levels; ++level ) {
+    auto pos = current >> ( level_bits * level );
+    for ( unsigned int i = 1; i <= slots; ++i ) {
+      if ( wheel[ level ][ ( pos + i ) & ( slots - 1 ) ] ) {
+        // the entries of level 0 expire at that tick, the ones of higher
+        // levels move down then.
+        ret = std::min( ret, ( pos + i ) << ( level_bits * level ) );
+        break;
+      }
+    }
+  }
+  if ( overflow ) {
+    ret = std::min( ret, ( ( current >> ( level_bits * levels ) ) + 1 ) << ( level_bits * levels ) );
+  }
+  return ret;
+}
+
+uint64_t
+timer_wheel::to_tick( clock::time_point t ) const
+{
+  if ( t <= epoch ) {
+    return 0;
+  }
+  auto ns = uint64_t( std::chrono::duration_cast< std::chrono::nanoseconds >( t - epoch ).count( ) );
+  return ns / 1000000 + ( ns % 1000000 != 0 );
+}
+
+timer_wheel::clock::time_point
+timer_wheel::to_time_point( uint64_t tick ) const
+{
+  return epoch + std::chrono::milliseconds( tick );
+}
+
+size_t
+timer_wheel::size( ) const
+{
+  return count;
+}
+
+void
+timer_wheel::place( timer_entry& e )
+{
+  assert( e.tick >= current );
+  auto delta = e.tick - current;
+  for ( unsigned int level = 0; level < levels; ++level ) {
+    if ( delta < level_span( level + 1 ) ) {
+      push( wheel[ level ][ ( e.tick >> ( level_bits * level ) ) & ( slots - 1 ) ], e );
+      return;
+    }
+  }
+  push( overflow, e );
+}
+
+void
+timer_wheel::push( timer_entry*& list, timer_entry& e )
+{
+  e.list = &list;
+  e.prev = nullptr;
+  e.next = list;
+  if ( list ) {
+    list->prev = &e;
+  }
+  list = &e;
+}
+
+void
+timer_wheel::unlink( timer_entry& e )
+{
+  if ( e.prev ) {
+    e.prev->next = e.next;
+  } else {
+    *e.list = e.next;
+  }
+  if ( e.next ) {
+    e.next->prev = e.prev;
+  }
+  e.list = nullptr;
+  e.prev = nullptr;
+  e.next = nullptr;
+}
+
+void
+timer_wheel::cascade( timer_entry*& list )
+{
+  auto* e = list;
+  list    = nullptr;
+  while ( e ) {
+    auto* next = e->next;
+    place( *e );
+    e = next;
+  }
+}
+}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "one_shot_callback.h"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief A callback that a worker runs once its deadline has passed.
+ * It is linked into the timer wheel of the pool, so it must live until it has
+ * been run or cancelled. Its destructor cancels it.
+ */
+struct timer_entry
+{
+  timer_entry( ) = default;
+  timer_entry( const timer_entry& ) = delete;
+  timer_entry& operator=( const timer_entry& ) = delete;
+  ~timer_entry( );
+
+  std::chrono::steady_clock::time_point deadline;
+  // armed while the entry is linked into the wheel.
+  one_shot_callback callback;
+
+  // managed by the timer wheel.
+  uint64_t tick      = 0;
+  timer_entry** list = nullptr;
+  timer_entry* prev  = nullptr;
+  timer_entry* next  = nullptr;
+};
+
+/** \brief A hierarchical timer wheel with a resolution of one millisecond.
+ * It has four levels of 64 slots, each covering 64 times the span of the one
+ * below. Entries are placed in the level that matches how far their deadline
+ * is and move down as the wheel advances, so adding and removing them is O(1)
+ * and each entry is moved at most once per level. Entries that are more than
+ * 2^24 ms (about 4.6 hours) away wait in an overflow list.
+ * It isn't thread safe.
+ */
+class timer_wheel
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  static const unsigned int level_bits = 6;
+  static const unsigned int slots      = 1u << level_bits;
+  static const unsigned int levels     = 4;
+  static const uint64_t no_expiry      = ~uint64_t( 0 );
+
+  timer_wheel( );
+
+  timer_wheel( const timer_wheel& ) = delete;
+  timer_wheel& operator=( const timer_wheel& ) = delete;
+
+  /** \brief Links e, whose deadline must be set. Deadlines that have already
+   * passed expire on the next tick.
+   */
+  void add( timer_entry& e );
+
+  /** \brief Unlinks e, which must have been added and not expired yet. */
+  void remove( timer_entry& e );
+
+  /** \brief Advances the wheel to now and appends the entries that have
+   * expired to expired. They are unlinked but their callbacks stay armed.
+   */
+  void advance( clock::time_point now, std::vector< timer_entry* >& expired );
+
+  /** \brief Returns the first tick at which the wheel has to be advanced, or
+   * no_expiry if it is empty. It may be earlier than the first deadline when
+   * entries have to move to a lower level.
+   */
+  uint64_t next_expiry( ) const;
+
+  /** \brief Converts between ticks and time points. */
+  uint64_t to_tick( clock::time_point t ) const;
+  clock::time_point to_time_point( uint64_t tick ) const;
+
+  size_t size( ) const;
+
+private:
+  void place( timer_entry& e );
+  void push( timer_entry*& list, timer_entry& e );
+  void unlink( timer_entry& e );
+  void cascade( timer_entry*& list );
+
+  const clock::time_point epoch;
+  // the last tick that has been processed.
+  uint64_t current = 0;
+  size_t count     = 0;
+  // heads of doubly linked lists of entries.
+  timer_entry* wheel[ levels ][ slots ] = {};
+  timer_entry* overflow                 = nullptr;
+};
+}
+}
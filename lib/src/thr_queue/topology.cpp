@@ -0,0 +1,69 @@
+#include "topology.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+namespace game_engine {
+namespace thr_queue {
+std::vector< unsigned int >
+cpu_topology::llc_cpus( unsigned int group ) const
+{
+  std::vector< unsigned int > ret;
+  for ( auto& cpu : cpus ) {
+    if ( cpu.llc_group == group ) {
+      ret.push_back( cpu.id );
+    }
+  }
+  return ret;
+}
+
+std::vector< unsigned int >
+cpu_topology::package_cpus( unsigned int package ) const
+{
+  std::vector< unsigned int > ret;
+  for ( auto& cpu : cpus ) {
+    if ( cpu.package == package ) {
+      ret.push_back( cpu.id );
+    }
+  }
+  return ret;
+}
+
+std::vector< unsigned int >
+parse_cpu_list( const std::string& list )
+{
+  std::vector< unsigned int > ret;
+  std::istringstream ss( list );
+  std::string range;
+  while ( std::getline( ss, range, ',' ) ) {
+    range.erase( std::remove_if( range.begin( ), range.end( ), ::isspace ), range.end( ) );
+    if ( range.empty( ) ) {
+      continue;
+    }
+    char* end;
+    auto first = strtoul( range.c_str( ), &end, 10 );
+    auto last  = first;
+    if ( end == range.c_str( ) ) {
+      return { };
+    }
+    if ( *end == '-' ) {
+      auto* last_begin = end + 1;
+      last             = strtoul( last_begin, &end, 10 );
+      if ( end == last_begin || last < first ) {
+        return { };
+      }
+    }
+    if ( *end != '\0' ) {
+      return { };
+    }
+    for ( auto cpu = first; cpu <= last; ++cpu ) {
+      ret.push_back( cpu );
+    }
+  }
+  std::sort( ret.begin( ), ret.end( ) );
+  ret.erase( std::unique( ret.begin( ), ret.end( ) ), ret.end( ) );
+  return ret;
+}
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief A CPU that the pool can run workers on. */
+struct cpu_info
+{
+  unsigned int id = 0;
+  // the socket of the CPU, numbered from 0.
+  unsigned int package = 0;
+  // the group of CPUs that share the last level cache, numbered from 0.
+  unsigned int llc_group = 0;
+};
+
+/** \brief The CPUs of the machine grouped by socket and last level cache. */
+struct cpu_topology
+{
+  std::vector< cpu_info > cpus;
+  unsigned int number_llc_groups = 1;
+  unsigned int number_packages   = 1;
+
+  /** \brief Reads the topology of the online CPUs, from /sys/devices/system/cpu
+   * on Linux. Only the CPUs in allowed are kept, unless it is empty. If the
+   * topology can't be read every CPU is put in a single group.
+   */
+  static cpu_topology detect( const std::vector< unsigned int >& allowed );
+
+  /** \brief Returns the CPUs of an LLC group. */
+  std::vector< unsigned int > llc_cpus( unsigned int group ) const;
+
+  /** \brief Returns the CPUs of a socket. */
+  std::vector< unsigned int > package_cpus( unsigned int package ) const;
+};
+
+/** \brief Parses a list of CPUs in the format used by the kernel, such as
+ * "0-3,8,10-11". Returns an empty vector if it is malformed.
+ */
+std::vector< unsigned int > parse_cpu_list( const std::string& list );
+
+/** \brief Restricts the calling thread to run on cpus. Returns false if the
+ * platform refused.
+ */
+bool pin_current_thread( const std::vector< unsigned int >& cpus );
+}
+}
@@ -0,0 +1,119 @@
+#include "topology.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <thread>
+
+namespace game_engine {
+namespace thr_queue {
+namespace {
+const char* const sys_cpu = "/sys/devices/system/cpu";
+
+bool
+read_line( const std::string& path, std::string& line )
+{
+  std::ifstream file( path );
+  return bool( std::getline( file, line ) );
+}
+
+std::string
+cpu_path( unsigned int cpu )
+{
+  std::ostringstream ss;
+  ss << sys_cpu << "/cpu" << cpu;
+  return ss.str( );
+}
+
+// returns the lowest CPU that shares the last level cache with cpu.
+unsigned int
+llc_leader( unsigned int cpu )
+{
+  unsigned int best_level = 0;
+  unsigned int leader     = cpu;
+  for ( unsigned int index = 0;; ++index ) {
+    std::ostringstream dir;
+    dir << cpu_path( cpu ) << "/cache/index" << index;
+    std::string level, shared;
+    if ( !read_line( dir.str( ) + "/level", level ) ) {
+      break;
+    }
+    auto lvl = unsigned( std::stoul( level ) );
+    if ( lvl < best_level || !read_line( dir.str( ) + "/shared_cpu_list", shared ) ) {
+      continue;
+    }
+    auto cpus = parse_cpu_list( shared );
+    if ( !cpus.empty( ) ) {
+      best_level = lvl;
+      leader     = cpus.front( );
+    }
+  }
+  return leader;
+}
+}
+
+cpu_topology
+cpu_topology::detect( const std::vector< unsigned int >& allowed )
+{
+  cpu_topology topo;
+  std::string line;
+  std::vector< unsigned int > online;
+  if ( read_line( std::string( sys_cpu ) + "/online", line ) ) {
+    online = parse_cpu_list( line );
+  }
+
+  // CPUs that the process isn't allowed to run on can't be used either.
+  cpu_set_t affinity;
+  CPU_ZERO( &affinity );
+  bool have_affinity = sched_getaffinity( 0, sizeof( affinity ), &affinity ) == 0;
+
+  std::map< unsigned int, unsigned int > llc_groups;
+  std::map< unsigned int, unsigned int > packages;
+  for ( auto cpu : online ) {
+    if ( ( !allowed.empty( ) && !std::binary_search( allowed.begin( ), allowed.end( ), cpu ) ) ||
+         ( have_affinity && cpu < CPU_SETSIZE && !CPU_ISSET( cpu, &affinity ) ) ) {
+      continue;
+    }
+    cpu_info info;
+    info.id = cpu;
+    unsigned int package_id = 0;
+    if ( read_line( cpu_path( cpu ) + "/topology/physical_package_id", line ) ) {
+      package_id = unsigned( std::stoul( line ) );
+    }
+    info.package   = packages.emplace( package_id, unsigned( packages.size( ) ) ).first->second;
+    auto group     = llc_groups.emplace( llc_leader( cpu ), unsigned( llc_groups.size( ) ) ).first;
+    info.llc_group = group->second;
+    topo.cpus.push_back( info );
+  }
+
+  if ( topo.cpus.empty( ) ) {
+    // sysfs isn't mounted or nothing matched, assume a single group.
+    auto count = allowed.empty( ) ? std::max( 1u, std::thread::hardware_concurrency( ) ) : allowed.size( );
+    topo.cpus.resize( count );
+    for ( unsigned int i = 0; i < count; ++i ) {
+      topo.cpus[ i ].id = allowed.empty( ) ? i : allowed[ i ];
+    }
+    llc_groups.clear( );
+    packages.clear( );
+  }
+  topo.number_llc_groups = std::max( std::size_t( 1 ), llc_groups.size( ) );
+  topo.number_packages   = std::max( std::size_t( 1 ), packages.size( ) );
+  return topo;
+}
+
+bool
+pin_current_thread( const std::vector< unsigned int >& cpus )
+{
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  for ( auto cpu : cpus ) {
+    if ( cpu < CPU_SETSIZE ) {
+      CPU_SET( cpu, &set );
+    }
+  }
+  return pthread_setaffinity_np( pthread_self( ), sizeof( set ), &set ) == 0;
+}
+}
+}
@@ -0,0 +1,40 @@
+#include "topology.h"
+#include <algorithm>
+#include <thread>
+#include <windows.h>
+
+namespace game_engine {
+namespace thr_queue {
+cpu_topology
+cpu_topology::detect( const std::vector< unsigned int >& allowed )
+{
+  // the cache layout isn't read on Windows, every CPU is put in one group.
+  cpu_topology topo;
+  auto count = std::max( 1u, std::thread::hardware_concurrency( ) );
+  for ( unsigned int cpu = 0; cpu < count; ++cpu ) {
+    if ( !allowed.empty( ) && !std::binary_search( allowed.begin( ), allowed.end( ), cpu ) ) {
+      continue;
+    }
+    cpu_info info;
+    info.id = cpu;
+    topo.cpus.push_back( info );
+  }
+  if ( topo.cpus.empty( ) ) {
+    topo.cpus.resize( 1 );
+  }
+  return topo;
+}
+
+bool
+pin_current_thread( const std::vector< unsigned int >& cpus )
+{
+  DWORD_PTR mask = 0;
+  for ( auto cpu : cpus ) {
+    if ( cpu < sizeof( mask ) * 8 ) {
+      mask |= DWORD_PTR( 1 ) << cpu;
+    }
+  }
+  return mask != 0 && SetThreadAffinityMask( GetCurrentThread( ), mask ) != 0;
+}
+}
+}
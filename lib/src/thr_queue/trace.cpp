@@ -0,0 +1,200 @@
+#include "trace_impl.h"
+#include "thr_queue/thread_api.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+namespace {
+struct trace_event
+{
+  uint64_t ts_ns;
+  std::intptr_t cor_id;
+  trace_event_type type;
+  block_reason reason;
+};
+
+struct trace_buffer
+{
+  trace_buffer( unsigned int tid_, size_t capacity_log2, uint64_t run_ )
+    : tid( tid_ )
+    , mask( ( size_t( 1 ) << capacity_log2 ) - 1 )
+    , events( new trace_event[ size_t( 1 ) << capacity_log2 ] )
+    , run( run_ )
+  {
+  }
+
+  const unsigned int tid;
+  const size_t mask;
+  std::unique_ptr< trace_event[] > events;
+  // only written by the owning thread.
+  std::atomic< uint64_t > written{ 0 };
+  // the run of start_tracing() that the events belong to, only written by the
+  // owning thread.
+  std::atomic< uint64_t > run;
+};
+
+// buffers are never freed so that the events of threads that have exited can
+// still be dumped.
+boost::mutex buffers_mt;
+std::vector< std::unique_ptr< trace_buffer > > buffers;
+size_t buffer_size_log2 = 16;
+uint64_t trace_start_ns = 0;
+// incremented by start_tracing(), the owners of the buffers discard the events
+// of previous runs the next time they record one.
+std::atomic< uint64_t > trace_run{ 0 };
+thread_local trace_buffer* this_buffer = nullptr;
+
+uint64_t
+now_ns( )
+{
+  return std::chrono::duration_cast< std::chrono::nanoseconds >(
+           std::chrono::steady_clock::now( ).time_since_epoch( ) )
+    .count( );
+}
+
+trace_buffer&
+get_buffer( )
+{
+  if ( !this_buffer ) {
+    boost::lock_guard< boost::mutex > lock( buffers_mt );
+    buffers.emplace_back( new trace_buffer( buffers.size( ), buffer_size_log2, trace_run.load( ) ) );
+    this_buffer = buffers.back( ).get( );
+  }
+  return *this_buffer;
+}
+
+const char*
+reason_name( block_reason reason )
+{
+  switch ( reason ) {
+    case block_reason::finished:
+      return "finished";
+    case block_reason::yield:
+      return "yield";
+    case block_reason::mutex:
+      return "mutex";
+    case block_reason::cond_var:
+      return "cond_var";
+    case block_reason::future:
+      return "future";
+    case block_reason::channel:
+      return "channel";
+    case block_reason::wait_list:
+      return "wait_list";
+    case block_reason::timer:
+      return "timer";
+    case block_reason::aio:
+      return "aio";
+  }
+  return "unknown";
+}
+
+void
+write_timestamp( std::ostream& out, uint64_t ts_ns )
+{
+  // chrome traces use microseconds.
+  auto rel = ts_ns > trace_start_ns ? ts_ns - trace_start_ns : 0;
+  out << rel / 1000 << '.' << ( rel % 1000 ) / 100 << ( rel % 100 ) / 10 << rel % 10;
+}
+}
+
+std::atomic< bool > trace_enabled{ false };
+thread_local block_reason trace_block_reason = block_reason::finished;
+
+void
+record_trace_event( trace_event_type type, std::intptr_t cor_id, block_reason reason )
+{
+  auto& buf = get_buffer( );
+  auto run  = trace_run.load( std::memory_order_relaxed );
+  auto i    = buf.written.load( std::memory_order_relaxed );
+  if ( buf.run.load( std::memory_order_relaxed ) != run ) {
+    // dump_trace() ignores the buffer until it sees the new run, and by then
+    // written has been reset.
+    i = 0;
+    buf.written.store( 0, std::memory_order_relaxed );
+    buf.run.store( run, std::memory_order_release );
+  }
+  auto& ev = buf.events[ i & buf.mask ];
+  ev.ts_ns  = now_ns( );
+  ev.cor_id = cor_id;
+  ev.type   = type;
+  ev.reason = reason;
+  buf.written.store( i + 1, std::memory_order_release );
+}
+
+void
+start_tracing( size_t events_per_thread )
+{
+  boost::lock_guard< boost::mutex > lock( buffers_mt );
+  if ( trace_enabled ) {
+    return;
+  }
+  buffer_size_log2 = 0;
+  while ( ( size_t( 1 ) << buffer_size_log2 ) < events_per_thread ) {
+    ++buffer_size_log2;
+  }
+  // threads may still be appending events of the previous run, so the buffers
+  // are reset by their owners.
+  ++trace_run;
+  trace_start_ns = now_ns( );
+  trace_enabled  = true;
+}
+
+void
+stop_tracing( )
+{
+  trace_enabled = false;
+}
+
+void
+dump_trace( std::ostream& out )
+{
+  boost::lock_guard< boost::mutex > lock( buffers_mt );
+  out << "{\"traceEvents\":[";
+  bool first       = true;
+  auto begin_event = [&]( const char* name, const char* phase, unsigned int tid ) {
+    out << ( first ? "\n" : ",\n" ) << "{\"name\":\"" << name << "\",\"ph\":\"" << phase
+        << "\",\"pid\":0,\"tid\":" << tid;
+    first = false;
+  };
+
+  for ( auto& buf : buffers ) {
+    begin_event( "thread_name", "M", buf->tid );
+    out << ",\"args\":{\"name\":\"thread " << buf->tid << "\"}}";
+
+    if ( buf->run.load( std::memory_order_acquire ) != trace_run ) {
+      continue;
+    }
+    auto written  = buf->written.load( std::memory_order_acquire );
+    auto capacity = buf->mask + 1;
+    auto begin    = written > capacity ? written - capacity : 0;
+    for ( auto i = begin; i < written; ++i ) {
+      const auto& ev = buf->events[ i & buf->mask ];
+      switch ( ev.type ) {
+        case trace_event_type::schedule:
+          begin_event( "schedule", "i", buf->tid );
+          out << ",\"s\":\"t\"";
+          break;
+        case trace_event_type::switch_in:
+          begin_event( "coroutine", "B", buf->tid );
+          break;
+        case trace_event_type::switch_out:
+          begin_event( "coroutine", "E", buf->tid );
+          break;
+      }
+      out << ",\"ts\":";
+      write_timestamp( out, ev.ts_ns );
+      out << ",\"args\":{\"cor\":" << ev.cor_id;
+      if ( ev.type == trace_event_type::switch_out ) {
+        out << ",\"reason\":\"" << reason_name( ev.reason ) << "\"";
+      }
+      out << "}}";
+    }
+  }
+  out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "thr_queue/trace.h"
+#include <atomic>
+#include <cstdint>
+
+namespace game_engine {
+namespace thr_queue {
+enum class trace_event_type : uint8_t
+{
+  schedule,
+  switch_in,
+  switch_out
+};
+
+extern std::atomic< bool > trace_enabled;
+
+/** \brief The reason passed to the last yield of the coroutine that the
+ * calling worker ran, only kept while tracing.
+ */
+extern thread_local block_reason trace_block_reason;
+
+/** \brief Returns whether events are being recorded. When tracing is disabled
+ * checking it is all that the scheduler does.
+ */
+inline bool
+tracing( )
+{
+  return trace_enabled.load( std::memory_order_relaxed );
+}
+
+/** \brief Appends an event to the ring buffer of the calling thread. */
+void record_trace_event( trace_event_type type, std::intptr_t cor_id, block_reason reason );
+}
+}
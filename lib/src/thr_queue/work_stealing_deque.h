@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace game_engine {
+namespace thr_queue {
+/** \brief A Chase-Lev work-stealing deque.
+ * The owning thread pushes and pops at the bottom (LIFO) while any other
+ * thread may steal from the top (FIFO). The memory orderings follow
+ * "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al.).
+ * Only trivially copyable types can be stored because a thief may read a slot
+ * that is being overwritten and discard the value afterwards.
+ */
+template < typename T >
+class work_stealing_deque
+{
+  static_assert( std::is_trivially_copyable< T >::value, "T must be trivially copyable" );
+
+public:
+  explicit work_stealing_deque( size_t initial_size_log2 = 8 );
+
+  work_stealing_deque( const work_stealing_deque& ) = delete;
+  work_stealing_deque& operator=( const work_stealing_deque& ) = delete;
+
+  /** \brief Adds an element at the bottom. Only the owner can call it. */
+  void push( T item );
+
+  /** \brief Removes the most recently pushed element. Only the owner can call it. */
+  bool pop( T& item );
+
+  /** \brief Removes the oldest element. It can be called from any thread.
+   * It returns false if the deque was empty or another thread won the race
+   * for the element.
+   */
+  bool steal( T& item );
+
+  /** \brief An approximation of the number of elements, only exact if no other
+   * thread is using the deque.
+   */
+  size_t size_approx( ) const;
+
+private:
+  struct ring
+  {
+    explicit ring( size_t size_log2 );
+
+    T get( std::int64_t i ) const;
+    void put( std::int64_t i, T item );
+    ring* grow( std::int64_t bottom, std::int64_t top ) const;
+
+    const size_t size_log2;
+    const std::int64_t mask;
+    std::unique_ptr< std::atomic< T >[] > items;
+  };
+
+  alignas( 64 ) std::atomic< std::int64_t > top{ 0 };
+  alignas( 64 ) std::atomic< std::int64_t > bottom{ 0 };
+  std::atomic< ring* > array;
+  // thieves might still be reading from a ring that was replaced, so we only
+  // free them when the deque is destroyed. Only the owner accesses this.
+  std::vector< std::unique_ptr< ring > > rings;
+};
+}
+}
+
+#include "work_stealing_deque.inl"
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "work_stealing_deque.h"
+
+namespace game_engine {
+namespace thr_queue {
+template <typename T>
+work_stealing_deque<T>::ring::ring(size_t log2)
+ :size_log2(log2)
+ ,mask((std::int64_t(1) << log2) - 1)
+ ,items(new std::atomic<T>[size_t(1) << log2])
+{}
+
+template <typename T>
+T work_stealing_deque<T>::ring::get(std::int64_t i) const {
+  return items[i & mask].load(std::memory_order_relaxed);
+}
+
+template <typename T>
+void work_stealing_deque<T>::ring::put(std::int64_t i, T item) {
+  items[i & mask].store(item, std::memory_order_relaxed);
+}
+
+template <typename T>
+typename work_stealing_deque<T>::ring *
+work_stealing_deque<T>::ring::grow(std::int64_t b, std::int64_t t) const {
+  auto *bigger = new ring(size_log2 + 1);
+  for (auto i = t; i != b; ++i) {
+    bigger->put(i, get(i));
+  }
+  return bigger;
+}
+
+template <typename T>
+work_stealing_deque<T>::work_stealing_deque(size_t initial_size_log2) {
+  rings.emplace_back(new ring(initial_size_log2));
+  array.store(rings.back().get(), std::memory_order_relaxed);
+}
+
+template <typename T>
+void work_stealing_deque<T>::push(T item) {
+  auto b = bottom.load(std::memory_order_relaxed);
+  auto t = top.load(std::memory_order_acquire);
+  auto *a = array.load(std::memory_order_relaxed);
+  if (b - t > a->mask) {
+    rings.emplace_back(a->grow(b, t));
+    a = rings.back().get();
+    array.store(a, std::memory_order_release);
+  }
+  a->put(b, item);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool work_stealing_deque<T>::pop(T &item) {
+  auto b = bottom.load(std::memory_order_relaxed) - 1;
+  auto *a = array.load(std::memory_order_relaxed);
+  bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto t = top.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    // empty
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return false;
+  }
+
+  item = a->get(b);
+  if (t == b) {
+    // last element, we might be racing against a thief.
+    bool won = top.compare_exchange_strong(t, t + 1,
+                                           std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return won;
+  }
+  return true;
+}
+
+template <typename T>
+bool work_stealing_deque<T>::steal(T &item) {
+  auto t = top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto b = bottom.load(std::memory_order_acquire);
+
+  if (t >= b) {
+    return false;
+  }
+
+  auto *a = array.load(std::memory_order_acquire);
+  item = a->get(t);
+  return top.compare_exchange_strong(t, t + 1,
+                                     std::memory_order_seq_cst,
+                                     std::memory_order_relaxed);
+}
+
+template <typename T>
+size_t work_stealing_deque<T>::size_approx() const {
+  auto b = bottom.load(std::memory_order_relaxed);
+  auto t = top.load(std::memory_order_relaxed);
+  return b > t ? size_t(b - t) : 0;
+}
+}
+}
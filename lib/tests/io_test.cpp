@@ -112,6 +112,20 @@ TEST( AIOSubsystem, ReallyBlocking )
     .wait( );
 }
 
+TEST( AIOSubsystem, BlockingThrows )
+{
+  auto throwing_op =
+    make_aio_operation( []( perform_helper< void >& ) { throw std::runtime_error( "test" ); } );
+
+  thr_queue::default_par_queue( )
+    .submit_work( [&] { EXPECT_THROW( throwing_op->perform( ), std::runtime_error ); } )
+    .wait( );
+  // an operation that isn't run by a worker runs on the caller.
+  auto throwing_op2 =
+    make_aio_operation( []( perform_helper< int >& ) { throw std::runtime_error( "test" ); } );
+  EXPECT_THROW( throwing_op2->perform( ), std::runtime_error );
+}
+
 static boost::filesystem::path
 create_path( )
 {
@@ -1,17 +1,76 @@
 #include "thr_queue/queue.h"
+#include "thr_queue/blocking_lane.h"
 #include "thr_queue/coroutine.h"
 #include "thr_queue/event/cond_var.h"
+#include "thr_queue/event/barrier.h"
+#include "thr_queue/event/latch.h"
 #include "thr_queue/event/mutex.h"
+#include "thr_queue/event/semaphore.h"
+#include "thr_queue/event/shared_mutex.h"
 #include "thr_queue/global_thr_pool.h"
+#include "thr_queue/channel.h"
+#include "thr_queue/io_wait.h"
+#include "thr_queue/parallel.h"
+#include "thr_queue/pool_allocator.h"
+#include "thr_queue/pool_options.h"
+#include "thr_queue/pool_stats.h"
+#include "thr_queue/task_graph.h"
+#include "thr_queue/task_group.h"
+#include "thr_queue/timer.h"
+#include "thr_queue/trace.h"
 #include "gtest/gtest.h"
 #include <algorithm>
+#include <array>
+#include <functional>
 #include <boost/context/all.hpp>
 #include <iostream>
+#include <sstream>
 
+#include "../src/thr_queue/blocking_lane.h"
 #include "../src/thr_queue/event/uv_thread.h"
+#include "../src/thr_queue/global_thr_pool_impl.h"
+#include "../src/thr_queue/stack_allocator.h"
+#include "../src/thr_queue/timer_wheel.h"
+#include "../src/thr_queue/topology.h"
+#include "../src/thr_queue/work_stealing_deque.h"
 #include "thr_queue/util_queue.h"
 
 #include <boost/chrono.hpp>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <cstdlib>
+#include <new>
+
+// counts the allocations made by the threads that set count_allocations, to
+// check that some operations don't allocate.
+static std::atomic< size_t > counted_allocations{ 0 };
+static thread_local bool count_allocations = false;
+
+void*
+operator new( size_t size )
+{
+  if ( count_allocations ) {
+    ++counted_allocations;
+  }
+  if ( auto ptr = std::malloc( size ? size : 1 ) ) {
+    return ptr;
+  }
+  throw std::bad_alloc( );
+}
+
+void
+operator delete( void* ptr ) noexcept
+{
+  std::free( ptr );
+}
+
+void
+operator delete( void* ptr, size_t ) noexcept
+{
+  std::free( ptr );
+}
 
 TEST( ThrQueue, ExecutesCode )
 {
@@ -106,6 +165,33 @@ TEST( ThrQueue, SerialQinParallel )
   }
 }
 
+TEST( ThrQueue, ParallelQueueConcurrentSubmit )
+{
+  using namespace game_engine::thr_queue;
+  queue q( queue_type::parallel );
+  std::atomic< int > count( 0 );
+  std::vector< boost::thread > producers;
+
+  for ( size_t i = 0; i < 4; ++i ) {
+    producers.emplace_back( [&] {
+      for ( size_t j = 0; j < 1000; ++j ) {
+        q.submit_work( [&] { count++; } );
+      }
+    } );
+  }
+  for ( auto& thr : producers ) {
+    thr.join( );
+  }
+
+  queue q_ser( queue_type::serial );
+  q_ser.append_queue( std::move( q ) );
+  auto fut = q_ser.submit_work( [] {} );
+  schedule_queue( std::move( q_ser ) );
+  fut.wait( );
+
+  EXPECT_EQ( 4000, count );
+}
+
 TEST( ThrQueue, DefaultParQueue )
 {
   std::atomic< int > count( 0 );
@@ -146,6 +232,41 @@ TEST( ThrQueue, FillStack )
 #endif
 }
 
+TEST( ThrQueue, StackSizeClasses )
+{
+  using namespace game_engine::thr_queue;
+  std::atomic< int > count( 0 );
+  queue q_ser( queue_type::serial );
+  auto running_class = [] { return running_coroutine->stack_size( ); };
+
+  for ( auto cls : { stack_size_class::small, stack_size_class::medium, stack_size_class::large,
+                     stack_size_class::huge } ) {
+    work_options opts;
+    opts.stack_size = cls;
+    auto got        = default_par_queue( ).submit_work(
+      [&] {
+        count++;
+        return running_class( );
+      },
+      opts );
+    EXPECT_EQ( cls, got.get( ) );
+    // the units of a serial queue may share a coroutine, its stack is the
+    // largest they need.
+    q_ser.submit_work(
+      [&, cls] {
+        count++;
+        EXPECT_GE( running_class( ), cls );
+      },
+      opts );
+  }
+
+  auto fut = q_ser.submit_work( [] {} );
+  schedule_queue( std::move( q_ser ) );
+  fut.wait( );
+
+  EXPECT_EQ( 8, count );
+}
+
 TEST( ThrQueue, SerQueue )
 {
   const int n_tasks = 10000;
@@ -295,3 +416,1359 @@ TEST( ThrQueue, UvWait )
   fut.wait( );
   EXPECT_EQ( number, counter );
 }
+
+TEST( ThrQueue, WorkStealingDeque )
+{
+  using game_engine::thr_queue::work_stealing_deque;
+  const int number = 100000;
+  std::vector< int > values( number );
+  work_stealing_deque< int* > deque( 2 );
+
+  for ( int i = 0; i < number; ++i ) {
+    values[ i ] = i;
+    deque.push( &values[ i ] );
+  }
+
+  int* ptr;
+  ASSERT_TRUE( deque.pop( ptr ) );
+  EXPECT_EQ( number - 1, *ptr );
+  ASSERT_TRUE( deque.steal( ptr ) );
+  EXPECT_EQ( 0, *ptr );
+
+  std::atomic< long > sum{ 0 };
+  std::vector< boost::thread > thieves;
+  for ( int i = 0; i < 4; ++i ) {
+    thieves.emplace_back( [&] {
+      int* stolen;
+      while ( deque.size_approx( ) > 0 ) {
+        if ( deque.steal( stolen ) ) {
+          sum += *stolen;
+        }
+      }
+    } );
+  }
+  while ( deque.pop( ptr ) ) {
+    sum += *ptr;
+  }
+  for ( auto& thr : thieves ) {
+    thr.join( );
+  }
+
+  EXPECT_EQ( long( number - 1 ) * ( number - 2 ) / 2, sum );
+}
+
+namespace {
+// counts the instances alive, a destructor that runs twice makes it negative.
+struct instance_counter
+{
+  static int alive;
+
+  instance_counter( )
+  {
+    ++alive;
+  }
+  instance_counter( const instance_counter& )
+  {
+    ++alive;
+  }
+  instance_counter( instance_counter&& ) noexcept
+  {
+    ++alive;
+  }
+  ~instance_counter( )
+  {
+    --alive;
+  }
+};
+int instance_counter::alive = 0;
+
+struct throwing_move
+{
+  throwing_move( ) = default;
+  throwing_move( throwing_move&& ) noexcept( false )
+  {
+  }
+  void operator( )( )
+  {
+  }
+};
+}
+
+TEST( ThrQueue, InlineFunctor )
+{
+  using game_engine::thr_queue::inline_functor;
+  int calls = 0;
+  {
+    // the lambdas hold the reference and the padding, which must not be more
+    // than inline_size bytes to be stored inline.
+    std::array< char, inline_functor::inline_size - sizeof( int* ) > fits{ };
+    std::array< char, inline_functor::inline_size - sizeof( int* ) + 1 > too_big{ };
+    inline_functor small( [&calls, fits] { calls += 1 + fits[ 0 ]; } );
+    inline_functor big( [&calls, too_big] { calls += 1 + too_big[ 0 ]; } );
+    EXPECT_TRUE( small.is_inline( ) );
+    EXPECT_FALSE( big.is_inline( ) );
+    small( );
+    big( );
+    EXPECT_EQ( 2, calls );
+  }
+
+  // moving a closure must not throw, the ones that may are kept in the heap.
+  inline_functor throwing( throwing_move{ } );
+  EXPECT_TRUE( bool( throwing ) );
+  EXPECT_FALSE( throwing.is_inline( ) );
+  throwing( );
+
+  auto ptr = std::make_unique< int >( 0 );
+  inline_functor move_only( [&calls, ptr = std::move( ptr )] { calls += ++*ptr; } );
+  EXPECT_TRUE( move_only.is_inline( ) );
+  inline_functor moved( std::move( move_only ) );
+  EXPECT_FALSE( bool( move_only ) );
+  moved( );
+  moved( );
+  EXPECT_EQ( 5, calls );
+
+  {
+    instance_counter counter;
+    std::array< char, inline_functor::inline_size > padding{ };
+    inline_functor inline_f( [counter] {} );
+    inline_functor heap_f( [counter, padding] { (void) padding; } );
+    EXPECT_TRUE( inline_f.is_inline( ) );
+    EXPECT_FALSE( heap_f.is_inline( ) );
+    // the moves relocate the closures, the moved from functors are empty.
+    inline_functor inline_moved( std::move( inline_f ) );
+    inline_functor heap_moved;
+    heap_moved = std::move( heap_f );
+    EXPECT_EQ( 3, instance_counter::alive );
+    inline_moved = nullptr;
+    EXPECT_EQ( 2, instance_counter::alive );
+  }
+  EXPECT_EQ( 0, instance_counter::alive );
+}
+
+TEST( ThrQueue, IdleWorkerStack )
+{
+// the workers of the Windows pool wait on the completion port instead.
+#ifndef _WIN32
+  using namespace game_engine::thr_queue::platform;
+  // the stack only stores the addresses of the workers.
+  char fake_workers[ 8 ];
+  auto worker = [&]( int i ) { return reinterpret_cast< worker_thread_impl* >( &fake_workers[ i ] ); };
+
+  idle_worker_stack stack( 8 );
+  EXPECT_EQ( nullptr, stack.pop( ) );
+  std::vector< unsigned int > slots;
+  for ( int i = 0; i < 4; ++i ) {
+    slots.push_back( stack.add_worker( *worker( i ) ) );
+    EXPECT_EQ( unsigned( i + 1 ), slots.back( ) );
+  }
+
+  // the last worker pushed is woken up first.
+  for ( auto slot : slots ) {
+    stack.push( slot );
+  }
+  for ( int i = 3; i >= 0; --i ) {
+    EXPECT_EQ( worker( i ), stack.pop( ) );
+  }
+  EXPECT_EQ( nullptr, stack.pop( ) );
+
+  // a popped slot can be pushed again.
+  stack.push( slots[ 0 ] );
+  EXPECT_EQ( worker( 0 ), stack.pop( ) );
+  stack.push( slots[ 0 ] );
+  stack.push( slots[ 1 ] );
+  EXPECT_EQ( worker( 1 ), stack.pop( ) );
+  EXPECT_EQ( worker( 0 ), stack.pop( ) );
+  EXPECT_EQ( nullptr, stack.pop( ) );
+
+  // the slots of removed workers are skipped.
+  stack.push( slots[ 0 ] );
+  stack.push( slots[ 2 ] );
+  stack.push( slots[ 3 ] );
+  stack.remove_worker( slots[ 2 ] );
+  stack.remove_worker( slots[ 3 ] );
+  EXPECT_EQ( worker( 0 ), stack.pop( ) );
+  EXPECT_EQ( nullptr, stack.pop( ) );
+
+  // like the workers, every thread only pushes its slot if it isn't listed
+  // already, and whoever pops a slot unlists it. A slot that is popped twice
+  // or a lost one would break the counts.
+  idle_worker_stack shared( 8 );
+  std::atomic< bool > listed[ 8 ];
+  for ( int i = 0; i < 8; ++i ) {
+    listed[ i ] = false;
+    EXPECT_EQ( unsigned( i + 1 ), shared.add_worker( *worker( i ) ) );
+  }
+  std::atomic< int > double_pops{ 0 };
+  std::vector< boost::thread > threads;
+  for ( int t = 0; t < 8; ++t ) {
+    threads.emplace_back( [&, t] {
+      for ( int i = 0; i < 20000; ++i ) {
+        if ( !listed[ t ].exchange( true ) ) {
+          shared.push( t + 1 );
+        }
+        if ( auto* popped = shared.pop( ) ) {
+          auto index = reinterpret_cast< char* >( popped ) - fake_workers;
+          if ( !listed[ index ].exchange( false ) ) {
+            ++double_pops;
+          }
+        }
+      }
+    } );
+  }
+  for ( auto& thr : threads ) {
+    thr.join( );
+  }
+  EXPECT_EQ( 0, double_pops );
+  int left = 0;
+  while ( auto* popped = shared.pop( ) ) {
+    auto index = reinterpret_cast< char* >( popped ) - fake_workers;
+    EXPECT_TRUE( listed[ index ].exchange( false ) );
+    ++left;
+  }
+  for ( int i = 0; i < 8; ++i ) {
+    EXPECT_FALSE( listed[ i ] );
+  }
+  EXPECT_LE( left, 8 );
+#endif
+}
+
+TEST( ThrQueue, ParallelAlgorithms )
+{
+  using namespace game_engine::thr_queue;
+  const int number = 100000;
+  std::vector< int > values( number );
+  for ( int i = 0; i < number; ++i ) {
+    values[ i ] = i;
+  }
+
+  std::atomic< long > sum{ 0 };
+  parallel_for( values.begin( ), values.end( ), 0, [&]( int v ) { sum += v; } );
+  EXPECT_EQ( long( number ) * ( number - 1 ) / 2, sum );
+
+  std::atomic< int > count{ 0 };
+  parallel_for( 0, number, 100, [&]( int ) { ++count; } );
+  EXPECT_EQ( number, count );
+
+  auto reduced = parallel_reduce( values.begin( ), values.end( ), 0, 0l,
+                                  []( int v ) { return long( v ); },
+                                  []( long a, long b ) { return a + b; } );
+  EXPECT_EQ( long( number ) * ( number - 1 ) / 2, reduced );
+
+  std::vector< int > doubled( number );
+  parallel_transform( values.begin( ), values.end( ), doubled.begin( ), 0,
+                      []( int v ) { return 2 * v; } );
+  for ( int i = 0; i < number; ++i ) {
+    ASSERT_EQ( 2 * i, doubled[ i ] );
+  }
+
+  EXPECT_THROW( parallel_for( 0, number, 10,
+                              []( int i ) {
+                                if ( i == number / 2 ) {
+                                  throw std::runtime_error( "test" );
+                                }
+                              } ),
+                std::runtime_error );
+}
+
+TEST( ThrQueue, TaskGraph )
+{
+  using game_engine::thr_queue::task_graph;
+  task_graph graph;
+  std::atomic< int > physics{ 0 }, ai{ 0 }, render{ 0 };
+  std::atomic< bool > ordered{ true };
+
+  auto physics_node = graph.add_node( [&] { ++physics; } );
+  auto ai_node = graph.add_node( [&] { ++ai; } );
+  auto render_node = graph.add_node( [&] {
+    ++render;
+    if ( physics != render || ai != render ) {
+      ordered = false;
+    }
+  } );
+  graph.add_edge( physics_node, render_node );
+  graph.add_edge( ai_node, render_node );
+
+  for ( int i = 0; i < 100; ++i ) {
+    graph.run( );
+  }
+  EXPECT_TRUE( ordered );
+  EXPECT_EQ( 100, physics );
+  EXPECT_EQ( 100, ai );
+  EXPECT_EQ( 100, render );
+
+  auto failing = graph.add_node( [] { throw std::runtime_error( "test" ); } );
+  auto after_failing = graph.add_node( [&] { ordered = false; } );
+  graph.add_edge( failing, after_failing );
+  EXPECT_THROW( graph.run( ), std::runtime_error );
+  EXPECT_TRUE( ordered );
+
+  graph.add_edge( after_failing, failing );
+  EXPECT_THROW( graph.run( ), std::runtime_error );
+  EXPECT_THROW( graph.add_edge( 0, 42 ), std::runtime_error );
+
+  // a chain of nodes is run by the caller, so running it again doesn't
+  // allocate anything.
+  task_graph chain;
+  int ticks = 0;
+  auto input = chain.add_node( [&] { ++ticks; } );
+  auto update = chain.add_node( [&] { ++ticks; } );
+  auto draw = chain.add_node( [&] { ++ticks; } );
+  chain.add_edge( input, update );
+  chain.add_edge( update, draw );
+  size_t allocations = 0;
+  game_engine::thr_queue::default_par_queue( )
+    .submit_work( [&] {
+      chain.run( );
+      auto before = counted_allocations.load( );
+      count_allocations = true;
+      chain.run( );
+      count_allocations = false;
+      allocations = counted_allocations - before;
+    } )
+    .wait( );
+  EXPECT_EQ( 6, ticks );
+  EXPECT_EQ( 0u, allocations );
+}
+
+TEST( ThrQueue, FutureContinuations )
+{
+  using namespace game_engine::thr_queue::event;
+  promise< int > prom_a;
+  promise< void > prom_b;
+  auto fut_a = prom_a.get_future( );
+  auto fut_b = prom_b.get_future( );
+
+  auto doubled = fut_a.then( []( future< int > fut ) { return 2 * fut.get( ); } );
+  auto all = when_all( fut_a, fut_b );
+  auto any = when_any( fut_b, fut_a );
+
+  prom_a.set_value( 21 );
+  EXPECT_EQ( 1u, any.get( ) );
+  EXPECT_EQ( 42, doubled.get( ) );
+  EXPECT_FALSE( all.ready( ) );
+
+  prom_b.set_value( );
+  all.wait( );
+  EXPECT_TRUE( fut_b.ready( ) );
+
+  auto failed = fut_b.then( []( future< void > ) -> int { throw std::runtime_error( "test" ); } );
+  EXPECT_THROW( failed.get( ), std::runtime_error );
+
+  std::vector< future< int > > futures{ doubled, future_with_value( 1 ) };
+  EXPECT_EQ( futures.begin( ) + 1, wait_any( futures.begin( ) + 1, futures.end( ) ) );
+  EXPECT_EQ( 2u, when_all( futures.begin( ), futures.end( ) ).get( ).size( ) );
+}
+
+TEST( ThrQueue, PoolAllocator )
+{
+  using game_engine::thr_queue::pool_allocator;
+  pool_allocator< std::string > alloc;
+  auto first = alloc.allocate( 1 );
+  alloc.deallocate( first, 1 );
+  auto second = alloc.allocate( 1 );
+  EXPECT_EQ( first, second );
+  alloc.deallocate( second, 1 );
+
+  using namespace game_engine::thr_queue::event;
+  auto fut = future_with_value( 42 );
+  fut.wait( );
+  EXPECT_TRUE( fut.ready( ) );
+  EXPECT_EQ( 42, fut.peek( ) );
+  EXPECT_EQ( 42, fut.get( ) );
+  EXPECT_THROW( fut.get( ), future_was_emptied_before );
+}
+
+TEST( ThrQueue, MutexModes )
+{
+  using namespace game_engine::thr_queue;
+  for ( auto mode : { event::mutex_mode::adaptive, event::mutex_mode::park } ) {
+    event::mutex mt( mode );
+    int counter = 0;
+    parallel_for( 0, 10000, 10, [&]( int ) {
+      boost::lock_guard< event::mutex > lock( mt );
+      ++counter;
+    } );
+
+    EXPECT_EQ( 10000, counter );
+    auto stats = mt.stats( );
+    EXPECT_EQ( 10000u, stats.acquisitions );
+    EXPECT_LE( stats.spin_acquired + stats.parked, stats.contended );
+    EXPECT_LE( stats.handoffs, stats.parked );
+    if ( mode == event::mutex_mode::park ) {
+      EXPECT_EQ( 0u, stats.spin_acquired );
+    }
+
+    // the last coroutine to lock a mutex destroys it right after unlocking it,
+    // while the others may still be returning from unlock().
+    for ( int round = 0; round < 200; ++round ) {
+      auto* shared = new event::mutex( mode );
+      int left     = 4;
+      parallel_for( 0, 4, 1, [&]( int ) {
+        shared->lock( );
+        bool last = --left == 0;
+        shared->unlock( );
+        if ( last ) {
+          delete shared;
+        }
+      } );
+    }
+  }
+}
+
+TEST( ThrQueue, SharedMutex )
+{
+  using namespace game_engine::thr_queue;
+  event::shared_mutex mt;
+  struct
+  {
+    int a = 0;
+    int b = 0;
+  } test;
+  std::atomic< bool > consistent{ true };
+
+  parallel_for( 0, 10000, 10, [&]( int i ) {
+    if ( i % 10 == 0 ) {
+      boost::unique_lock< event::shared_mutex > lock( mt );
+      test.a++;
+      test.b++;
+    } else {
+      boost::shared_lock< event::shared_mutex > lock( mt );
+      if ( test.a != test.b ) {
+        consistent = false;
+      }
+    }
+  } );
+
+  EXPECT_TRUE( consistent );
+  EXPECT_EQ( 1000, test.a );
+  EXPECT_EQ( 1000, test.b );
+}
+
+TEST( ThrQueue, Channels )
+{
+  using namespace game_engine::thr_queue;
+  const int number = 10000;
+  channel< int > bounded( 4 );
+  channel< std::string > unbounded;
+  long sum            = 0;
+  int received_strings = 0;
+
+  auto& q = default_par_queue( );
+  auto sent_ints = q.submit_work( [&] {
+    for ( int j = 0; j < number; ++j ) {
+      EXPECT_TRUE( bounded.send( j ) );
+    }
+    bounded.close( );
+  } );
+  auto sent_strings = q.submit_work( [&] {
+    for ( int j = 0; j < 100; ++j ) {
+      EXPECT_TRUE( unbounded.send( std::to_string( j ) ) );
+    }
+    unbounded.close( );
+  } );
+  auto received = q.submit_work( [&] {
+    bool open[] = { true, true };
+    while ( open[ 0 ] || open[ 1 ] ) {
+      if ( open[ 0 ] && open[ 1 ] ) {
+        select( on_recv( bounded,
+                         [&]( boost::optional< int > v ) {
+                           if ( v ) {
+                             sum += *v;
+                           } else {
+                             open[ 0 ] = false;
+                           }
+                         } ),
+                on_recv( unbounded, [&]( boost::optional< std::string > v ) {
+                  if ( v ) {
+                    ++received_strings;
+                  } else {
+                    open[ 1 ] = false;
+                  }
+                } ) );
+      } else if ( open[ 0 ] ) {
+        if ( auto v = bounded.recv( ) ) {
+          sum += *v;
+        } else {
+          open[ 0 ] = false;
+        }
+      } else if ( unbounded.recv( ) ) {
+        ++received_strings;
+      } else {
+        open[ 1 ] = false;
+      }
+    }
+  } );
+  wait_all( sent_ints, sent_strings, received );
+
+  EXPECT_EQ( long( number ) * ( number - 1 ) / 2, sum );
+  EXPECT_EQ( 100, received_strings );
+
+  int val = 1;
+  EXPECT_EQ( channel_status::closed, bounded.try_send( val ) );
+  EXPECT_EQ( channel_status::closed, bounded.try_recv( val ) );
+}
+
+TEST( ThrQueue, SemaphoreLatchBarrier )
+{
+  using namespace game_engine::thr_queue;
+  const int workers = 8;
+  const int phases  = 100;
+  event::semaphore sem( 2 );
+  event::barrier bar( workers );
+  std::atomic< int > inside{ 0 };
+  std::atomic< int > max_inside{ 0 };
+  std::atomic< int > arrived{ 0 };
+  std::atomic< bool > phases_ok{ true };
+
+  queue q( queue_type::parallel );
+  for ( int i = 0; i < workers; ++i ) {
+    q.submit_work( [&] {
+      sem.acquire( );
+      auto now = ++inside;
+      auto prev = max_inside.load( );
+      while ( now > prev && !max_inside.compare_exchange_weak( prev, now ) ) {
+      }
+      --inside;
+      sem.release( );
+
+      for ( int p = 0; p < phases; ++p ) {
+        ++arrived;
+        bar.arrive_and_wait( );
+        if ( arrived < ( p + 1 ) * workers ) {
+          phases_ok = false;
+        }
+        bar.arrive_and_wait( );
+      }
+    } );
+  }
+
+  auto waited = default_par_queue( ).submit_work( [&] {
+    event::latch done( workers );
+    schedule_queue( std::move( q ), done );
+    done.wait( );
+    EXPECT_TRUE( done.try_wait( ) );
+  } );
+  waited.wait( );
+
+  EXPECT_LE( max_inside, 2 );
+  EXPECT_TRUE( phases_ok );
+  EXPECT_EQ( workers * phases, arrived );
+}
+
+TEST( ThrQueue, ScheduleQueueNotifies )
+{
+  using namespace game_engine::thr_queue;
+  // the units may still notify after the waiter has seen them all.
+  static event::mutex mt;
+  static event::condition_variable cv;
+  std::atomic< int > completed{ 0 };
+  queue q( queue_type::parallel );
+  for ( int i = 0; i < 10; ++i ) {
+    q.submit_work( [&] { ++completed; } );
+  }
+
+  default_par_queue( )
+    .submit_work( [&] {
+      boost::unique_lock< event::mutex > lock( mt );
+      schedule_queue( std::move( q ), cv, mt, 4 );
+      cv.wait( lock );
+      EXPECT_LE( 4, completed );
+      while ( completed < 10 ) {
+        cv.wait( lock );
+      }
+    } )
+    .wait( );
+}
+
+TEST( ThrQueue, TimerWheel )
+{
+  using namespace game_engine::thr_queue;
+  timer_wheel wheel;
+  // deadlines in every level and in the overflow list.
+  const uint64_t ticks[] = { 1, 63, 64, 100, 4095, 4096, 300000, uint64_t( 1 ) << 24, ( uint64_t( 1 ) << 24 ) + 5 };
+  std::vector< std::unique_ptr< timer_entry > > entries;
+  for ( auto tick : ticks ) {
+    entries.emplace_back( new timer_entry );
+    entries.back( )->deadline = wheel.to_time_point( tick );
+    wheel.add( *entries.back( ) );
+  }
+  timer_entry cancelled;
+  cancelled.deadline = wheel.to_time_point( 200 );
+  wheel.add( cancelled );
+  wheel.remove( cancelled );
+  EXPECT_EQ( entries.size( ), wheel.size( ) );
+
+  std::vector< timer_entry* > expired;
+  for ( size_t i = 0; i < entries.size( ); ++i ) {
+    auto next = wheel.next_expiry( );
+    EXPECT_LE( next, ticks[ i ] );
+    // advancing to just before the deadline doesn't expire anything.
+    wheel.advance( wheel.to_time_point( ticks[ i ] - 1 ), expired );
+    EXPECT_TRUE( expired.empty( ) );
+    wheel.advance( wheel.to_time_point( ticks[ i ] ), expired );
+    ASSERT_EQ( 1u, expired.size( ) );
+    EXPECT_EQ( entries[ i ].get( ), expired.front( ) );
+    expired.clear( );
+  }
+  EXPECT_EQ( 0u, wheel.size( ) );
+  EXPECT_EQ( timer_wheel::no_expiry, wheel.next_expiry( ) );
+
+  // a wheel that hasn't been advanced for hours skips the empty ticks.
+  timer_wheel idle;
+  const uint64_t late = uint64_t( 40 ) << 24;
+  timer_entry entry;
+  entry.deadline = idle.to_time_point( late );
+  idle.add( entry );
+  idle.advance( idle.to_time_point( late - 1 ), expired );
+  EXPECT_TRUE( expired.empty( ) );
+  idle.advance( idle.to_time_point( late ), expired );
+  ASSERT_EQ( 1u, expired.size( ) );
+  EXPECT_EQ( &entry, expired.front( ) );
+  EXPECT_EQ( 0u, idle.size( ) );
+}
+
+TEST( ThrQueue, Timers )
+{
+  using namespace game_engine::thr_queue;
+  const auto delay = std::chrono::milliseconds( 20 );
+  auto& q = default_par_queue( );
+
+  std::vector< event::future< void > > sleepers;
+  std::atomic< bool > slept_enough{ true };
+  for ( int i = 0; i < 1000; ++i ) {
+    sleepers.emplace_back( q.submit_work( [&] {
+      auto start = timer_clock::now( );
+      sleep_for( delay );
+      if ( timer_clock::now( ) - start < delay ) {
+        slept_enough = false;
+      }
+    } ) );
+  }
+  wait_all( sleepers.begin( ), sleepers.end( ) );
+  EXPECT_TRUE( slept_enough );
+
+  event::mutex mt;
+  event::condition_variable cv;
+  event::promise< void > never_set;
+  auto never = never_set.get_future( );
+  auto timed = q.submit_work( [&] {
+    boost::unique_lock< event::mutex > lock( mt );
+    EXPECT_EQ( std::cv_status::timeout, cv.wait_for( lock, delay ) );
+    EXPECT_TRUE( lock.owns_lock( ) );
+    EXPECT_FALSE( never.wait_for( delay ) );
+
+    auto locked = default_par_queue( ).submit_work( [&] { return mt.try_lock_for( delay ); } );
+    EXPECT_FALSE( locked.get( ) );
+    lock.unlock( );
+    auto acquisitions = mt.stats( ).acquisitions;
+    locked            = default_par_queue( ).submit_work( [&] {
+      auto ret = mt.try_lock_for( delay );
+      if ( ret ) {
+        mt.unlock( );
+      }
+      return ret;
+    } );
+    EXPECT_TRUE( locked.wait_for( std::chrono::seconds( 5 ) ) );
+    EXPECT_TRUE( locked.get( ) );
+    EXPECT_EQ( acquisitions + 1, mt.stats( ).acquisitions );
+  } );
+  timed.wait( );
+  never_set.set_value( );
+}
+
+TEST( ThrQueue, PoolStats )
+{
+  using namespace game_engine::thr_queue;
+  auto tasks_run = []( const pool_stats& stats ) {
+    uint64_t ret = 0;
+    for ( auto& w : stats.workers ) {
+      ret += w.tasks_run;
+    }
+    return ret;
+  };
+
+  auto before = get_pool_stats( );
+  EXPECT_FALSE( before.workers.empty( ) );
+  std::vector< event::future< void > > futs;
+  for ( int i = 0; i < 100; ++i ) {
+    futs.emplace_back( default_par_queue( ).submit_work( [] {} ) );
+  }
+  wait_all( futs.begin( ), futs.end( ) );
+  auto after = get_pool_stats( );
+
+  EXPECT_EQ( before.workers.size( ), after.workers.size( ) );
+  // coroutines are counted before they are resumed.
+  EXPECT_GE( tasks_run( after ), tasks_run( before ) + 100 );
+}
+
+TEST( ThrQueue, StackCacheStats )
+{
+  using namespace game_engine::thr_queue;
+  auto before = get_pool_stats( ).stacks;
+  // a new thread starts with an empty cache and adds its hits to the counters
+  // when it exits.
+  boost::thread( [] {
+    for ( int i = 0; i < 10; ++i ) {
+      release_stack( allocate_stack( stack_size_class::small ) );
+    }
+    // one more stack than the cache holds, the last one is released to the
+    // shared cache without the pages that are far from its top.
+    std::vector< allocated_stack > stacks;
+    stacks.reserve( 5 );
+    for ( int i = 0; i < 5; ++i ) {
+      stacks.emplace_back( allocate_stack( stack_size_class::huge ) );
+    }
+    for ( auto& stack : stacks ) {
+      release_stack( std::move( stack ) );
+    }
+    // the stacks left in the cache keep their pages until a worker parks.
+    auto cached_before = get_pool_stats( ).stacks.bytes_reclaimed;
+    reclaim_cached_stacks( );
+    EXPECT_GT( get_pool_stats( ).stacks.bytes_reclaimed, cached_before );
+  } ).join( );
+  auto after = get_pool_stats( ).stacks;
+
+  // the workers may allocate stacks too.
+  EXPECT_GE( after.thread_cache_misses - before.thread_cache_misses, 6u );
+  EXPECT_GE( after.thread_cache_hits - before.thread_cache_hits, 9u );
+  EXPECT_GE( after.global_cache_hits + after.stacks_mapped - before.global_cache_hits - before.stacks_mapped,
+             6u );
+  EXPECT_GT( after.bytes_reclaimed, before.bytes_reclaimed );
+}
+
+TEST( ThrQueue, WakeupStats )
+{
+// the workers of the Windows pool wait on the completion port instead.
+#ifndef _WIN32
+  using namespace game_engine::thr_queue;
+  auto totals = []( uint64_t worker_stats::*counter ) {
+    uint64_t ret = 0;
+    for ( auto& w : get_pool_stats( ).workers ) {
+      ret += w.*counter;
+    }
+    return ret;
+  };
+
+  // the workers park once they run out of work, so work submitted by a thread
+  // that isn't a worker needs a syscall to wake one up.
+  sleep_for( std::chrono::milliseconds( 50 ) );
+  auto sent_before     = totals( &worker_stats::wakeups_sent );
+  auto received_before = totals( &worker_stats::wakeups_received );
+  default_par_queue( ).submit_work( [] {} ).wait( );
+  EXPECT_GT( totals( &worker_stats::wakeups_sent ), sent_before );
+  EXPECT_GT( totals( &worker_stats::wakeups_received ), received_before );
+
+  // coroutines resumed while the workers they are bound to are running don't
+  // need one.
+  const auto workers = get_pool_stats( ).threads;
+  event::promise< void > go;
+  auto go_fut = go.get_future( );
+  std::atomic< bool > go_set{ false };
+  std::atomic< uint64_t > waiting{ 0 };
+  std::vector< event::future< void > > waiters;
+  for ( uint64_t i = 0; i < workers; ++i ) {
+    waiters.emplace_back( default_par_queue( ).submit_work( [&] {
+      ++waiting;
+      go_fut.wait( );
+    } ) );
+  }
+  for ( int i = 0; i < 5000 && waiting < workers; ++i ) {
+    sleep_for( std::chrono::milliseconds( 1 ) );
+  }
+  sleep_for( std::chrono::milliseconds( 10 ) );
+
+  auto avoided_before = totals( &worker_stats::wakeups_avoided );
+  std::atomic< uint64_t > spinning{ 0 };
+  std::atomic< bool > release{ false };
+  std::vector< event::future< void > > spinners;
+  for ( uint64_t i = 0; i < workers; ++i ) {
+    spinners.emplace_back( default_par_queue( ).submit_work( [&] {
+      // the last one sets the promise while the others keep their workers busy.
+      if ( ++spinning == workers && !go_set.exchange( true ) ) {
+        go.set_value( );
+        release = true;
+      }
+      while ( !release ) {
+      }
+    } ) );
+  }
+  for ( int i = 0; i < 5000 && !release; ++i ) {
+    sleep_for( std::chrono::milliseconds( 1 ) );
+  }
+  if ( !go_set.exchange( true ) ) {
+    ADD_FAILURE( ) << "the spinners didn't hold every worker";
+    go.set_value( );
+  }
+  release = true;
+  wait_all( spinners.begin( ), spinners.end( ) );
+  wait_all( waiters.begin( ), waiters.end( ) );
+  EXPECT_GT( totals( &worker_stats::wakeups_avoided ), avoided_before );
+#endif
+}
+
+TEST( ThrQueue, Tracing )
+{
+  using namespace game_engine::thr_queue;
+  start_tracing( 1024 );
+  std::vector< event::future< void > > futs;
+  for ( int i = 0; i < 10; ++i ) {
+    futs.emplace_back( default_par_queue( ).submit_work( [] { sleep_for( std::chrono::milliseconds( 1 ) ); } ) );
+  }
+  wait_all( futs.begin( ), futs.end( ) );
+  // tracing is already on, so the events recorded so far are kept.
+  start_tracing( 1024 );
+  stop_tracing( );
+
+  std::ostringstream out;
+  dump_trace( out );
+  auto json = out.str( );
+  EXPECT_EQ( 0u, json.find( "{\"traceEvents\":[" ) );
+  EXPECT_NE( std::string::npos, json.find( "\"ph\":\"B\"" ) );
+  EXPECT_NE( std::string::npos, json.find( "\"reason\":\"timer\"" ) );
+  EXPECT_NE( std::string::npos, json.find( "\"reason\":\"finished\"" ) );
+  EXPECT_NE( std::string::npos, json.find( "\"name\":\"schedule\"" ) );
+}
+
+TEST( ThrQueue, WorkPriorities )
+{
+  using namespace game_engine::thr_queue;
+  work_options background;
+  background.priority = work_priority::background;
+  work_options urgent;
+  urgent.priority = work_priority::high;
+  urgent.deadline = timer_clock::now( ) + std::chrono::milliseconds( 5 );
+  auto combined = combine_options( background, urgent );
+  EXPECT_EQ( work_priority::high, combined.priority );
+  EXPECT_EQ( urgent.deadline, combined.deadline );
+
+  std::atomic< int > ran{ 0 };
+  std::vector< event::future< void > > futs;
+  for ( int i = 0; i < 500; ++i ) {
+    work_options opts;
+    opts.priority = work_priority( i % number_work_priorities );
+    if ( i % 7 == 0 ) {
+      opts.deadline = timer_clock::now( ) + std::chrono::milliseconds( i % 13 );
+    }
+    futs.emplace_back( default_par_queue( ).submit_work( [&] { ++ran; }, opts ) );
+  }
+  wait_all( futs.begin( ), futs.end( ) );
+  EXPECT_EQ( 500, ran );
+
+  auto stats = get_pool_stats( );
+  EXPECT_EQ( 0u, stats.deadline_queue_size );
+
+  // every worker but one spins while the work given by enqueue runs, so it
+  // runs in the order the scheduler picks it. Returns whether every worker
+  // was held.
+  auto on_one_worker = [&]( auto enqueue ) {
+    const auto workers = get_pool_stats( ).threads;
+    std::atomic< bool > release{ false };
+    std::atomic< bool > free_one{ false };
+    std::atomic< uint64_t > spinning{ 0 };
+    std::vector< event::future< void > > spinners;
+    for ( uint64_t i = 0; i < workers; ++i ) {
+      spinners.emplace_back( default_par_queue( ).submit_work( [&] {
+        ++spinning;
+        bool expected = true;
+        while ( !release && !free_one.compare_exchange_weak( expected, false ) ) {
+          expected = true;
+        }
+      } ) );
+    }
+    for ( int i = 0; i < 5000 && spinning < workers; ++i ) {
+      sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    const bool held = spinning == workers;
+
+    auto queued = enqueue( );
+    free_one    = true;
+    wait_all( queued.begin( ), queued.end( ) );
+    release = true;
+    wait_all( spinners.begin( ), spinners.end( ) );
+    return held;
+  };
+  const auto starvation_limit = pool_options::from_environment( ).starvation_limit;
+
+  // critical work runs first, then the work with a deadline, earliest first,
+  // and then the other classes from the highest to the lowest.
+  const int per_class = 20;
+  std::vector< int > order;
+  std::atomic< size_t > position{ 0 };
+  timer_clock::time_point enqueued;
+  order.resize( per_class * ( number_work_priorities + 1 ) );
+  bool held = on_one_worker( [&] {
+    enqueued = timer_clock::now( );
+    std::vector< event::future< void > > queued;
+    for ( int i = 0; i < per_class * int( number_work_priorities ); ++i ) {
+      work_options opts;
+      opts.priority = work_priority( i % number_work_priorities );
+      auto tag      = 100 * int( opts.priority );
+      queued.emplace_back(
+        default_par_queue( ).submit_work( [&, tag] { order[ position++ ] = tag; }, opts ) );
+    }
+    for ( int i = 0; i < per_class; ++i ) {
+      // a permutation of the ranks of the deadlines.
+      int rank = i * 7 % per_class;
+      work_options opts;
+      opts.deadline = enqueued + std::chrono::hours( 1 ) + std::chrono::milliseconds( rank );
+      queued.emplace_back(
+        default_par_queue( ).submit_work( [&, rank] { order[ position++ ] = 1 + rank; }, opts ) );
+    }
+    return queued;
+  } );
+  EXPECT_TRUE( held );
+  // work that waits for longer than the starvation limit may be run early.
+  if ( held && timer_clock::now( ) - enqueued < starvation_limit ) {
+    std::vector< int > expected( per_class, 0 );
+    for ( int rank = 0; rank < per_class; ++rank ) {
+      expected.push_back( 1 + rank );
+    }
+    for ( size_t prio = 1; prio < number_work_priorities; ++prio ) {
+      expected.insert( expected.end( ), per_class, 100 * int( prio ) );
+    }
+    EXPECT_EQ( expected, order );
+  }
+
+  // background work that has waited for longer than the starvation limit is
+  // run ahead of the high priority work that keeps the worker busy.
+  const int busy_items = int( 2 * starvation_limit.count( ) ) + 64;
+  std::atomic< int > busy_run{ 0 };
+  std::atomic< int > background_rank{ -1 };
+  held = on_one_worker( [&] {
+    std::vector< event::future< void > > queued;
+    work_options opts;
+    opts.priority = work_priority::background;
+    queued.emplace_back(
+      default_par_queue( ).submit_work( [&] { background_rank = busy_run.load( ); }, opts ) );
+    opts.priority = work_priority::high;
+    for ( int i = 0; i < busy_items; ++i ) {
+      queued.emplace_back( default_par_queue( ).submit_work(
+        [&] {
+          auto until = timer_clock::now( ) + std::chrono::milliseconds( 1 );
+          while ( timer_clock::now( ) < until ) {
+          }
+          ++busy_run;
+        },
+        opts ) );
+    }
+    return queued;
+  } );
+  EXPECT_TRUE( held );
+  if ( held ) {
+    EXPECT_LT( background_rank, busy_items );
+  }
+}
+
+TEST( ThrQueue, Topology )
+{
+  using namespace game_engine::thr_queue;
+  EXPECT_EQ( std::vector< unsigned int >( { 0, 1, 2, 3, 8, 10, 11 } ), parse_cpu_list( "0-3,8,10-11\n" ) );
+  EXPECT_EQ( std::vector< unsigned int >( { 2, 5 } ), parse_cpu_list( "5,2,5" ) );
+  EXPECT_TRUE( parse_cpu_list( "3-1" ).empty( ) );
+  EXPECT_TRUE( parse_cpu_list( "a" ).empty( ) );
+
+  auto topo = cpu_topology::detect( { } );
+  ASSERT_FALSE( topo.cpus.empty( ) );
+  EXPECT_GE( topo.number_llc_groups, 1u );
+  size_t grouped = 0;
+  for ( unsigned int group = 0; group < topo.number_llc_groups; ++group ) {
+    grouped += topo.llc_cpus( group ).size( );
+  }
+  EXPECT_EQ( topo.cpus.size( ), grouped );
+  EXPECT_GE( topo.number_packages, 1u );
+  size_t packaged = 0;
+  for ( unsigned int package = 0; package < topo.number_packages; ++package ) {
+    packaged += topo.package_cpus( package ).size( );
+  }
+  EXPECT_EQ( topo.cpus.size( ), packaged );
+
+  auto first = topo.cpus.front( ).id;
+  auto only  = cpu_topology::detect( { first } );
+  ASSERT_EQ( 1u, only.cpus.size( ) );
+  EXPECT_EQ( first, only.cpus.front( ).id );
+}
+
+TEST( ThrQueue, ConfigureAfterStart )
+{
+  using namespace game_engine::thr_queue;
+  // get_pool_stats() starts the pool if nothing else has.
+  get_pool_stats( );
+  EXPECT_FALSE( configure_global_pool( pool_options( ) ) );
+}
+
+TEST( ThrQueue, BlockingSectionsStartWorkers )
+{
+  using namespace game_engine::thr_queue;
+  auto before = get_pool_stats( );
+  // more coroutines than workers block their threads until all of them have
+  // started, which only happens if the pool starts new workers.
+  const auto blockers = before.threads + 2;
+  std::atomic< uint64_t > started{ 0 };
+  std::vector< event::future< void > > futs;
+  for ( uint64_t i = 0; i < blockers; ++i ) {
+    futs.emplace_back( default_par_queue( ).submit_work( [&] {
+      blocking_section blocking;
+      ++started;
+      auto give_up = std::chrono::steady_clock::now( ) + std::chrono::seconds( 5 );
+      while ( started < blockers && std::chrono::steady_clock::now( ) < give_up ) {
+        boost::this_thread::sleep_for( boost::chrono::milliseconds( 1 ) );
+      }
+    } ) );
+  }
+  wait_all( futs.begin( ), futs.end( ) );
+  EXPECT_EQ( blockers, started );
+
+  auto after = get_pool_stats( );
+  EXPECT_GE( after.peak_blocked_threads, blockers );
+  EXPECT_GE( after.peak_threads, blockers );
+  EXPECT_EQ( 0u, after.blocked_threads );
+}
+
+TEST( ThrQueue, TaskGroups )
+{
+  using namespace game_engine::thr_queue;
+  // the first exception is rethrown and cancels the other children.
+  {
+    task_group group;
+    event::promise< void > never;
+    auto never_fut = never.get_future( );
+    std::atomic< int > cancelled{ 0 };
+    // the child that throws waits for the others to start, children that
+    // haven't started when the group is cancelled aren't run at all.
+    event::latch started( 4 );
+    for ( int i = 0; i < 4; ++i ) {
+      group.spawn( [&] {
+        started.count_down( );
+        try {
+          never_fut.wait( );
+        } catch ( const operation_cancelled& ) {
+          ++cancelled;
+          throw;
+        }
+      } );
+    }
+    group.spawn( [&] {
+      started.wait( );
+      throw std::logic_error( "child failed" );
+    } );
+    EXPECT_THROW( group.join( ), std::logic_error );
+    EXPECT_TRUE( group.is_cancelled( ) );
+    EXPECT_EQ( 4, cancelled );
+  }
+
+  // cancelling wakes up children waiting on mutexes and condition variables,
+  // and nested groups are cancelled with their parent.
+  {
+    task_group group;
+    event::mutex mt;
+    event::condition_variable cv;
+    std::atomic< int > waiting{ 0 };
+    std::atomic< int > cancelled{ 0 };
+    boost::unique_lock< event::mutex > held( mt, boost::defer_lock );
+    event::promise< void > locked;
+    event::promise< void > release;
+    auto locked_fut  = locked.get_future( );
+    auto release_fut = release.get_future( );
+    auto holder      = default_par_queue( ).submit_work( [&] {
+      held.lock( );
+      locked.set_value( );
+      release_fut.wait( );
+      held.unlock( );
+    } );
+    locked_fut.wait( );
+
+    group.spawn( [&] {
+      try {
+        ++waiting;
+        boost::lock_guard< event::mutex > l( mt );
+      } catch ( const operation_cancelled& ) {
+        ++cancelled;
+      }
+    } );
+    group.spawn( [&] {
+      task_group nested;
+      nested.spawn( [&] {
+        event::mutex own_mt;
+        boost::unique_lock< event::mutex > l( own_mt );
+        try {
+          ++waiting;
+          cv.wait( l );
+        } catch ( const operation_cancelled& ) {
+          EXPECT_TRUE( l.owns_lock( ) );
+          ++cancelled;
+        }
+      } );
+      nested.join( );
+    } );
+    while ( waiting < 2 ) {
+      sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    sleep_for( std::chrono::milliseconds( 10 ) );
+    group.cancel( );
+    group.join( );
+    EXPECT_EQ( 2, cancelled );
+    EXPECT_TRUE( group.token( ).is_cancelled( ) );
+    release.set_value( );
+    holder.wait( );
+  }
+}
+
+TEST( ThrQueue, AffinityAndLifoSlot )
+{
+  using namespace game_engine::thr_queue;
+  // the slot belongs to the work_stealing scheduler. ctest runs this test on
+  // its own too, see tests/CMakeLists.txt, so that the pool isn't started yet
+  // and can be configured to use it.
+  auto opts      = pool_options::from_environment( );
+  opts.scheduler = scheduler_type::work_stealing;
+  if ( !configure_global_pool( opts ) &&
+       pool_options::from_environment( ).scheduler != scheduler_type::work_stealing ) {
+#ifdef GTEST_SKIP
+    GTEST_SKIP( ) << "the pool was started with another scheduler.";
+#else
+    return;
+#endif
+  }
+  auto totals = []( uint64_t worker_stats::*counter ) {
+    uint64_t ret = 0;
+    for ( auto& w : get_pool_stats( ).workers ) {
+      ret += w.*counter;
+    }
+    return ret;
+  };
+
+  auto resumed_before   = totals( &worker_stats::affinity_hits ) + totals( &worker_stats::affinity_misses );
+  auto lifo_hits_before = totals( &worker_stats::lifo_hits );
+  // every round trip spawns a child and resumes the parent once the child has
+  // set the value.
+  default_par_queue( )
+    .submit_work( [] {
+      for ( int i = 0; i < 50; ++i ) {
+        event::promise< void > done;
+        auto fut = done.get_future( );
+        default_par_queue( ).submit_work( [&] { done.set_value( ); } );
+        fut.wait( );
+      }
+    } )
+    .wait( );
+  auto resumed_after = totals( &worker_stats::affinity_hits ) + totals( &worker_stats::affinity_misses );
+
+#ifdef _WIN32
+  EXPECT_GT( resumed_after, resumed_before );
+#else
+  // the parent is bound to the worker that first ran it, bound coroutines
+  // aren't counted.
+  EXPECT_EQ( resumed_after, resumed_before );
+#endif
+  // the children are spawned by a worker, they go to its slot unless a thief
+  // takes them first.
+  EXPECT_GT( totals( &worker_stats::lifo_hits ), lifo_hits_before );
+  EXPECT_LE( totals( &worker_stats::lifo_hits ), totals( &worker_stats::lifo_pushes ) );
+}
+
+#ifndef _WIN32
+TEST( ThrQueue, IoWait )
+{
+  using namespace game_engine::thr_queue;
+  int fds[ 2 ];
+  ASSERT_EQ( 0, socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds ) );
+  {
+    io_handle reader( fds[ 0 ] );
+    io_handle writer( fds[ 1 ] );
+    const int messages = 1000;
+    auto received      = default_par_queue( ).submit_work( [&] {
+      for ( int got = 0; got < messages; ) {
+        char c;
+        if ( read( fds[ 0 ], &c, 1 ) == 1 ) {
+          EXPECT_EQ( char( got ), c );
+          ++got;
+        } else {
+          ASSERT_EQ( EAGAIN, errno );
+          reader.wait_readable( );
+        }
+      }
+    } );
+    default_par_queue( )
+      .submit_work( [&] {
+        for ( int i = 0; i < messages; ++i ) {
+          char c = char( i );
+          while ( write( fds[ 1 ], &c, 1 ) != 1 ) {
+            writer.wait_writable( );
+          }
+          if ( i % 100 == 0 ) {
+            // lets the reader park.
+            sleep_for( std::chrono::milliseconds( 1 ) );
+          }
+        }
+      } )
+      .wait( );
+    received.wait( );
+
+    // a coroutine waiting for a fd that never gets ready can be cancelled.
+    std::atomic< bool > cancelled{ false };
+    task_group group;
+    group.spawn( [&] {
+      try {
+        while ( true ) {
+          reader.wait_readable( );
+        }
+      } catch ( const operation_cancelled& ) {
+        cancelled = true;
+        throw;
+      }
+    } );
+    sleep_for( std::chrono::milliseconds( 10 ) );
+    group.cancel( );
+    group.join( );
+    EXPECT_TRUE( cancelled );
+
+    // closing the handle wakes up its waiters and fails the later waits.
+    auto closed = default_par_queue( ).submit_work( [&] {
+      while ( reader.wait_readable( ) ) {
+      }
+    } );
+    sleep_for( std::chrono::milliseconds( 10 ) );
+    reader.close( );
+    EXPECT_TRUE( closed.wait_for( std::chrono::seconds( 5 ) ) );
+    EXPECT_FALSE( reader.wait_readable( ) );
+  }
+
+  // a worker that keeps finding work still resumes the coroutines waiting for
+  // its fds.
+  {
+    io_handle reader( fds[ 0 ] );
+    auto woken = default_par_queue( ).submit_work( [&] {
+      char c;
+      while ( read( fds[ 0 ], &c, 1 ) != 1 ) {
+        reader.wait_readable( );
+      }
+    } );
+    sleep_for( std::chrono::milliseconds( 10 ) );
+
+    std::atomic< bool > done{ false };
+    std::atomic< int > links{ 0 };
+    std::function< void( ) > chain = [&] {
+      if ( !done ) {
+        ++links;
+        default_par_queue( ).submit_work( chain );
+      }
+      --links;
+    };
+    for ( uint64_t i = 0; i < 4 * get_pool_stats( ).threads; ++i ) {
+      ++links;
+      default_par_queue( ).submit_work( chain );
+    }
+    sleep_for( std::chrono::milliseconds( 10 ) );
+    char c = 1;
+    EXPECT_EQ( 1, write( fds[ 1 ], &c, 1 ) );
+    EXPECT_TRUE( woken.wait_for( std::chrono::seconds( 5 ) ) );
+    done = true;
+    while ( links > 0 ) {
+      sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    woken.wait( );
+  }
+  close( fds[ 0 ] );
+  close( fds[ 1 ] );
+}
+#endif
+
+TEST( ThrQueue, RunBlocking )
+{
+  using namespace game_engine::thr_queue;
+  auto before = get_pool_stats( ).blocking;
+  // outside of a coroutine the calling thread runs it.
+  auto caller = boost::this_thread::get_id( );
+  EXPECT_EQ( caller, run_blocking( [] { return boost::this_thread::get_id( ); } ) );
+  EXPECT_EQ( before.submitted, get_pool_stats( ).blocking.submitted );
+
+  const int calls = 32;
+  std::atomic< int > on_workers{ 0 };
+  std::vector< event::future< void > > futs;
+  for ( int i = 0; i < calls; ++i ) {
+    futs.emplace_back( default_par_queue( ).submit_work( [&, i] {
+      auto worker = boost::this_thread::get_id( );
+      auto ret    = run_blocking( [&, i] {
+        if ( boost::this_thread::get_id( ) == worker ) {
+          ++on_workers;
+        }
+        boost::this_thread::sleep_for( boost::chrono::milliseconds( 5 ) );
+        return i;
+      } );
+      EXPECT_EQ( i, ret );
+    } ) );
+  }
+  wait_all( futs.begin( ), futs.end( ) );
+  EXPECT_EQ( 0, on_workers );
+
+  default_par_queue( )
+    .submit_work( [] {
+      EXPECT_THROW( run_blocking( [] { throw std::logic_error( "blocking call failed" ); } ),
+                    std::logic_error );
+      run_blocking( [] {} );
+    } )
+    .wait( );
+
+  // a call is counted as completed after its caller has been woken up.
+  auto after = get_pool_stats( ).blocking;
+  for ( int i = 0; i < 1000 && after.completed != after.submitted; ++i ) {
+    sleep_for( std::chrono::milliseconds( 1 ) );
+    after = get_pool_stats( ).blocking;
+  }
+  EXPECT_EQ( before.submitted + calls + 2, after.submitted );
+  EXPECT_EQ( after.submitted, after.completed );
+  EXPECT_GE( after.threads, 1u );
+  EXPECT_EQ( 0u, after.queue_size );
+  EXPECT_GE( after.peak_queue_size, 1u );
+}
+
+TEST( ThrQueue, BlockingLaneQueueLimit )
+{
+  using namespace game_engine::thr_queue;
+  // one thread and room for two queued calls.
+  blocking_lane lane( 1, 2 );
+  std::atomic< bool > release{ false };
+  std::atomic< int > ran{ 0 };
+  auto wait_for_stats = [&]( auto pred ) {
+    for ( int i = 0; i < 5000 && !pred( lane.stats( ) ); ++i ) {
+      sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    return pred( lane.stats( ) );
+  };
+
+  default_par_queue( )
+    .submit_work( [&] {
+      lane.submit( [&] {
+        while ( !release ) {
+          boost::this_thread::sleep_for( boost::chrono::milliseconds( 1 ) );
+        }
+        ++ran;
+      } );
+    } )
+    .wait( );
+  // the thread has taken the first call, so the next two fill the queue.
+  ASSERT_TRUE( wait_for_stats( []( const blocking_lane_stats& s ) { return s.busy_threads == 1; } ) );
+  default_par_queue( )
+    .submit_work( [&] {
+      lane.submit( [&] { ++ran; } );
+      lane.submit( [&] { ++ran; } );
+    } )
+    .wait( );
+  EXPECT_EQ( 2u, lane.stats( ).queue_size );
+
+  auto parked = default_par_queue( ).submit_work( [&] { lane.submit( [&] { ++ran; } ); } );
+  EXPECT_TRUE( wait_for_stats( []( const blocking_lane_stats& s ) { return s.queue_full_waits == 1; } ) );
+  EXPECT_FALSE( parked.ready( ) );
+  EXPECT_EQ( 2u, lane.stats( ).queue_size );
+
+  release = true;
+  parked.wait( );
+  lane.stop( );
+  auto stats = lane.stats( );
+  EXPECT_EQ( 4, ran );
+  EXPECT_EQ( 4u, stats.submitted );
+  EXPECT_EQ( 4u, stats.completed );
+  EXPECT_EQ( 1u, stats.queue_full_waits );
+  EXPECT_EQ( 2u, stats.peak_queue_size );
+  EXPECT_EQ( 0u, stats.queue_size );
+}
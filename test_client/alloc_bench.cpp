@@ -0,0 +1,116 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <thr_queue/functor.h>
+#include <thr_queue/global_thr_pool.h>
+#include <thr_queue/queue.h>
+#include <vector>
+
+// Prints how many heap allocations are made per submitted task by the
+// different ways of storing and running work.
+
+using namespace game_engine::thr_queue;
+
+static std::atomic< uint64_t > allocations{ 0 };
+
+void*
+operator new( size_t size )
+{
+  ++allocations;
+  if ( auto ptr = malloc( size ) ) {
+    return ptr;
+  }
+  throw std::bad_alloc( );
+}
+
+void
+operator delete( void* ptr ) noexcept
+{
+  free( ptr );
+}
+
+void
+operator delete( void* ptr, size_t ) noexcept
+{
+  free( ptr );
+}
+
+template < typename F >
+static void
+measure( const char* name, size_t tasks, F func )
+{
+  auto allocs_before = allocations.load( );
+  auto start         = std::chrono::steady_clock::now( );
+  func( );
+  auto end    = std::chrono::steady_clock::now( );
+  auto allocs = allocations.load( ) - allocs_before;
+  auto ns     = std::chrono::duration_cast< std::chrono::nanoseconds >( end - start ).count( );
+  std::cout << name << ": " << double( allocs ) / tasks << " allocations/task, " << double( ns ) / tasks
+            << " ns/task" << std::endl;
+}
+
+int
+main( int argc, const char* argv[] )
+{
+  size_t tasks = 100000;
+  if ( argc > 1 ) {
+    tasks = std::strtoull( argv[ 1 ], nullptr, 10 );
+  }
+  std::atomic< size_t > counter{ 0 };
+
+  measure( "functor_ptr (make_functor)", tasks, [&] {
+    std::vector< functor_ptr > funcs;
+    funcs.reserve( tasks );
+    for ( size_t i = 0; i < tasks; ++i ) {
+      funcs.push_back( make_functor( [&counter, i] { counter += i; } ) );
+    }
+    for ( auto& f : funcs ) {
+      ( *f )( );
+    }
+  } );
+
+  measure( "inline_functor", tasks, [&] {
+    std::vector< inline_functor > funcs;
+    funcs.reserve( tasks );
+    for ( size_t i = 0; i < tasks; ++i ) {
+      funcs.push_back( [&counter, i] { counter += i; } );
+    }
+    for ( auto& f : funcs ) {
+      f( );
+    }
+  } );
+
+  measure( "queue::submit_work + run_until_empty", tasks, [&] {
+    queue q( queue_type::parallel );
+    for ( size_t i = 0; i < tasks; ++i ) {
+      q.submit_work( [&counter, i] { counter += i; } );
+    }
+    q.run_until_empty( );
+  } );
+
+  measure( "queue::submit_work + schedule_queue", tasks, [&] {
+    boost::mutex mt;
+    boost::condition_variable cv;
+    std::atomic< size_t > done{ 0 };
+    queue q( queue_type::parallel );
+    for ( size_t i = 0; i < tasks; ++i ) {
+      q.submit_work( [&, i] {
+        counter += i;
+        if ( ++done == tasks ) {
+          boost::lock_guard< boost::mutex > lock( mt );
+          cv.notify_one( );
+        }
+      } );
+    }
+    boost::unique_lock< boost::mutex > lock( mt );
+    schedule_queue( std::move( q ) );
+    while ( done != tasks ) {
+      cv.wait( lock );
+    }
+  } );
+
+  // so that the work can't be optimized away.
+  std::cout << "checksum: " << counter << std::endl;
+}
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thr_queue/event/future.h>
+#include <thr_queue/event/semaphore.h>
+#include <thr_queue/global_thr_pool.h>
+#include <thr_queue/pool_stats.h>
+#include <thr_queue/queue.h>
+#include <thr_queue/timer.h>
+#include <thr_queue/util_queue.h>
+
+// Prints the latency of a round trip between two coroutines that wake each
+// other up, and how many of the wakeups needed a syscall.
+
+using namespace game_engine::thr_queue;
+
+static void
+measure( const char* name, size_t rounds, std::chrono::microseconds pause )
+{
+  event::semaphore ping;
+  event::semaphore pong;
+  std::chrono::nanoseconds round_trips( 0 );
+  auto stats_before = get_pool_stats( );
+
+  auto ponger = default_par_queue( ).submit_work( [&] {
+    for ( size_t i = 0; i < rounds; ++i ) {
+      ping.acquire( );
+      pong.release( );
+    }
+  } );
+  auto pinger = default_par_queue( ).submit_work( [&] {
+    for ( size_t i = 0; i < rounds; ++i ) {
+      if ( pause.count( ) > 0 ) {
+        // lets the ponger's worker park between rounds.
+        sleep_for( pause );
+      }
+      auto start = std::chrono::steady_clock::now( );
+      ping.release( );
+      pong.acquire( );
+      round_trips += std::chrono::steady_clock::now( ) - start;
+    }
+  } );
+  pinger.wait( );
+  ponger.wait( );
+
+  auto stats_after  = get_pool_stats( );
+  auto wakeups_sent = stats_after.wakeups_sent - stats_before.wakeups_sent;
+  auto avoided      = stats_after.wakeups_avoided - stats_before.wakeups_avoided;
+  std::cout << name << ": " << double( round_trips.count( ) ) / rounds << " ns/round trip, "
+            << double( wakeups_sent ) / rounds << " wakeup syscalls/round trip, "
+            << double( avoided ) / rounds << " avoided/round trip" << std::endl;
+}
+
+int
+main( int argc, const char* argv[] )
+{
+  size_t rounds = 100000;
+  if ( argc > 1 ) {
+    rounds = std::strtoull( argv[ 1 ], nullptr, 10 );
+  }
+
+  measure( "busy ping-pong", rounds, std::chrono::microseconds( 0 ) );
+  // most round trips have to wake up a parked worker.
+  measure( "ping-pong with parking", rounds / 100, std::chrono::microseconds( 200 ) );
+}